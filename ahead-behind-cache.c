@@ -0,0 +1,299 @@
+#include "git-compat-util.h"
+#include "ahead-behind-cache.h"
+#include "commit.h"
+#include "commit-graph.h"
+#include "commit-reach.h"
+#include "config.h"
+#include "gettext.h"
+#include "hash.h"
+#include "lockfile.h"
+#include "oidset.h"
+#include "path.h"
+#include "refs.h"
+#include "repository.h"
+#include "strbuf.h"
+#include "trace2.h"
+
+/*
+ * The cache file consists of a header, followed by one record per pair
+ * of commits, sorted by tip and then by base:
+ *
+ *	4-byte signature "ABHC"
+ *	4-byte version number (1)
+ *	4-byte hash format id (e.g. "sha1")
+ *
+ *	For each record:
+ *	    tip object name (hash length bytes)
+ *	    base object name (hash length bytes)
+ *	    4-byte "ahead" count
+ *	    4-byte "behind" count
+ *
+ * All integers are in network byte order.
+ */
+#define AHEAD_BEHIND_CACHE_FILE "ahead-behind-cache"
+#define AHEAD_BEHIND_CACHE_SIGNATURE 0x41424843 /* "ABHC" */
+#define AHEAD_BEHIND_CACHE_VERSION 1
+#define AHEAD_BEHIND_CACHE_HEADER_SIZE 12
+
+struct ahead_behind_entry {
+	struct object_id tip;
+	struct object_id base;
+	uint32_t ahead;
+	uint32_t behind;
+	unsigned used : 1;
+};
+
+struct ahead_behind_entries {
+	struct ahead_behind_entry *entry;
+	size_t nr, alloc;
+};
+
+int ahead_behind_cache_enabled(struct repository *r)
+{
+	int enabled;
+
+	if (repo_config_get_bool(r, "core.aheadbehindcache", &enabled))
+		return 0;
+	return enabled;
+}
+
+static size_t record_size(const struct git_hash_algo *algo)
+{
+	return 2 * algo->rawsz + 2 * sizeof(uint32_t);
+}
+
+static void add_be32(struct strbuf *sb, uint32_t value)
+{
+	unsigned char buf[4];
+
+	put_be32(buf, value);
+	strbuf_add(sb, buf, sizeof(buf));
+}
+
+static int entry_cmp(const void *va, const void *vb)
+{
+	const struct ahead_behind_entry *a = va, *b = vb;
+	int cmp = oidcmp(&a->tip, &b->tip);
+
+	return cmp ? cmp : oidcmp(&a->base, &b->base);
+}
+
+static void read_cache(struct repository *r, const char *path,
+		       struct ahead_behind_entries *entries)
+{
+	const struct git_hash_algo *algo = r->hash_algo;
+	struct strbuf buf = STRBUF_INIT;
+	size_t rec_size = record_size(algo);
+	const unsigned char *p, *end;
+
+	if (strbuf_read_file(&buf, path, 0) < 0)
+		return;
+
+	if (buf.len < AHEAD_BEHIND_CACHE_HEADER_SIZE ||
+	    (buf.len - AHEAD_BEHIND_CACHE_HEADER_SIZE) % rec_size ||
+	    get_be32(buf.buf) != AHEAD_BEHIND_CACHE_SIGNATURE ||
+	    get_be32(buf.buf + 4) != AHEAD_BEHIND_CACHE_VERSION ||
+	    get_be32(buf.buf + 8) != algo->format_id) {
+		warning(_("ignoring invalid ahead/behind cache '%s'"), path);
+		goto out;
+	}
+
+	p = (const unsigned char *)buf.buf + AHEAD_BEHIND_CACHE_HEADER_SIZE;
+	end = (const unsigned char *)buf.buf + buf.len;
+	ALLOC_GROW(entries->entry, (end - p) / rec_size, entries->alloc);
+	for (; p < end; p += rec_size) {
+		struct ahead_behind_entry *e = &entries->entry[entries->nr++];
+
+		oidread(&e->tip, p, algo);
+		oidread(&e->base, p + algo->rawsz, algo);
+		e->ahead = get_be32(p + 2 * algo->rawsz);
+		e->behind = get_be32(p + 2 * algo->rawsz + 4);
+		e->used = 0;
+
+		if (entries->nr > 1 && entry_cmp(e - 1, e) >= 0) {
+			warning(_("ignoring invalid ahead/behind cache '%s'"), path);
+			entries->nr = 0;
+			goto out;
+		}
+	}
+
+out:
+	strbuf_release(&buf);
+}
+
+static struct ahead_behind_entry *lookup_entry(struct ahead_behind_entries *entries,
+					       const struct object_id *tip,
+					       const struct object_id *base)
+{
+	struct ahead_behind_entry key;
+
+	oidcpy(&key.tip, tip);
+	oidcpy(&key.base, base);
+	return bsearch(&key, entries->entry, entries->nr,
+		       sizeof(*entries->entry), entry_cmp);
+}
+
+static int add_ref_tip(const struct reference *ref, void *cb_data)
+{
+	struct oidset *tips = cb_data;
+
+	oidset_insert(tips, ref->oid);
+	if (ref->peeled_oid)
+		oidset_insert(tips, ref->peeled_oid);
+	return 0;
+}
+
+static void write_cache(struct repository *r, const char *path,
+			struct ahead_behind_entries *entries)
+{
+	const struct git_hash_algo *algo = r->hash_algo;
+	struct lock_file lock = LOCK_INIT;
+	struct oidset tips = OIDSET_INIT;
+	struct strbuf buf = STRBUF_INIT;
+	struct ref_store *refs = get_main_ref_store(r);
+	const struct object_id *prev_tip = NULL, *prev_base = NULL;
+	size_t written = 0;
+
+	/*
+	 * If somebody else is updating the cache right now we simply leave
+	 * it to them.
+	 */
+	if (hold_lock_file_for_update(&lock, path, 0) < 0)
+		return;
+
+	refs_head_ref(refs, add_ref_tip, &tips);
+	refs_for_each_ref(refs, add_ref_tip, &tips);
+
+	QSORT(entries->entry, entries->nr, entry_cmp);
+
+	strbuf_grow(&buf, AHEAD_BEHIND_CACHE_HEADER_SIZE +
+		    st_mult(entries->nr, record_size(algo)));
+	add_be32(&buf, AHEAD_BEHIND_CACHE_SIGNATURE);
+	add_be32(&buf, AHEAD_BEHIND_CACHE_VERSION);
+	add_be32(&buf, algo->format_id);
+
+	for (size_t i = 0; i < entries->nr; i++) {
+		struct ahead_behind_entry *e = &entries->entry[i];
+
+		if (prev_tip && oideq(prev_tip, &e->tip) &&
+		    oideq(prev_base, &e->base))
+			continue;
+		if (!e->used &&
+		    (!oidset_contains(&tips, &e->tip) ||
+		     !oidset_contains(&tips, &e->base)))
+			continue;
+
+		strbuf_add(&buf, e->tip.hash, algo->rawsz);
+		strbuf_add(&buf, e->base.hash, algo->rawsz);
+		add_be32(&buf, e->ahead);
+		add_be32(&buf, e->behind);
+		prev_tip = &e->tip;
+		prev_base = &e->base;
+		written++;
+	}
+
+	if (write_in_full(get_lock_file_fd(&lock), buf.buf, buf.len) < 0)
+		rollback_lock_file(&lock);
+	else
+		commit_lock_file(&lock);
+
+	trace2_data_intmax("ahead-behind-cache", r, "written", written);
+
+	oidset_clear(&tips);
+	strbuf_release(&buf);
+}
+
+void ahead_behind_cached(struct repository *r,
+			 struct commit **commits, size_t commits_nr,
+			 struct ahead_behind_count *counts, size_t counts_nr)
+{
+	struct ahead_behind_entries entries = { 0 };
+	struct commit **missing_commits = NULL;
+	struct ahead_behind_count *missing = NULL;
+	size_t missing_commits_nr = 0, missing_nr = 0;
+	size_t *missing_pos = NULL, *commit_map = NULL;
+	char *path;
+
+	if (!commit_graph_compatible(r)) {
+		ahead_behind(r, commits, commits_nr, counts, counts_nr);
+		return;
+	}
+
+	path = repo_git_path(r, AHEAD_BEHIND_CACHE_FILE);
+	read_cache(r, path, &entries);
+
+	ALLOC_ARRAY(missing, counts_nr);
+	ALLOC_ARRAY(missing_pos, counts_nr);
+	for (size_t i = 0; i < counts_nr; i++) {
+		struct ahead_behind_count *count = &counts[i];
+		struct ahead_behind_entry *e;
+
+		e = lookup_entry(&entries,
+				 &commits[count->tip_index]->object.oid,
+				 &commits[count->base_index]->object.oid);
+		if (e) {
+			count->ahead = e->ahead;
+			count->behind = e->behind;
+			e->used = 1;
+			continue;
+		}
+		missing_pos[missing_nr] = i;
+		missing[missing_nr++] = *count;
+	}
+
+	trace2_data_intmax("ahead-behind-cache", r, "hits",
+			   counts_nr - missing_nr);
+	trace2_data_intmax("ahead-behind-cache", r, "misses", missing_nr);
+
+	if (!missing_nr)
+		goto out;
+
+	/*
+	 * Only walk from the commits that take part in one of the missing
+	 * counts, so that the walk does not have to cover the history of
+	 * tips whose counts we already know.
+	 */
+	ALLOC_ARRAY(commit_map, commits_nr);
+	for (size_t i = 0; i < commits_nr; i++)
+		commit_map[i] = SIZE_MAX;
+	ALLOC_ARRAY(missing_commits, commits_nr);
+	for (size_t i = 0; i < missing_nr; i++) {
+		size_t *index[] = { &missing[i].tip_index, &missing[i].base_index };
+
+		for (size_t j = 0; j < ARRAY_SIZE(index); j++) {
+			if (commit_map[*index[j]] == SIZE_MAX) {
+				missing_commits[missing_commits_nr] = commits[*index[j]];
+				commit_map[*index[j]] = missing_commits_nr++;
+			}
+			*index[j] = commit_map[*index[j]];
+		}
+	}
+
+	ahead_behind(r, missing_commits, missing_commits_nr,
+		     missing, missing_nr);
+
+	ALLOC_GROW(entries.entry, st_add(entries.nr, missing_nr), entries.alloc);
+	for (size_t i = 0; i < missing_nr; i++) {
+		struct ahead_behind_count *count = &counts[missing_pos[i]];
+		struct ahead_behind_entry *e = &entries.entry[entries.nr++];
+
+		count->ahead = missing[i].ahead;
+		count->behind = missing[i].behind;
+
+		oidcpy(&e->tip, &commits[count->tip_index]->object.oid);
+		oidcpy(&e->base, &commits[count->base_index]->object.oid);
+		e->ahead = count->ahead;
+		e->behind = count->behind;
+		e->used = 1;
+	}
+
+	write_cache(r, path, &entries);
+
+out:
+	free(path);
+	free(missing);
+	free(missing_pos);
+	free(missing_commits);
+	free(commit_map);
+	free(entries.entry);
+}
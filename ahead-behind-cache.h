@@ -0,0 +1,35 @@
+#ifndef AHEAD_BEHIND_CACHE_H
+#define AHEAD_BEHIND_CACHE_H
+
+struct repository;
+struct commit;
+struct ahead_behind_count;
+
+/*
+ * A cache for the results of ahead_behind(), stored in
+ * "$GIT_DIR/ahead-behind-cache".
+ *
+ * Entries are keyed on the object names of the tip and the base commit.
+ * As long as the history is not rewritten by grafts, replace refs or a
+ * shallow clone (in which case the cache is not used at all), the counts
+ * for a pair of commits never change, so entries do not need to be
+ * invalidated. When references move, only the pairs involving their new
+ * tips have to be computed. Entries are dropped once they have neither
+ * been used by the latest query nor refer to current reference tips.
+ */
+
+/*
+ * Return whether "core.aheadBehindCache" is enabled for the repository.
+ */
+int ahead_behind_cache_enabled(struct repository *r);
+
+/*
+ * Like ahead_behind(), but take the counts from the cache where possible.
+ * Only the counts that are missing are computed, and they are added to
+ * the cache afterwards. Errors while writing the cache are ignored.
+ */
+void ahead_behind_cached(struct repository *r,
+			 struct commit **commits, size_t commits_nr,
+			 struct ahead_behind_count *counts, size_t counts_nr);
+
+#endif /* AHEAD_BEHIND_CACHE_H */
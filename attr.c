@@ -427,6 +427,8 @@ struct match_attr *parse_attr_line(const char *line, const char *src,
  * .gitignore file and info/excludes file as a fallback.
  */
 
+struct attr_index;
+
 struct attr_stack {
 	struct attr_stack *prev;
 	char *origin;
@@ -434,11 +436,16 @@ struct attr_stack {
 	unsigned num_matches;
 	unsigned alloc;
 	struct match_attr **attrs;
+	/* lookup tables for the patterns in attrs[], see fill_indexed() */
+	struct attr_index *index;
 };
 
+static void attr_index_free(struct attr_index *index);
+
 static void attr_stack_free(struct attr_stack *e)
 {
 	unsigned i;
+	attr_index_free(e->index);
 	free(e->origin);
 	for (i = 0; i < e->num_matches; i++) {
 		struct match_attr *a = e->attrs[i];
@@ -1114,14 +1121,131 @@ static int fill_one(struct all_attrs_item *all_attrs,
 	return rem;
 }
 
+/*
+ * Large attribute files mostly consist of patterns without wildcards,
+ * like "*.png" or "/path/to/file". Instead of matching every path with
+ * each of them, we put them into a "struct pattern_index" (see dir.h).
+ * The tables are built per attr_stack element the first time it is
+ * used; as the stack belongs to a single attr_check, and each thread
+ * uses its own attr_check, this needs no locking.
+ */
+#define ATTR_INDEX_MIN_PATTERNS 32
+
+/* set up by attr_start(), before any threads can look at it */
+static unsigned long attr_index_min_patterns = ATTR_INDEX_MIN_PATTERNS;
+
+struct attr_index {
+	struct pattern_index patterns;
+	/* positions of the patterns matching the current path */
+	int *found;
+	size_t found_nr, found_alloc;
+	/* used by attr_index_found() */
+	const struct attr_stack *stack;
+	int isdir;
+};
+
+static void attr_index_free(struct attr_index *index)
+{
+	if (!index)
+		return;
+	pattern_index_clear(&index->patterns);
+	free(index->found);
+	free(index);
+}
+
+static struct attr_index *attr_index_build(const struct attr_stack *stack)
+{
+	struct attr_index *index;
+	struct strbuf base = STRBUF_INIT;
+
+	CALLOC_ARRAY(index, 1);
+	pattern_index_init(&index->patterns);
+	if (stack->originlen)
+		strbuf_addf(&base, "%s/", stack->origin);
+
+	for (unsigned i = 0; i < stack->num_matches; i++) {
+		const struct match_attr *a = stack->attrs[i];
+
+		if (a->is_macro)
+			continue;
+		pattern_index_add(&index->patterns, i, a->u.pat.pattern,
+				  a->u.pat.patternlen, a->u.pat.nowildcardlen,
+				  a->u.pat.flags, base.buf, base.len);
+	}
+	strbuf_release(&base);
+	return index;
+}
+
+static void attr_index_found(int pos, void *data)
+{
+	struct attr_index *index = data;
+	const struct match_attr *a = index->stack->attrs[pos];
+
+	if ((a->u.pat.flags & PATTERN_FLAG_MUSTBEDIR) && !index->isdir)
+		return;
+	ALLOC_GROW(index->found, index->found_nr + 1, index->found_alloc);
+	index->found[index->found_nr++] = pos;
+}
+
+static int cmp_pos_desc(const void *a_, const void *b_)
+{
+	int a = *(const int *)a_, b = *(const int *)b_;
+
+	return a < b ? 1 : a > b ? -1 : 0;
+}
+
+/*
+ * Like the loop in fill() over a single stack element, but using the
+ * lookup tables: collect all matching patterns, then apply them from
+ * the last one to the first one.
+ */
+static int fill_indexed(const char *path, int pathlen, int basename_offset,
+			struct attr_stack *stack,
+			struct all_attrs_item *all_attrs, int rem)
+{
+	struct attr_index *index = stack->index;
+	const char *base = stack->origin ? stack->origin : "";
+	int isdir = (pathlen && path[pathlen - 1] == '/');
+
+	index->found_nr = 0;
+	index->stack = stack;
+	index->isdir = isdir;
+	pattern_index_for_each_match(&index->patterns, path, pathlen - isdir,
+				     basename_offset, attr_index_found, index);
+	for (size_t i = 0; i < index->patterns.other_nr; i++) {
+		int pos = index->patterns.other[i];
+		const struct match_attr *a = stack->attrs[pos];
+
+		if (path_matches(path, pathlen, basename_offset,
+				 &a->u.pat, base, stack->originlen)) {
+			ALLOC_GROW(index->found, index->found_nr + 1,
+				   index->found_alloc);
+			index->found[index->found_nr++] = pos;
+		}
+	}
+
+	QSORT(index->found, index->found_nr, cmp_pos_desc);
+	for (size_t i = 0; 0 < rem && i < index->found_nr; i++)
+		rem = fill_one(all_attrs, stack->attrs[index->found[i]], rem);
+	return rem;
+}
+
 static int fill(const char *path, int pathlen, int basename_offset,
-		const struct attr_stack *stack,
+		struct attr_stack *stack,
 		struct all_attrs_item *all_attrs, int rem)
 {
 	for (; rem > 0 && stack; stack = stack->prev) {
 		unsigned i;
 		const char *base = stack->origin ? stack->origin : "";
 
+		if (stack->num_matches >= attr_index_min_patterns) {
+			if (!stack->index)
+				stack->index = attr_index_build(stack);
+			rem = fill_indexed(path, pathlen, basename_offset,
+					   stack, all_attrs, rem);
+			continue;
+		}
+
 		for (i = stack->num_matches; 0 < rem && 0 < i; i--) {
 			const struct match_attr *a = stack->attrs[i - 1];
 			if (a->is_macro)
@@ -1364,4 +1488,6 @@ void attr_start(void)
 {
 	pthread_mutex_init(&g_attr_hashmap.mutex, NULL);
 	pthread_mutex_init(&check_vector.mutex, NULL);
+	attr_index_min_patterns = git_env_ulong("GIT_TEST_ATTR_INDEX_MIN",
+						ATTR_INDEX_MIN_PATTERNS);
 }
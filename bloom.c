@@ -12,6 +12,7 @@
 #include "tree-walk.h"
 #include "config.h"
 #include "repository.h"
+#include "odb.h"
 
 define_commit_slab(bloom_filter_slab, struct bloom_filter);
 
@@ -433,18 +434,9 @@ struct bloom_filter *get_bloom_filter(struct repository *r, struct commit *c)
 	return filter;
 }
 
-struct bloom_filter *get_or_compute_bloom_filter(struct repository *r,
-						 struct commit *c,
-						 int compute_if_not_present,
-						 const struct bloom_filter_settings *settings,
-						 enum bloom_filter_computed *computed)
+struct bloom_filter *load_bloom_filter(struct repository *r, struct commit *c)
 {
 	struct bloom_filter *filter;
-	int i;
-	struct diff_options diffopt;
-
-	if (computed)
-		*computed = BLOOM_NOT_COMPUTED;
 
 	if (!bloom_filters.slab_size)
 		return NULL;
@@ -460,48 +452,92 @@ struct bloom_filter *get_or_compute_bloom_filter(struct repository *r,
 			load_bloom_filter_from_graph(g, filter, graph_pos);
 	}
 
-	if (filter->data && filter->len) {
-		struct bloom_filter *upgrade;
-		if (!settings || settings->hash_version == filter->version)
-			return filter;
+	return filter;
+}
 
-		/* version mismatch, see if we can upgrade */
-		if (compute_if_not_present &&
-		    git_env_bool("GIT_TEST_UPGRADE_BLOOM_FILTERS", 1)) {
-			upgrade = upgrade_filter(r, c, filter,
-						 settings->hash_version);
-			if (upgrade) {
-				if (computed)
-					*computed |= BLOOM_UPGRADED;
-				return upgrade;
-			}
-		}
-	}
-	if (!compute_if_not_present)
-		return NULL;
+/*
+ * Queue the changes into the queue given as "change_fn_data" instead of
+ * the global diff queue. Deciding whether a submodule is ignored reads its
+ * configuration, which is only safe under the object read lock.
+ */
+static void bloom_diff_check_max_changes(struct diff_options *opt,
+					 struct diff_queue_struct *queue)
+{
+	if (opt->max_changes && queue->nr > opt->max_changes)
+		opt->flags.quick = 1;
+}
+
+static void bloom_diff_add_remove(struct diff_options *opt,
+				  int addremove, unsigned mode,
+				  const struct object_id *oid,
+				  int oid_valid, const char *fullpath,
+				  unsigned dirty_submodule)
+{
+	struct diff_queue_struct *queue = opt->change_fn_data;
+
+	if (S_ISGITLINK(mode))
+		obj_read_lock();
+	diff_queue_addremove(queue, opt, addremove, mode, oid, oid_valid,
+			     fullpath, dirty_submodule);
+	if (S_ISGITLINK(mode))
+		obj_read_unlock();
+	bloom_diff_check_max_changes(opt, queue);
+}
+
+static void bloom_diff_change(struct diff_options *opt,
+			      unsigned old_mode, unsigned new_mode,
+			      const struct object_id *old_oid,
+			      const struct object_id *new_oid,
+			      int old_oid_valid, int new_oid_valid,
+			      const char *fullpath,
+			      unsigned old_dirty_submodule,
+			      unsigned new_dirty_submodule)
+{
+	struct diff_queue_struct *queue = opt->change_fn_data;
+	int gitlink = S_ISGITLINK(old_mode) && S_ISGITLINK(new_mode);
+
+	if (gitlink)
+		obj_read_lock();
+	diff_queue_change(queue, opt, old_mode, new_mode, old_oid, new_oid,
+			  old_oid_valid, new_oid_valid, fullpath,
+			  old_dirty_submodule, new_dirty_submodule);
+	if (gitlink)
+		obj_read_unlock();
+	bloom_diff_check_max_changes(opt, queue);
+}
+
+enum bloom_filter_computed compute_bloom_filter(struct repository *r,
+						struct commit *c,
+						const struct bloom_filter_settings *settings,
+						struct bloom_filter *filter)
+{
+	enum bloom_filter_computed computed = BLOOM_COMPUTED;
+	struct diff_queue_struct queue = DIFF_QUEUE_INIT;
+	struct diff_options diffopt;
+	int i;
 
 	repo_diff_setup(r, &diffopt);
 	diffopt.flags.recursive = 1;
 	diffopt.detect_rename = 0;
 	diffopt.max_changes = settings->max_changed_paths;
+	diffopt.add_remove = bloom_diff_add_remove;
+	diffopt.change = bloom_diff_change;
+	diffopt.change_fn_data = &queue;
 	diff_setup_done(&diffopt);
 
-	/* ensure commit is parsed so we have parent information */
-	repo_parse_commit(r, c);
-
 	if (c->parents)
 		diff_tree_oid(&c->parents->item->object.oid, &c->object.oid, "", &diffopt);
 	else
 		diff_tree_oid(NULL, &c->object.oid, "", &diffopt);
-	diffcore_std(&diffopt);
+	diff_free(&diffopt);
 
-	if (diff_queued_diff.nr <= settings->max_changed_paths) {
+	if (queue.nr <= settings->max_changed_paths) {
 		struct hashmap pathmap = HASHMAP_INIT(pathmap_cmp, NULL);
 		struct pathmap_hash_entry *e;
 		struct hashmap_iter iter;
 
-		for (i = 0; i < diff_queued_diff.nr; i++) {
-			char *path = diff_queued_diff.queue[i]->two->path;
+		for (i = 0; i < queue.nr; i++) {
+			char *path = queue.queue[i]->two->path;
 
 			/*
 			 * Add each leading directory of the changed file, i.e. for
@@ -532,16 +568,14 @@ struct bloom_filter *get_or_compute_bloom_filter(struct repository *r,
 		if (hashmap_get_size(&pathmap) > settings->max_changed_paths) {
 			init_truncated_large_filter(filter,
 						    settings->hash_version);
-			if (computed)
-				*computed |= BLOOM_TRUNC_LARGE;
+			computed |= BLOOM_TRUNC_LARGE;
 			goto cleanup;
 		}
 
 		filter->len = (hashmap_get_size(&pathmap) * settings->bits_per_entry + BITS_PER_WORD - 1) / BITS_PER_WORD;
 		filter->version = settings->hash_version;
 		if (!filter->len) {
-			if (computed)
-				*computed |= BLOOM_TRUNC_EMPTY;
+			computed |= BLOOM_TRUNC_EMPTY;
 			filter->len = 1;
 		}
 		CALLOC_ARRAY(filter->data, filter->len);
@@ -558,15 +592,56 @@ struct bloom_filter *get_or_compute_bloom_filter(struct repository *r,
 		hashmap_clear_and_free(&pathmap, struct pathmap_hash_entry, entry);
 	} else {
 		init_truncated_large_filter(filter, settings->hash_version);
+		computed |= BLOOM_TRUNC_LARGE;
+	}
+
+	diff_queue_clear(&queue);
+	return computed;
+}
+
+struct bloom_filter *get_or_compute_bloom_filter(struct repository *r,
+						 struct commit *c,
+						 int compute_if_not_present,
+						 const struct bloom_filter_settings *settings,
+						 enum bloom_filter_computed *computed)
+{
+	struct bloom_filter *filter;
+	enum bloom_filter_computed result;
+
+	if (computed)
+		*computed = BLOOM_NOT_COMPUTED;
+
+	filter = load_bloom_filter(r, c);
+	if (!filter)
+		return NULL;
 
-		if (computed)
-			*computed |= BLOOM_TRUNC_LARGE;
+	if (filter->data && filter->len) {
+		struct bloom_filter *upgrade;
+		if (!settings || settings->hash_version == filter->version)
+			return filter;
+
+		/* version mismatch, see if we can upgrade */
+		if (compute_if_not_present &&
+		    git_env_bool("GIT_TEST_UPGRADE_BLOOM_FILTERS", 1)) {
+			upgrade = upgrade_filter(r, c, filter,
+						 settings->hash_version);
+			if (upgrade) {
+				if (computed)
+					*computed |= BLOOM_UPGRADED;
+				return upgrade;
+			}
+		}
 	}
+	if (!compute_if_not_present)
+		return NULL;
+
+	/* ensure commit is parsed so we have parent information */
+	repo_parse_commit(r, c);
 
+	result = compute_bloom_filter(r, c, settings, filter);
 	if (computed)
-		*computed |= BLOOM_COMPUTED;
+		*computed |= result;
 
-	diff_queue_clear(&diff_queued_diff);
 	return filter;
 }
 
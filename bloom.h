@@ -130,6 +130,25 @@ struct bloom_filter *get_or_compute_bloom_filter(struct repository *r,
 						 const struct bloom_filter_settings *settings,
 						 enum bloom_filter_computed *computed);
 
+/*
+ * Return the slot for the Bloom filter of "c", after loading the filter
+ * from the commit-graph if there is one. The slot's "data" is NULL if the
+ * filter is neither loaded nor computed yet. Returns NULL if Bloom filters
+ * have not been initialized.
+ */
+struct bloom_filter *load_bloom_filter(struct repository *r, struct commit *c);
+
+/*
+ * Compute the Bloom filter of the parsed commit "c" into "filter" from
+ * scratch. This neither uses the global diff queue nor the Bloom filter
+ * slab, so it may be called from multiple threads at once as long as the
+ * object read lock is enabled (see enable_obj_read_lock()).
+ */
+enum bloom_filter_computed compute_bloom_filter(struct repository *r,
+						struct commit *c,
+						const struct bloom_filter_settings *settings,
+						struct bloom_filter *filter);
+
 /*
  * Find the Bloom filter associated with the given commit "c".
  *
@@ -20,7 +20,9 @@
 #define BUILTIN_COMMIT_GRAPH_WRITE_USAGE \
 	N_("git commit-graph write [--object-dir <dir>] [--append]\n" \
 	   "                       [--split[=<strategy>]] [--reachable | --stdin-packs | --stdin-commits]\n" \
-	   "                       [--changed-paths] [--[no-]max-new-filters <n>] [--[no-]progress]\n" \
+	   "                       [--changed-paths] [--[no-]max-new-filters <n>]\n" \
+	   "                       [--[no-]reachability-index] [--[no-]changed-path-lists]\n" \
+	   "                       [--[no-]progress]\n" \
 	   "                       <split-options>")
 
 static const char * const builtin_commit_graph_verify_usage[] = {
@@ -49,6 +51,8 @@ static struct opts_commit_graph {
 	int shallow;
 	int progress;
 	int enable_changed_paths;
+	int enable_reachability_index;
+	int enable_changed_path_lists;
 } opts;
 
 static struct option common_opts[] = {
@@ -143,6 +147,7 @@ static int graph_verify(int argc, const char **argv, const char *prefix,
 
 extern int read_replace_refs;
 static struct commit_graph_opts write_opts;
+static enum commit_graph_split_flags split_strategy;
 
 static int write_option_parse_split(const struct option *opt, const char *arg,
 				    int unset)
@@ -159,6 +164,8 @@ static int write_option_parse_split(const struct option *opt, const char *arg,
 		*flags = COMMIT_GRAPH_SPLIT_MERGE_PROHIBITED;
 	else if (!strcmp(arg, "replace"))
 		*flags = COMMIT_GRAPH_SPLIT_REPLACE;
+	else if (!strcmp(arg, "cost"))
+		*flags = COMMIT_GRAPH_SPLIT_MERGE_BY_COST;
 	else
 		die(_("unrecognized --split argument, %s"), arg);
 
@@ -210,8 +217,24 @@ static int git_commit_graph_write_config(const char *var, const char *value,
 {
 	if (!strcmp(var, "commitgraph.maxnewfilters"))
 		write_opts.max_new_filters = git_config_int(var, value, ctx->kvi);
+	else if (!strcmp(var, "commitgraph.maxlookupcost"))
+		write_opts.max_lookup_cost = git_config_int(var, value, ctx->kvi);
+	else if (!strcmp(var, "commitgraph.splitstrategy")) {
+		if (!value)
+			return config_error_nonbool(var);
+		if (!strcmp(value, "cost"))
+			split_strategy = COMMIT_GRAPH_SPLIT_MERGE_BY_COST;
+		else if (!strcmp(value, "size"))
+			split_strategy = COMMIT_GRAPH_SPLIT_UNSPECIFIED;
+		else
+			warning(_("ignoring unknown %s value '%s'"), var, value);
+	}
 	else if (!strcmp(var, "commitgraph.changedpaths"))
 		opts.enable_changed_paths = git_config_bool(var, value) ? 1 : -1;
+	else if (!strcmp(var, "commitgraph.reachabilityindex"))
+		opts.enable_reachability_index = git_config_bool(var, value) ? 1 : -1;
+	else if (!strcmp(var, "commitgraph.changedpathlists"))
+		opts.enable_changed_path_lists = git_config_bool(var, value) ? 1 : -1;
 	/*
 	 * No need to fall-back to 'git_default_config', since this was already
 	 * called in 'cmd_commit_graph()'.
@@ -241,6 +264,10 @@ static int graph_write(int argc, const char **argv, const char *prefix,
 			N_("include all commits already in the commit-graph file")),
 		OPT_BOOL(0, "changed-paths", &opts.enable_changed_paths,
 			N_("enable computation for changed paths")),
+		OPT_BOOL(0, "reachability-index", &opts.enable_reachability_index,
+			N_("enable computation of the reachability index")),
+		OPT_BOOL(0, "changed-path-lists", &opts.enable_changed_path_lists,
+			N_("enable computation of changed-path lists")),
 		OPT_CALLBACK_F(0, "split", &write_opts.split_flags, NULL,
 			N_("allow writing an incremental commit-graph file"),
 			PARSE_OPT_OPTARG | PARSE_OPT_NONEG,
@@ -254,6 +281,8 @@ static int graph_write(int argc, const char **argv, const char *prefix,
 		OPT_CALLBACK_F(0, "max-new-filters", &write_opts.max_new_filters,
 			NULL, N_("maximum number of changed-path Bloom filters to compute"),
 			0, write_option_max_new_filters),
+		OPT_INTEGER(0, "max-lookup-cost", &write_opts.max_lookup_cost,
+			N_("maximum average number of layers to probe for a commit with --split=cost")),
 		OPT_BOOL(0, "progress", &opts.progress,
 			 N_("force progress reporting")),
 		OPT_END(),
@@ -262,10 +291,13 @@ static int graph_write(int argc, const char **argv, const char *prefix,
 
 	opts.progress = isatty(2);
 	opts.enable_changed_paths = -1;
+	opts.enable_reachability_index = -1;
+	opts.enable_changed_path_lists = -1;
 	write_opts.size_multiple = 2;
 	write_opts.max_commits = 0;
 	write_opts.expire_time = 0;
 	write_opts.max_new_filters = -1;
+	write_opts.max_lookup_cost = 3;
 
 	trace2_cmd_mode("write");
 
@@ -285,6 +317,12 @@ static int graph_write(int argc, const char **argv, const char *prefix,
 		flags |= COMMIT_GRAPH_WRITE_APPEND;
 	if (opts.split)
 		flags |= COMMIT_GRAPH_WRITE_SPLIT;
+	if (opts.split && write_opts.split_flags == COMMIT_GRAPH_SPLIT_UNSPECIFIED)
+		write_opts.split_flags = split_strategy;
+	if (opts.split &&
+	    write_opts.split_flags == COMMIT_GRAPH_SPLIT_MERGE_BY_COST &&
+	    write_opts.max_lookup_cost < 1)
+		die(_("--max-lookup-cost must be at least 1"));
 	if (opts.progress)
 		flags |= COMMIT_GRAPH_WRITE_PROGRESS;
 	if (!opts.enable_changed_paths)
@@ -292,6 +330,14 @@ static int graph_write(int argc, const char **argv, const char *prefix,
 	if (opts.enable_changed_paths == 1 ||
 	    git_env_bool(GIT_TEST_COMMIT_GRAPH_CHANGED_PATHS, 0))
 		flags |= COMMIT_GRAPH_WRITE_BLOOM_FILTERS;
+	if (!opts.enable_reachability_index)
+		flags |= COMMIT_GRAPH_NO_WRITE_REACHABILITY_INDEX;
+	if (opts.enable_reachability_index == 1)
+		flags |= COMMIT_GRAPH_WRITE_REACHABILITY_INDEX;
+	if (!opts.enable_changed_path_lists)
+		flags |= COMMIT_GRAPH_NO_WRITE_CHANGED_PATH_LISTS;
+	if (opts.enable_changed_path_lists == 1)
+		flags |= COMMIT_GRAPH_WRITE_CHANGED_PATH_LISTS;
 
 	source = odb_find_source_or_die(the_repository->objects, opts.obj_dir);
 
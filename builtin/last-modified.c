@@ -7,17 +7,23 @@
 #include "config.h"
 #include "diff.h"
 #include "diffcore.h"
+#include "dir.h"
 #include "environment.h"
 #include "ewah/ewok.h"
 #include "hashmap.h"
 #include "hex.h"
+#include "lockfile.h"
 #include "object-name.h"
 #include "object.h"
+#include "odb.h"
 #include "parse-options.h"
+#include "path.h"
 #include "prio-queue.h"
 #include "quote.h"
 #include "repository.h"
 #include "revision.h"
+#include "thread-utils.h"
+#include "trace2.h"
 
 /* Remember to update object flag allocation in object.h */
 #define PARENT1 (1u<<16) /* used instead of SEEN */
@@ -55,7 +61,15 @@ struct last_modified {
 	struct rev_info rev;
 	bool show_trees;
 	bool nul_termination;
+	bool changed_path_lists;
 	int max_depth;
+	int threads;
+	bool use_cache;
+	int cache_entries;
+
+	/* The output so far, as it is stored in the cache. */
+	struct strbuf cache_records;
+	bool record;
 
 	const char **all_paths;
 	size_t all_paths_nr;
@@ -65,24 +79,36 @@ struct last_modified {
 	struct bitmap *scratch;
 };
 
-static struct bitmap *active_paths_for(struct last_modified *lm, struct commit *c)
+static struct bitmap *active_paths_at(struct active_paths_for_commit *active_paths,
+				      size_t nr, struct commit *c)
 {
-	struct bitmap **bitmap = active_paths_for_commit_at(&lm->active_paths, c);
+	struct bitmap **bitmap = active_paths_for_commit_at(active_paths, c);
 	if (!*bitmap)
-		*bitmap = bitmap_word_alloc(lm->all_paths_nr / BITS_IN_EWORD + 1);
+		*bitmap = bitmap_word_alloc(nr / BITS_IN_EWORD + 1);
 
 	return *bitmap;
 }
 
-static void active_paths_free(struct last_modified *lm, struct commit *c)
+static void active_paths_clear(struct active_paths_for_commit *active_paths,
+			       struct commit *c)
 {
-	struct bitmap **bitmap = active_paths_for_commit_at(&lm->active_paths, c);
+	struct bitmap **bitmap = active_paths_for_commit_at(active_paths, c);
 	if (*bitmap) {
 		bitmap_free(*bitmap);
 		*bitmap = NULL;
 	}
 }
 
+static struct bitmap *active_paths_for(struct last_modified *lm, struct commit *c)
+{
+	return active_paths_at(&lm->active_paths, lm->all_paths_nr, c);
+}
+
+static void active_paths_free(struct last_modified *lm, struct commit *c)
+{
+	active_paths_clear(&lm->active_paths, c);
+}
+
 static void last_modified_release(struct last_modified *lm)
 {
 	struct hashmap_iter iter;
@@ -95,6 +121,7 @@ static void last_modified_release(struct last_modified *lm)
 	release_revisions(&lm->rev);
 
 	free(lm->all_paths);
+	strbuf_release(&lm->cache_records);
 }
 
 struct last_modified_callback_data {
@@ -167,13 +194,17 @@ static int populate_paths_from_revs(struct last_modified *lm)
 	return ret;
 }
 
-static void last_modified_emit(struct last_modified *lm,
-			       const char *path, const struct commit *commit)
-
+static void last_modified_emit(struct last_modified *lm, const char *path,
+			       const struct object_id *oid, bool boundary)
 {
-	if (commit->object.flags & BOUNDARY)
+	if (lm->record) {
+		strbuf_add(&lm->cache_records, oid->hash, lm->rev.repo->hash_algo->rawsz);
+		strbuf_add(&lm->cache_records, path, strlen(path) + 1);
+	}
+
+	if (boundary)
 		putchar('^');
-	printf("%s\t", oid_to_hex(&commit->object.oid));
+	printf("%s\t", oid_to_hex(oid));
 
 	if (lm->nul_termination)
 		printf("%s%c", path, '\0');
@@ -199,7 +230,8 @@ static void mark_path(const char *path, const struct object_id *oid,
 	if (oid && !oideq(oid, &ent->oid))
 		return;
 
-	last_modified_emit(data->lm, path, data->commit);
+	last_modified_emit(data->lm, path, &data->commit->object.oid,
+			   data->commit->object.flags & BOUNDARY);
 
 	hashmap_remove(&data->lm->paths, &ent->hashent, path);
 	bloom_key_clear(&ent->key);
@@ -254,21 +286,72 @@ static void pass_to_parent(struct bitmap *c,
 	bitmap_set(p, pos);
 }
 
+static bool is_active_path(struct last_modified *lm, const char *path,
+			   struct bitmap *active)
+{
+	struct last_modified_entry *ent =
+		hashmap_get_entry_from_hash(&lm->paths, strhash(path), path,
+					    struct last_modified_entry, hashent);
+
+	return ent && (!active || bitmap_get(active, ent->diff_idx));
+}
+
+/*
+ * The changed-path lists of the commit-graph only record files, so check
+ * their leading directories, too, in case we are looking at trees.
+ */
+static bool changed_path_in_list(struct last_modified *lm,
+				 struct commit_changed_paths *paths,
+				 struct bitmap *active)
+{
+	struct strbuf path = STRBUF_INIT;
+	bool changed = false;
+
+	for (size_t i = 0; !changed && i < paths->nr; i++) {
+		char *slash;
+
+		strbuf_reset(&path);
+		strbuf_addstr(&path, commit_changed_path(paths, i));
+		changed = is_active_path(lm, path.buf, active);
+		while (!changed && (slash = strrchr(path.buf, '/'))) {
+			strbuf_setlen(&path, slash - path.buf);
+			changed = is_active_path(lm, path.buf, active);
+		}
+	}
+
+	strbuf_release(&path);
+	return changed;
+}
+
 static bool maybe_changed_path(struct last_modified *lm,
 			       struct commit *origin,
 			       struct bitmap *active)
 {
-	struct bloom_filter *filter;
+	struct bloom_filter *filter = NULL;
 	struct last_modified_entry *ent;
 	struct hashmap_iter iter;
+	struct commit_changed_paths paths;
+	bool have_paths;
 
-	if (!lm->rev.bloom_filter_settings)
-		return true;
+	/*
+	 * Finding the commit in the commit-graph is not thread-safe, but
+	 * the lists and filters we get are read-only.
+	 */
+	obj_read_lock();
+	have_paths = lm->changed_path_lists &&
+		!get_commit_changed_paths(lm->rev.repo, origin, &paths);
+	if (!have_paths && lm->rev.bloom_filter_settings &&
+	    commit_graph_generation(origin) != GENERATION_NUMBER_INFINITY)
+		filter = get_bloom_filter(lm->rev.repo, origin);
+	obj_read_unlock();
 
-	if (commit_graph_generation(origin) == GENERATION_NUMBER_INFINITY)
-		return true;
+	/*
+	 * The lists tell us exactly whether one of our paths changed. If
+	 * one did, we still need the diff to learn its new object name.
+	 */
+	if (have_paths)
+		return changed_path_in_list(lm, &paths, active);
 
-	filter = get_bloom_filter(lm->rev.repo, origin);
 	if (!filter)
 		return true;
 
@@ -295,7 +378,7 @@ static void process_parent(struct last_modified *lm,
 
 	/*
 	 * The first time entering this function for this commit (i.e. first parent)
-	 * see if Bloom filters will tell us it's worth to do the diff.
+	 * see if the commit-graph will tell us it's worth to do the diff.
 	 */
 	if (parent_i || maybe_changed_path(lm, c, active_c)) {
 		diff_tree_oid(&parent->object.oid,
@@ -341,7 +424,487 @@ static void process_parent(struct last_modified *lm,
 	diff_queue_clear(&diff_queued_diff);
 }
 
-static int last_modified_run(struct last_modified *lm)
+/*
+ * With more than one thread, the paths are split up between the threads
+ * and each of them walks the history for its share of the paths on its
+ * own. A path is always passed on to the first parent it is TREESAME to,
+ * so every path follows a single line of history, and the commit it ends
+ * up at neither depends on the other paths walked along with it nor on
+ * the order in which commits are visited.
+ *
+ * The threads share the parsed commits, their Bloom filters and their
+ * changed-path lists, which are looked up under the object read lock.
+ * Everything else is private to each thread: the active paths, the
+ * queue, and a copy of the diff options that queues the changes into a
+ * diff queue of its own instead of the global one. The object flags are
+ * left alone, and the results are only shown once all threads are done.
+ */
+struct walk_commit_info {
+	timestamp_t generation;
+	unsigned queued : 1;
+};
+
+define_commit_slab(walk_commit_info_slab, struct walk_commit_info);
+
+struct last_modified_thread {
+	struct last_modified *lm;
+	pthread_t thread;
+	struct commit *start;
+
+	/* The indices of the paths in `lm->all_paths` walked by this thread. */
+	size_t *paths;
+	size_t paths_nr;
+
+	struct active_paths_for_commit active_paths;
+	struct walk_commit_info_slab info;
+	struct bitmap *scratch;
+	struct diff_options diffopt;
+	struct diff_queue_struct queue;
+
+	/* The commit that last modified each path, shared by all threads. */
+	struct commit **result;
+};
+
+static int compare_walk_commits(const void *a_, const void *b_, void *data)
+{
+	struct walk_commit_info_slab *info = data;
+	const struct commit *a = a_, *b = b_;
+	timestamp_t generation_a = walk_commit_info_slab_peek(info, a)->generation;
+	timestamp_t generation_b = walk_commit_info_slab_peek(info, b)->generation;
+
+	/* Like compare_commits_by_gen_then_commit_date(). */
+	if (generation_a < generation_b)
+		return 1;
+	if (generation_a > generation_b)
+		return -1;
+	if (a->date < b->date)
+		return 1;
+	if (a->date > b->date)
+		return -1;
+	return 0;
+}
+
+static void thread_enqueue(struct last_modified_thread *t,
+			   struct prio_queue *queue, struct commit *c)
+{
+	struct walk_commit_info *info = walk_commit_info_slab_at(&t->info, c);
+
+	obj_read_lock();
+	info->generation = commit_graph_generation(c);
+	obj_read_unlock();
+	info->queued = 1;
+	prio_queue_put(queue, c);
+}
+
+static void thread_diff_add_remove(struct diff_options *opt,
+				   int addremove, unsigned mode,
+				   const struct object_id *oid,
+				   int oid_valid,
+				   const char *fullpath, unsigned dirty_submodule)
+{
+	struct diff_queue_struct *queue = opt->change_fn_data;
+
+	/* Looking at a submodule may need to read objects. */
+	obj_read_lock();
+	diff_queue_addremove(queue, opt, addremove, mode, oid, oid_valid,
+			     fullpath, dirty_submodule);
+	obj_read_unlock();
+}
+
+static void thread_diff_change(struct diff_options *opt,
+			       unsigned old_mode, unsigned new_mode,
+			       const struct object_id *old_oid,
+			       const struct object_id *new_oid,
+			       int old_oid_valid, int new_oid_valid,
+			       const char *fullpath,
+			       unsigned old_dirty_submodule,
+			       unsigned new_dirty_submodule)
+{
+	struct diff_queue_struct *queue = opt->change_fn_data;
+
+	obj_read_lock();
+	diff_queue_change(queue, opt, old_mode, new_mode, old_oid, new_oid,
+			  old_oid_valid, new_oid_valid, fullpath,
+			  old_dirty_submodule, new_dirty_submodule);
+	obj_read_unlock();
+}
+
+/* Like process_parent(), but for the share of paths of a single thread. */
+static void thread_process_parent(struct last_modified_thread *t,
+				  struct prio_queue *queue,
+				  struct commit *c, struct bitmap *active_c,
+				  struct commit *parent, int parent_i)
+{
+	struct last_modified *lm = t->lm;
+	struct walk_commit_info *info;
+	struct bitmap *active_p;
+
+	obj_read_lock();
+	repo_parse_commit(lm->rev.repo, parent);
+	obj_read_unlock();
+	active_p = active_paths_at(&t->active_paths, lm->all_paths_nr, parent);
+
+	if (parent_i || maybe_changed_path(lm, c, active_c))
+		diff_tree_oid(&parent->object.oid,
+			      &c->object.oid, "", &t->diffopt);
+
+	for (int i = 0; i < t->queue.nr; i++) {
+		const char *path = t->queue.queue[i]->two->path;
+		struct last_modified_entry *ent =
+			hashmap_get_entry_from_hash(&lm->paths, strhash(path), path,
+						    struct last_modified_entry, hashent);
+		if (ent && bitmap_get(active_c, ent->diff_idx))
+			bitmap_set(t->scratch, ent->diff_idx);
+	}
+	for (size_t i = 0; i < t->paths_nr; i++) {
+		size_t k = t->paths[i];
+
+		if (bitmap_get(active_c, k) && !bitmap_get(t->scratch, k))
+			pass_to_parent(active_c, active_p, k);
+	}
+
+	info = walk_commit_info_slab_at(&t->info, parent);
+	if (!bitmap_is_empty(active_p) && !info->queued)
+		thread_enqueue(t, queue, parent);
+	if (!info->queued)
+		active_paths_clear(&t->active_paths, parent);
+
+	MEMZERO_ARRAY(t->scratch->words, t->scratch->word_alloc);
+	diff_queue_clear(&t->queue);
+}
+
+static void *last_modified_thread_walk(void *data)
+{
+	struct last_modified_thread *t = data;
+	struct last_modified *lm = t->lm;
+	struct prio_queue queue = {
+		.compare = compare_walk_commits,
+		.cb_data = &t->info,
+	};
+	struct bitmap *active;
+
+	active = active_paths_at(&t->active_paths, lm->all_paths_nr, t->start);
+	for (size_t i = 0; i < t->paths_nr; i++)
+		bitmap_set(active, t->paths[i]);
+	thread_enqueue(t, &queue, t->start);
+
+	while (queue.nr) {
+		int parent_i;
+		struct commit_list *p;
+		struct commit *c = prio_queue_get(&queue);
+		struct bitmap *active_c =
+			active_paths_at(&t->active_paths, lm->all_paths_nr, c);
+
+		for (p = c->parents, parent_i = 0; p; p = p->next, parent_i++) {
+			thread_process_parent(t, &queue, c, active_c,
+					      p->item, parent_i);
+
+			if (bitmap_is_empty(active_c))
+				break;
+		}
+
+		for (size_t i = 0; i < t->paths_nr; i++) {
+			if (bitmap_get(active_c, t->paths[i]))
+				t->result[t->paths[i]] = c;
+		}
+
+		active_paths_clear(&t->active_paths, c);
+	}
+
+	clear_prio_queue(&queue);
+	return NULL;
+}
+
+static int path_index_cmp(const void *va, const void *vb, void *data)
+{
+	struct last_modified *lm = data;
+	size_t a = *(const size_t *)va, b = *(const size_t *)vb;
+
+	return strcmp(lm->all_paths[a], lm->all_paths[b]);
+}
+
+static int result_index_cmp(const void *va, const void *vb, void *data)
+{
+	struct commit **result = data;
+	size_t a = *(const size_t *)va, b = *(const size_t *)vb;
+	int cmp;
+
+	if (result[a] != result[b]) {
+		cmp = compare_commits_by_gen_then_commit_date(result[a],
+							      result[b], NULL);
+		return cmp ? cmp : oidcmp(&result[a]->object.oid,
+					  &result[b]->object.oid);
+	}
+	return a < b ? -1 : a > b;
+}
+
+/*
+ * Walk the history from "start" for all paths with "nr_threads" threads,
+ * and show the results in the order of the commits they were found at,
+ * like the single-threaded walk does.
+ */
+static void last_modified_run_threaded(struct last_modified *lm,
+				       struct commit *start, int nr_threads)
+{
+	struct last_modified_callback_data data = { .lm = lm };
+	struct last_modified_thread *threads;
+	struct commit **result;
+	size_t *paths;
+
+	CALLOC_ARRAY(result, lm->all_paths_nr);
+	ALLOC_ARRAY(paths, lm->all_paths_nr);
+	for (size_t i = 0; i < lm->all_paths_nr; i++)
+		paths[i] = i;
+
+	/*
+	 * Keep the paths of a directory together, as they tend to be
+	 * changed by the same commits.
+	 */
+	QSORT_S(paths, lm->all_paths_nr, path_index_cmp, lm);
+
+	trace2_region_enter("last-modified", "walk", lm->rev.repo);
+	trace2_data_intmax("last-modified", lm->rev.repo, "threads", nr_threads);
+
+	enable_obj_read_lock();
+	CALLOC_ARRAY(threads, nr_threads);
+	for (int i = 0; i < nr_threads; i++) {
+		struct last_modified_thread *t = &threads[i];
+		size_t begin = st_mult(lm->all_paths_nr, i) / nr_threads;
+		size_t end = st_mult(lm->all_paths_nr, i + 1) / nr_threads;
+
+		t->lm = lm;
+		t->start = start;
+		t->paths = paths + begin;
+		t->paths_nr = end - begin;
+		t->result = result;
+		init_active_paths_for_commit(&t->active_paths);
+		init_walk_commit_info_slab(&t->info);
+		t->scratch = bitmap_word_alloc(lm->all_paths_nr / BITS_IN_EWORD + 1);
+		diff_queue_init(&t->queue);
+
+		memcpy(&t->diffopt, &lm->rev.diffopt, sizeof(t->diffopt));
+		copy_pathspec(&t->diffopt.pathspec, &lm->rev.diffopt.pathspec);
+		t->diffopt.add_remove = thread_diff_add_remove;
+		t->diffopt.change = thread_diff_change;
+		t->diffopt.change_fn_data = &t->queue;
+
+		if (pthread_create(&t->thread, NULL, last_modified_thread_walk, t))
+			die(_("unable to create thread"));
+	}
+	for (int i = 0; i < nr_threads; i++) {
+		struct last_modified_thread *t = &threads[i];
+
+		if (pthread_join(t->thread, NULL))
+			die(_("unable to join thread"));
+
+		clear_active_paths_for_commit(&t->active_paths);
+		clear_walk_commit_info_slab(&t->info);
+		bitmap_free(t->scratch);
+		clear_pathspec(&t->diffopt.pathspec);
+	}
+	disable_obj_read_lock();
+
+	trace2_region_leave("last-modified", "walk", lm->rev.repo);
+
+	for (size_t i = 0; i < lm->all_paths_nr; i++) {
+		if (!result[i])
+			BUG("no commit found for '%s' in last-modified",
+			    lm->all_paths[i]);
+		paths[i] = i;
+	}
+	QSORT_S(paths, lm->all_paths_nr, result_index_cmp, result);
+
+	for (size_t i = 0; i < lm->all_paths_nr; i++) {
+		data.commit = result[paths[i]];
+		mark_path(lm->all_paths[paths[i]], NULL, &data);
+	}
+
+	free(threads);
+	free(paths);
+	free(result);
+}
+
+/*
+ * Only a plain walk from a single commit over all of history is split up
+ * between threads and cached. Everything else either needs the walk to see
+ * the commits in order, or changes which paths are associated with which
+ * commit in ways that are not captured by the cache key.
+ */
+static bool last_modified_is_simple(struct last_modified *lm)
+{
+	struct diff_options *opt = &lm->rev.diffopt;
+
+	return lm->rev.commits && !lm->rev.commits->next &&
+		!(lm->rev.commits->item->object.flags & BOTTOM) &&
+		lm->rev.max_count < 0 &&
+		!opt->detect_rename && opt->break_opt == -1 &&
+		!(opt->pickaxe_opts & DIFF_PICKAXE_KINDS_MASK) && !opt->objfind &&
+		!opt->filter && !opt->filter_not && !opt->rotate_to &&
+		!(opt->pathspec.magic & PATHSPEC_ATTR);
+}
+
+/*
+ * The results of such walks are cached in files in
+ * "$GIT_DIR/last-modified-cache", named after a hash of the commit the
+ * walk started at and the options that decide which paths are shown.
+ * Each file consists of a header, followed by one record per path in the
+ * order in which they are shown:
+ *
+ *	4-byte signature "LMDC"
+ *	4-byte version number (1)
+ *	4-byte hash format id (e.g. "sha1")
+ *
+ *	For each path:
+ *	    object name of the commit (hash length bytes)
+ *	    NUL-terminated path
+ *
+ * All integers are in network byte order.
+ *
+ * At most "lastModified.cacheEntries" files are kept. Reading a file
+ * updates its modification time, so that the least recently used ones
+ * are removed first.
+ */
+#define LAST_MODIFIED_CACHE_DIR "last-modified-cache"
+#define LAST_MODIFIED_CACHE_ENTRIES 1000
+#define LAST_MODIFIED_CACHE_SIGNATURE 0x4c4d4443 /* "LMDC" */
+#define LAST_MODIFIED_CACHE_VERSION 1
+#define LAST_MODIFIED_CACHE_HEADER_SIZE 12
+
+static char *last_modified_cache_path(struct last_modified *lm,
+				      struct commit *start)
+{
+	const struct git_hash_algo *algo = lm->rev.repo->hash_algo;
+	const struct pathspec *pathspec = &lm->rev.diffopt.pathspec;
+	struct strbuf key = STRBUF_INIT;
+	unsigned char hash[GIT_MAX_RAWSZ];
+	struct git_hash_ctx ctx;
+
+	strbuf_addf(&key, "%s %d %d %d %d\n", oid_to_hex(&start->object.oid),
+		    lm->max_depth, lm->show_trees,
+		    lm->rev.diffopt.flags.ignore_submodules, pathspec->magic);
+	for (int i = 0; i < pathspec->nr; i++) {
+		strbuf_addf(&key, "%u ", pathspec->items[i].magic);
+		strbuf_add(&key, pathspec->items[i].match,
+			   pathspec->items[i].len + 1);
+	}
+
+	git_hash_init(&ctx, algo);
+	git_hash_update(&ctx, key.buf, key.len);
+	git_hash_final(hash, &ctx);
+	strbuf_release(&key);
+
+	return repo_git_path(lm->rev.repo, "%s/%s", LAST_MODIFIED_CACHE_DIR,
+			     hash_to_hex_algop(hash, algo));
+}
+
+static void add_be32(struct strbuf *sb, uint32_t value)
+{
+	unsigned char buf[4];
+
+	put_be32(buf, value);
+	strbuf_add(sb, buf, sizeof(buf));
+}
+
+/*
+ * Show the results from the cache file at "path", if there is one that
+ * covers exactly the paths we are looking for.
+ */
+static int last_modified_replay_cache(struct last_modified *lm,
+				      const char *path)
+{
+	const struct git_hash_algo *algo = lm->rev.repo->hash_algo;
+	struct strbuf buf = STRBUF_INIT;
+	struct bitmap *seen = NULL;
+	const char *p, *end;
+	size_t nr = 0;
+	int ret = -1;
+
+	if (strbuf_read_file(&buf, path, 0) < 0)
+		return -1;
+
+	if (buf.len < LAST_MODIFIED_CACHE_HEADER_SIZE ||
+	    get_be32(buf.buf) != LAST_MODIFIED_CACHE_SIGNATURE ||
+	    get_be32(buf.buf + 4) != LAST_MODIFIED_CACHE_VERSION ||
+	    get_be32(buf.buf + 8) != algo->format_id)
+		goto out;
+
+	/* Check all records before showing any of them. */
+	seen = bitmap_word_alloc(lm->all_paths_nr / BITS_IN_EWORD + 1);
+	end = buf.buf + buf.len;
+	for (p = buf.buf + LAST_MODIFIED_CACHE_HEADER_SIZE; p < end; nr++) {
+		const char *name = p + algo->rawsz, *nul;
+		struct last_modified_entry *ent;
+
+		if ((size_t)(end - p) <= algo->rawsz ||
+		    !(nul = memchr(name, '\0', end - name)))
+			goto out;
+		ent = hashmap_get_entry_from_hash(&lm->paths, strhash(name), name,
+						  struct last_modified_entry, hashent);
+		if (!ent || bitmap_get(seen, ent->diff_idx))
+			goto out;
+		bitmap_set(seen, ent->diff_idx);
+		p = nul + 1;
+	}
+	if (nr != lm->all_paths_nr)
+		goto out;
+
+	for (p = buf.buf + LAST_MODIFIED_CACHE_HEADER_SIZE; p < end; ) {
+		struct object_id oid;
+		const char *name = p + algo->rawsz;
+
+		oidread(&oid, (const unsigned char *)p, algo);
+		last_modified_emit(lm, name, &oid, false);
+		p = name + strlen(name) + 1;
+	}
+	utime(path, NULL);
+	ret = 0;
+
+out:
+	if (ret)
+		warning(_("ignoring invalid last-modified cache '%s'"), path);
+	bitmap_free(seen);
+	strbuf_release(&buf);
+	return ret;
+}
+
+static void last_modified_write_cache(struct last_modified *lm, char *path)
+{
+	struct lock_file lock = LOCK_INIT;
+	struct strbuf buf = STRBUF_INIT;
+	char *dir;
+
+	if (lm->cache_entries <= 0 ||
+	    safe_create_leading_directories(lm->rev.repo, path) != SCLD_OK)
+		return;
+
+	/* make room for the new file */
+	dir = repo_git_path(lm->rev.repo, LAST_MODIFIED_CACHE_DIR);
+	remove_oldest_files(dir, lm->cache_entries - 1);
+	free(dir);
+
+	/*
+	 * If somebody else is writing the same results right now we simply
+	 * leave it to them.
+	 */
+	if (hold_lock_file_for_update(&lock, path, 0) < 0)
+		return;
+
+	add_be32(&buf, LAST_MODIFIED_CACHE_SIGNATURE);
+	add_be32(&buf, LAST_MODIFIED_CACHE_VERSION);
+	add_be32(&buf, lm->rev.repo->hash_algo->format_id);
+	strbuf_addbuf(&buf, &lm->cache_records);
+
+	if (write_in_full(get_lock_file_fd(&lock), buf.buf, buf.len) < 0)
+		rollback_lock_file(&lock);
+	else
+		commit_lock_file(&lock);
+
+	trace2_data_intmax("last-modified-cache", lm->rev.repo, "written",
+			   lm->all_paths_nr);
+	strbuf_release(&buf);
+}
+
+static int last_modified_walk(struct last_modified *lm)
 {
 	int max_count, queue_popped = 0;
 	struct prio_queue queue = { compare_commits_by_gen_then_commit_date };
@@ -352,9 +915,6 @@ static int last_modified_run(struct last_modified *lm)
 	lm->rev.diffopt.output_format = DIFF_FORMAT_CALLBACK;
 	lm->rev.diffopt.format_callback = last_modified_diff;
 	lm->rev.diffopt.format_callback_data = &data;
-	lm->rev.no_walk = 1;
-
-	prepare_revision_walk(&lm->rev);
 
 	max_count = lm->rev.max_count;
 
@@ -473,6 +1033,78 @@ static int last_modified_run(struct last_modified *lm)
 	return 0;
 }
 
+static int last_modified_run(struct last_modified *lm)
+{
+	struct repository *r = lm->rev.repo;
+	struct commit *start;
+	char *cache_path = NULL;
+	int nr_threads, ret = 0;
+
+	lm->rev.no_walk = 1;
+
+	prepare_revision_walk(&lm->rev);
+
+	if (!last_modified_is_simple(lm))
+		return last_modified_walk(lm);
+
+	start = lm->rev.commits->item;
+	if (lm->use_cache && commit_graph_compatible(r)) {
+		cache_path = last_modified_cache_path(lm, start);
+		if (!last_modified_replay_cache(lm, cache_path)) {
+			trace2_data_intmax("last-modified-cache", r, "hit", 1);
+			goto out;
+		}
+		trace2_data_intmax("last-modified-cache", r, "hit", 0);
+		lm->record = true;
+	}
+
+	nr_threads = lm->threads;
+	if ((size_t)nr_threads > lm->all_paths_nr)
+		nr_threads = lm->all_paths_nr;
+
+	if (nr_threads > 1)
+		last_modified_run_threaded(lm, start, nr_threads);
+	else
+		ret = last_modified_walk(lm);
+
+	if (!ret && lm->record)
+		last_modified_write_cache(lm, cache_path);
+
+out:
+	free(cache_path);
+	return ret;
+}
+
+static int git_last_modified_config(const char *var, const char *value,
+				    const struct config_context *ctx, void *cb)
+{
+	struct last_modified *lm = cb;
+
+	if (!strcmp(var, "lastmodified.threads")) {
+		lm->threads = git_config_int(var, value, ctx->kvi);
+		if (lm->threads < 0)
+			die(_("invalid number of threads specified (%d) for %s"),
+			    lm->threads, var);
+		else if (!HAVE_THREADS && lm->threads > 1) {
+			warning(_("no threads support, ignoring %s"), var);
+			lm->threads = 1;
+		}
+		return 0;
+	}
+
+	if (!strcmp(var, "lastmodified.cache")) {
+		lm->use_cache = git_config_bool(var, value);
+		return 0;
+	}
+
+	if (!strcmp(var, "lastmodified.cacheentries")) {
+		lm->cache_entries = git_config_int(var, value, ctx->kvi);
+		return 0;
+	}
+
+	return git_default_config(var, value, ctx, cb);
+}
+
 static int last_modified_init(struct last_modified *lm, struct repository *r,
 			      const char *prefix, int argc, const char **argv)
 {
@@ -501,6 +1133,7 @@ static int last_modified_init(struct last_modified *lm, struct repository *r,
 	}
 
 	lm->rev.bloom_filter_settings = get_bloom_filter_settings(lm->rev.repo);
+	lm->changed_path_lists = commit_graph_has_changed_path_lists(lm->rev.repo);
 
 	if (populate_paths_from_revs(lm) < 0)
 		return -1;
@@ -519,11 +1152,15 @@ int cmd_last_modified(int argc, const char **argv, const char *prefix,
 		      struct repository *repo)
 {
 	int ret;
-	struct last_modified lm = { 0 };
+	struct last_modified lm = {
+		.threads = 1,
+		.cache_entries = LAST_MODIFIED_CACHE_ENTRIES,
+		.cache_records = STRBUF_INIT,
+	};
 
 	const char * const last_modified_usage[] = {
 		N_("git last-modified [--recursive] [--show-trees] [--max-depth=<depth>] [-z]\n"
-		   "                  [<revision-range>] [[--] <pathspec>...]"),
+		   "                  [--threads=<n>] [<revision-range>] [[--] <pathspec>...]"),
 		NULL
 	};
 
@@ -536,15 +1173,25 @@ int cmd_last_modified(int argc, const char **argv, const char *prefix,
 			      N_("maximum tree depth to recurse"), PARSE_OPT_NONEG),
 		OPT_BOOL('z', NULL, &lm.nul_termination,
 			 N_("lines are separated with NUL character")),
+		OPT_INTEGER(0, "threads", &lm.threads,
+			    N_("use <n> worker threads")),
 		OPT_END()
 	};
 
+	repo_config(repo, git_last_modified_config, &lm);
+
 	argc = parse_options(argc, argv, prefix, last_modified_options,
 			     last_modified_usage,
 			     PARSE_OPT_KEEP_ARGV0 | PARSE_OPT_KEEP_UNKNOWN_OPT |
 			     PARSE_OPT_KEEP_DASHDASH);
 
-	repo_config(repo, git_default_config, NULL);
+	if (!HAVE_THREADS && lm.threads > 1) {
+		warning(_("no threads support, ignoring --threads"));
+		lm.threads = 1;
+	} else if (lm.threads < 0)
+		die(_("invalid number of threads specified (%d)"), lm.threads);
+	else if (!lm.threads)
+		lm.threads = HAVE_THREADS ? online_cpus() : 1;
 
 	ret = last_modified_init(&lm, repo, prefix, argc, argv);
 	if (ret > 0)
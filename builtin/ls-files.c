@@ -494,6 +494,63 @@ static void show_files(struct repository *repo, struct dir_struct *dir)
 	strbuf_release(&fullname);
 }
 
+/*
+ * Plain listings of the cached entries can be served from a mapped index
+ * without reading the whole index. Anything that looks at the working
+ * tree, at index extensions or at attributes needs the real thing, and
+ * so do the tags, which depend on flags adjusted after reading the index.
+ */
+static int can_use_mapped_index(const struct dir_struct *dir)
+{
+	return !(show_deleted || show_modified || show_others || show_killed ||
+		 show_resolve_undo || show_eol || *tag_cached ||
+		 recurse_submodules || with_tree || format ||
+		 (dir->flags & DIR_SHOW_IGNORED) ||
+		 (pathspec.magic & PATHSPEC_ATTR));
+}
+
+/*
+ * Like show_files(), but decoding only the entries starting with "prefix"
+ * one by one from the mapped index.
+ */
+static void show_mapped_files(struct repository *repo, struct dir_struct *dir,
+			      struct mapped_index *mi,
+			      const char *prefix, size_t prefixlen)
+{
+	struct strbuf fullname = STRBUF_INIT;
+	struct strbuf previous_name = STRBUF_INIT;
+	unsigned int i = 0, nr = mapped_index_nr(mi);
+
+	if (prefix) {
+		int pos = mapped_index_name_pos(mi, prefix, prefixlen);
+		i = pos < 0 ? -pos - 1 : pos;
+	}
+
+	for (; i < nr; i++) {
+		const struct cache_entry *ce = mapped_index_entry(mi, i);
+
+		if (prefix && strncmp(ce->name, prefix, prefixlen))
+			break;
+		if (show_unmerged && !ce_stage(ce))
+			continue;
+		if (skipping_duplicates && !strcmp(previous_name.buf, ce->name))
+			continue;
+
+		construct_fullname(&fullname, repo, ce);
+		show_ce(repo, dir, ce, fullname.buf,
+			ce_stage(ce) ? tag_unmerged :
+			(ce_skip_worktree(ce) ? tag_skip_worktree : tag_cached));
+
+		if (skipping_duplicates) {
+			strbuf_reset(&previous_name);
+			strbuf_addstr(&previous_name, ce->name);
+		}
+	}
+
+	strbuf_release(&fullname);
+	strbuf_release(&previous_name);
+}
+
 /*
  * Prune the index to only contain stuff starting with "prefix"
  */
@@ -597,6 +654,7 @@ int cmd_ls_files(int argc,
 	struct dir_struct dir = DIR_INIT;
 	struct pattern_list *pl;
 	struct string_list exclude_list = STRING_LIST_INIT_NODUP;
+	struct mapped_index *mi = NULL;
 	struct option builtin_ls_files_options[] = {
 		/* Think twice before adding "--nul" synonym to this */
 		OPT_SET_INT('z', NULL, &line_terminator,
@@ -678,9 +736,6 @@ int cmd_ls_files(int argc,
 		prefix_len = strlen(prefix);
 	repo_config(repo, git_default_config, NULL);
 
-	if (repo_read_index(repo) < 0)
-		die("index file corrupt");
-
 	argc = parse_options(argc, argv, prefix, builtin_ls_files_options,
 			ls_files_usage, 0);
 	pl = add_pattern_list(&dir, EXC_CMDL, "--exclude option");
@@ -747,7 +802,13 @@ int cmd_ls_files(int argc,
 		max_prefix = common_prefix(&pathspec);
 	max_prefix_len = get_common_prefix_len(max_prefix);
 
-	prune_index(repo->index, max_prefix, max_prefix_len);
+	if (can_use_mapped_index(&dir))
+		mi = mapped_index_open(repo, repo_get_index_file(repo));
+	if (!mi) {
+		if (repo_read_index(repo) < 0)
+			die("index file corrupt");
+		prune_index(repo->index, max_prefix, max_prefix_len);
+	}
 
 	/* Treat unmatching pathspec elements as errors */
 	if (pathspec.nr && error_unmatch)
@@ -774,7 +835,10 @@ int cmd_ls_files(int argc,
 		overlay_tree_on_index(repo->index, with_tree, max_prefix);
 	}
 
-	show_files(repo, &dir);
+	if (mi)
+		show_mapped_files(repo, &dir, mi, max_prefix, max_prefix_len);
+	else
+		show_files(repo, &dir);
 
 	if (show_resolve_undo)
 		show_ru_info(repo, repo->index);
@@ -784,6 +848,7 @@ int cmd_ls_files(int argc,
 		ret = 1;
 	}
 
+	mapped_index_close(mi);
 	string_list_clear(&exclude_list, 0);
 	dir_clear(&dir);
 	free(max_prefix);
@@ -534,6 +534,15 @@ static inline int parse_missing_action_value(const char *value)
 	return 0;
 }
 
+static int try_graph_count(struct rev_info *revs)
+{
+	if (count_revisions_in_graph(revs))
+		return -1;
+
+	printf("%d\n", revs->count_right);
+	return 0;
+}
+
 static int try_bitmap_count(struct rev_info *revs,
 			    int filter_provided_objects)
 {
@@ -929,6 +938,9 @@ int cmd_rev_list(int argc,
 			goto cleanup;
 	}
 
+	if (!bisect_list && !show_disk_usage && !try_graph_count(&revs))
+		goto cleanup;
+
 	if (prepare_revision_walk(&revs))
 		die("revision walk setup failed");
 
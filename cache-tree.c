@@ -8,13 +8,16 @@
 #include "tree.h"
 #include "tree-walk.h"
 #include "cache-tree.h"
+#include "config.h"
 #include "object-file.h"
 #include "odb.h"
 #include "odb/transaction.h"
+#include "oidset.h"
 #include "read-cache-ll.h"
 #include "replace-object.h"
 #include "repository.h"
 #include "promisor-remote.h"
+#include "thread-utils.h"
 #include "trace.h"
 #include "trace2.h"
 
@@ -254,13 +257,44 @@ static int must_check_existence(const struct cache_entry *ce)
 	return !(repo_has_promisor_remote(the_repository) && ce_skip_worktree(ce));
 }
 
+/*
+ * Tree objects built by a worker thread of cache_tree_update(). Writing
+ * objects is not thread-safe, so they are kept in memory and written by
+ * the main thread once all workers are done.
+ */
+struct deferred_trees {
+	struct deferred_tree {
+		struct object_id oid;
+		char *buf;
+		size_t len;
+	} *trees;
+	size_t nr, alloc;
+	struct oidset oids;
+};
+
+static void defer_tree(struct deferred_trees *deferred,
+		       struct strbuf *buffer, struct object_id *oid)
+{
+	struct deferred_tree *tree;
+
+	hash_object_file(the_hash_algo, buffer->buf, buffer->len,
+			 OBJ_TREE, oid);
+	ALLOC_GROW(deferred->trees, deferred->nr + 1, deferred->alloc);
+	tree = &deferred->trees[deferred->nr++];
+	oidcpy(&tree->oid, oid);
+	tree->len = buffer->len;
+	tree->buf = strbuf_detach(buffer, NULL);
+	oidset_insert(&deferred->oids, oid);
+}
+
 static int update_one(struct cache_tree *it,
 		      struct cache_entry **cache,
 		      int entries,
 		      const char *base,
 		      int baselen,
 		      int *skip_count,
-		      int flags)
+		      int flags,
+		      struct deferred_trees *deferred)
 {
 	struct strbuf buffer;
 	int missing_ok = flags & WRITE_TREE_MISSING_OK;
@@ -338,7 +372,8 @@ static int update_one(struct cache_tree *it,
 				    path,
 				    baselen + sublen + 1,
 				    &subskip,
-				    flags);
+				    flags,
+				    deferred);
 		if (subcnt < 0)
 			return subcnt;
 		if (!subcnt)
@@ -400,6 +435,7 @@ static int update_one(struct cache_tree *it,
 			!must_check_existence(ce);
 		if (is_null_oid(oid) ||
 		    (!ce_missing_ok &&
+		     !(sub && deferred && oidset_contains(&deferred->oids, oid)) &&
 		     !odb_has_object(the_repository->objects, oid,
 				     ODB_HAS_OBJECT_RECHECK_PACKED | ODB_HAS_OBJECT_FETCH_PROMISOR))) {
 			strbuf_release(&buffer);
@@ -456,6 +492,8 @@ static int update_one(struct cache_tree *it,
 	} else if (dryrun) {
 		hash_object_file(the_hash_algo, buffer.buf, buffer.len,
 				 OBJ_TREE, &it->oid);
+	} else if (deferred) {
+		defer_tree(deferred, &buffer, &it->oid);
 	} else if (odb_write_object_ext(the_repository->objects, buffer.buf, buffer.len, OBJ_TREE,
 					&it->oid, NULL, flags & WRITE_TREE_SILENT ? ODB_WRITE_OBJECT_SILENT : 0)) {
 		strbuf_release(&buffer);
@@ -472,6 +510,224 @@ static int update_one(struct cache_tree *it,
 	return i;
 }
 
+/*
+ * Like read-cache.c, do not bother with threads for fewer index entries
+ * than this per thread when the number of threads is auto-detected.
+ */
+#define THREAD_COST (10000)
+
+static int cache_tree_threads(struct index_state *istate)
+{
+	int nr_threads, cpus;
+
+	if (!HAVE_THREADS ||
+	    repo_config_get_index_threads(the_repository, &nr_threads))
+		return 1;
+
+	if (!nr_threads) {
+		nr_threads = istate->cache_nr / THREAD_COST;
+		cpus = online_cpus();
+		if (nr_threads > cpus)
+			nr_threads = cpus;
+	}
+	return nr_threads;
+}
+
+struct cache_tree_job {
+	struct cache_tree *it;
+	struct cache_entry **cache;
+	int entries;
+	const char *base;
+	int baselen;
+	int ret;
+	struct deferred_trees deferred;
+};
+
+struct cache_tree_jobs {
+	struct cache_tree_job *jobs;
+	size_t nr, alloc, next;
+	int flags;
+	pthread_mutex_t mutex;
+};
+
+/*
+ * Hand out the invalid subtrees below "it" as jobs. Subtrees with more
+ * than "limit" entries are split into their own subtrees instead, so
+ * that a repository with a few large top-level directories still gets
+ * enough jobs to keep the threads busy. The trees that are not part of
+ * any job are left for the serial update_one() that follows.
+ */
+static void plan_jobs(struct cache_tree_jobs *jobs, struct cache_tree *it,
+		      struct cache_entry **cache, int entries,
+		      const char *base, int baselen, int limit)
+{
+	int i = 0;
+
+	while (i < entries) {
+		const struct cache_entry *ce = cache[i];
+		struct cache_tree_sub *sub;
+		const char *path, *slash;
+		int pathlen, sublen, subcnt;
+
+		path = ce->name;
+		pathlen = ce_namelen(ce);
+		if (pathlen <= baselen || memcmp(base, path, baselen))
+			break; /* at the end of this level */
+
+		slash = strchr(path + baselen, '/');
+		if (!slash) {
+			i++;
+			continue;
+		}
+		sublen = slash - (path + baselen);
+		for (subcnt = 1; i + subcnt < entries; subcnt++) {
+			const struct cache_entry *next = cache[i + subcnt];
+
+			if (ce_namelen(next) <= baselen + sublen ||
+			    memcmp(next->name, path, baselen + sublen + 1))
+				break;
+		}
+
+		sub = find_subtree(it, path + baselen, sublen, 1);
+		if (!sub->cache_tree)
+			sub->cache_tree = cache_tree();
+		if (sub->cache_tree->entry_count >= 0) {
+			/* the serial pass checks that it still exists */
+		} else if (subcnt > limit) {
+			plan_jobs(jobs, sub->cache_tree, cache + i, subcnt,
+				  path, baselen + sublen + 1, limit);
+		} else {
+			struct cache_tree_job *job;
+
+			ALLOC_GROW(jobs->jobs, jobs->nr + 1, jobs->alloc);
+			job = &jobs->jobs[jobs->nr++];
+			memset(job, 0, sizeof(*job));
+			job->it = sub->cache_tree;
+			job->cache = cache + i;
+			job->entries = subcnt;
+			job->base = path;
+			job->baselen = baselen + sublen + 1;
+			oidset_init(&job->deferred.oids, 0);
+		}
+		i += subcnt;
+	}
+}
+
+static void *run_cache_tree_jobs_thread(void *data)
+{
+	struct cache_tree_jobs *jobs = data;
+	int defer = !(jobs->flags & WRITE_TREE_REPAIR);
+
+	for (;;) {
+		struct cache_tree_job *job = NULL;
+		int skip;
+
+		pthread_mutex_lock(&jobs->mutex);
+		if (jobs->next < jobs->nr)
+			job = &jobs->jobs[jobs->next++];
+		pthread_mutex_unlock(&jobs->mutex);
+
+		if (!job)
+			return NULL;
+
+		job->ret = update_one(job->it, job->cache, job->entries,
+				      job->base, job->baselen, &skip,
+				      jobs->flags,
+				      defer ? &job->deferred : NULL);
+	}
+}
+
+/*
+ * Build independent subtrees of an invalid cache-tree with several
+ * threads, so that the serial update_one() afterwards finds them valid
+ * and only has to build the trees above them.
+ *
+ * The workers only read from the object database, which is safe with
+ * the object read lock enabled. The tree objects they build are
+ * written afterwards by this thread, within the caller's transaction.
+ */
+static int update_in_parallel(struct index_state *istate, int flags)
+{
+	struct cache_tree_jobs jobs = { .flags = flags };
+	pthread_t *threads;
+	int nr_threads, ret = 0;
+	size_t i, j;
+
+	/* A dry run has nothing to hand to the serial pass. */
+	if (flags & WRITE_TREE_DRY_RUN)
+		return 0;
+	if (istate->cache_tree->entry_count >= 0)
+		return 0;
+	nr_threads = cache_tree_threads(istate);
+	if (nr_threads < 2)
+		return 0;
+
+	/*
+	 * update_one() returns the entry count of a valid cache-tree
+	 * instead of walking its entries again, which does not account
+	 * for entries that are about to be removed.
+	 */
+	for (i = 0; i < istate->cache_nr; i++)
+		if (istate->cache[i]->ce_flags & CE_REMOVE)
+			return 0;
+
+	plan_jobs(&jobs, istate->cache_tree, istate->cache, istate->cache_nr,
+		  "", 0, DIV_ROUND_UP(istate->cache_nr, nr_threads * 4));
+	if (jobs.nr < 2)
+		goto done;
+	if (nr_threads > jobs.nr)
+		nr_threads = jobs.nr;
+
+	trace2_region_enter("cache_tree", "parallel", istate->repo);
+	trace2_data_intmax("cache_tree", istate->repo, "parallel/jobs", jobs.nr);
+	trace2_data_intmax("cache_tree", istate->repo, "parallel/threads",
+			   nr_threads);
+
+	enable_obj_read_lock();
+	pthread_mutex_init(&jobs.mutex, NULL);
+	CALLOC_ARRAY(threads, nr_threads);
+	for (i = 0; i < nr_threads; i++)
+		if (pthread_create(&threads[i], NULL,
+				   run_cache_tree_jobs_thread, &jobs))
+			die(_("unable to create thread"));
+	for (i = 0; i < nr_threads; i++)
+		if (pthread_join(threads[i], NULL))
+			die(_("unable to join thread"));
+	free(threads);
+	pthread_mutex_destroy(&jobs.mutex);
+	disable_obj_read_lock();
+
+	trace2_region_leave("cache_tree", "parallel", istate->repo);
+
+done:
+	/*
+	 * Write the trees in index order and stop at the first failure,
+	 * like a serial update would have.
+	 */
+	for (i = 0; i < jobs.nr; i++) {
+		struct cache_tree_job *job = &jobs.jobs[i];
+
+		for (j = 0; j < job->deferred.nr; j++) {
+			struct deferred_tree *tree = &job->deferred.trees[j];
+
+			if (!ret &&
+			    odb_write_object_ext(the_repository->objects,
+						 tree->buf, tree->len, OBJ_TREE,
+						 &tree->oid, NULL,
+						 flags & WRITE_TREE_SILENT ?
+						 ODB_WRITE_OBJECT_SILENT : 0))
+				ret = -1;
+			free(tree->buf);
+		}
+		if (!ret && job->ret < 0)
+			ret = job->ret;
+		free(job->deferred.trees);
+		oidset_clear(&job->deferred.oids);
+	}
+	free(jobs.jobs);
+	return ret;
+}
+
 int cache_tree_update(struct index_state *istate, int flags)
 {
 	struct odb_transaction *transaction;
@@ -491,8 +747,10 @@ int cache_tree_update(struct index_state *istate, int flags)
 	trace_performance_enter();
 	trace2_region_enter("cache_tree", "update", istate->repo);
 	transaction = odb_transaction_begin(the_repository->objects);
-	i = update_one(istate->cache_tree, istate->cache, istate->cache_nr,
-		       "", 0, &skip, flags);
+	i = update_in_parallel(istate, flags);
+	if (!i)
+		i = update_one(istate->cache_tree, istate->cache,
+			       istate->cache_nr, "", 0, &skip, flags, NULL);
 	odb_transaction_commit(transaction);
 	trace2_region_leave("cache_tree", "update", istate->repo);
 	trace_performance_leave("cache_tree_update");
@@ -3,6 +3,8 @@
 #include "git-compat-util.h"
 #include "config.h"
 #include "csum-file.h"
+#include "diff.h"
+#include "diffcore.h"
 #include "environment.h"
 #include "gettext.h"
 #include "hex.h"
@@ -23,10 +25,12 @@
 #include "bloom.h"
 #include "commit-slab.h"
 #include "shallow.h"
+#include "strmap.h"
 #include "json-writer.h"
 #include "trace2.h"
 #include "tree.h"
 #include "chunk-format.h"
+#include "thread-utils.h"
 
 void git_test_write_commit_graph_or_die(struct odb_source *source)
 {
@@ -51,6 +55,11 @@ void git_test_write_commit_graph_or_die(struct odb_source *source)
 #define GRAPH_CHUNKID_BLOOMINDEXES 0x42494458 /* "BIDX" */
 #define GRAPH_CHUNKID_BLOOMDATA 0x42444154 /* "BDAT" */
 #define GRAPH_CHUNKID_BASE 0x42415345 /* "BASE" */
+#define GRAPH_CHUNKID_REACHABILITY 0x52454143 /* "REAC" */
+#define GRAPH_CHUNKID_PATH_LIST_INDEX 0x50494458 /* "PIDX" */
+#define GRAPH_CHUNKID_PATH_LIST_DATA 0x50444154 /* "PDAT" */
+#define GRAPH_CHUNKID_PATH_NAME_OFFSETS 0x504e4f46 /* "PNOF" */
+#define GRAPH_CHUNKID_PATH_NAMES 0x504e414d /* "PNAM" */
 
 #define GRAPH_VERSION_1 0x1
 #define GRAPH_VERSION GRAPH_VERSION_1
@@ -66,6 +75,26 @@ void git_test_write_commit_graph_or_die(struct odb_source *source)
 
 #define CORRECTED_COMMIT_DATE_OFFSET_OVERFLOW (1ULL << 31)
 
+/*
+ * Set in the changed-path list index for commits whose changed paths are
+ * not recorded.
+ */
+#define GRAPH_PATH_LIST_NONE 0x80000000
+
+/*
+ * Each commit in the reachability index has three labels computed by a
+ * depth-first walk over the parent edges: its post-order number, the
+ * smallest post-order number of any commit it can reach, and the
+ * smallest post-order number within its subtree of the walk.
+ */
+struct reachability_label {
+	uint32_t post;
+	uint32_t low;
+	uint32_t tree_low;
+};
+
+#define GRAPH_REACHABILITY_LABEL_WIDTH (3 * sizeof(uint32_t))
+
 /* Remember to update object flag allocation in object.h */
 #define REACHABLE       (1u<<15)
 
@@ -220,7 +249,7 @@ static struct commit_graph *alloc_commit_graph(void)
 	return g;
 }
 
-static int commit_graph_compatible(struct repository *r)
+int commit_graph_compatible(struct repository *r)
 {
 	if (!r->gitdir)
 		return 0;
@@ -333,6 +362,30 @@ static int graph_read_generation_data(const unsigned char *chunk_start,
 	return 0;
 }
 
+static int graph_read_reachability_index(const unsigned char *chunk_start,
+					 size_t chunk_size, void *data)
+{
+	struct commit_graph *g = data;
+	if (chunk_size / GRAPH_REACHABILITY_LABEL_WIDTH != g->num_commits) {
+		warning(_("commit-graph reachability index chunk is the wrong size"));
+		return -1;
+	}
+	g->chunk_reachability_index = chunk_start;
+	return 0;
+}
+
+static int graph_read_path_list_index(const unsigned char *chunk_start,
+				      size_t chunk_size, void *data)
+{
+	struct commit_graph *g = data;
+	if (chunk_size / 4 != g->num_commits) {
+		warning(_("commit-graph changed-path list index chunk is the wrong size"));
+		return -1;
+	}
+	g->chunk_path_list_index = chunk_start;
+	return 0;
+}
+
 static int graph_read_bloom_index(const unsigned char *chunk_start,
 				  size_t chunk_size, void *data)
 {
@@ -447,6 +500,32 @@ struct commit_graph *parse_commit_graph(struct repository *r,
 		   &graph->chunk_extra_edges_size);
 	pair_chunk(cf, GRAPH_CHUNKID_BASE, &graph->chunk_base_graphs,
 		   &graph->chunk_base_graphs_size);
+	read_chunk(cf, GRAPH_CHUNKID_REACHABILITY,
+		   graph_read_reachability_index, graph);
+	read_chunk(cf, GRAPH_CHUNKID_PATH_LIST_INDEX,
+		   graph_read_path_list_index, graph);
+	pair_chunk(cf, GRAPH_CHUNKID_PATH_LIST_DATA, &graph->chunk_path_list_data,
+		   &graph->chunk_path_list_data_size);
+	pair_chunk(cf, GRAPH_CHUNKID_PATH_NAME_OFFSETS,
+		   &graph->chunk_path_name_offsets,
+		   &graph->chunk_path_name_offsets_size);
+	pair_chunk(cf, GRAPH_CHUNKID_PATH_NAMES, &graph->chunk_path_names,
+		   &graph->chunk_path_names_size);
+	if (!graph->chunk_path_list_index || !graph->chunk_path_list_data ||
+	    !graph->chunk_path_name_offsets || !graph->chunk_path_names ||
+	    graph->chunk_path_list_data_size % 4 ||
+	    graph->chunk_path_name_offsets_size % 4 ||
+	    (graph->chunk_path_names_size ?
+	     graph->chunk_path_names[graph->chunk_path_names_size - 1] :
+	     graph->chunk_path_name_offsets_size)) {
+		if (graph->chunk_path_list_index || graph->chunk_path_list_data ||
+		    graph->chunk_path_name_offsets || graph->chunk_path_names)
+			warning(_("ignoring incomplete changed-path lists in commit-graph file"));
+		graph->chunk_path_list_index = NULL;
+		graph->chunk_path_list_data = NULL;
+		graph->chunk_path_name_offsets = NULL;
+		graph->chunk_path_names = NULL;
+	}
 
 	prepare_repo_settings(r);
 
@@ -820,6 +899,137 @@ struct bloom_filter_settings *get_bloom_filter_settings(struct repository *r)
 	return NULL;
 }
 
+static void load_reachability_label(struct commit_graph *g, uint32_t pos,
+				    struct reachability_label *label)
+{
+	const unsigned char *p = g->chunk_reachability_index +
+		st_mult(GRAPH_REACHABILITY_LABEL_WIDTH, pos);
+
+	label->post = get_be32(p);
+	label->low = get_be32(p + 4);
+	label->tree_low = get_be32(p + 8);
+}
+
+int commit_graph_can_reach(struct repository *r,
+			   struct commit *from, struct commit *to)
+{
+	struct commit_graph *g = prepare_commit_graph(r);
+	struct reachability_label from_label, to_label;
+	uint32_t from_pos, to_pos;
+
+	if (!g)
+		return -1;
+
+	/*
+	 * The labels are only comparable within one file, so only a base
+	 * layer (which contains all ancestors of its commits) carries them.
+	 */
+	while (g->base_graph)
+		g = g->base_graph;
+	if (!g->chunk_reachability_index)
+		return -1;
+
+	from_pos = commit_graph_position(from);
+	to_pos = commit_graph_position(to);
+	if (from_pos == COMMIT_NOT_FROM_GRAPH || to_pos == COMMIT_NOT_FROM_GRAPH)
+		return -1;
+	if (from_pos >= g->num_commits)
+		return -1;
+	if (to_pos >= g->num_commits)
+		return 0;
+
+	load_reachability_label(g, from_pos, &from_label);
+	load_reachability_label(g, to_pos, &to_label);
+
+	/*
+	 * Everything "from" can reach has been numbered within the interval
+	 * [low, post] of "from", and everything "to" can reach is reachable
+	 * from "from" too. If either does not hold, "to" is out of reach.
+	 */
+	if (to_label.post > from_label.post ||
+	    to_label.post < from_label.low ||
+	    to_label.low < from_label.low)
+		return 0;
+
+	/* Commits in the subtree of "from" are reachable from it. */
+	if (to_label.post >= from_label.tree_low)
+		return 1;
+
+	return -1;
+}
+
+int commit_graph_has_changed_path_lists(struct repository *r)
+{
+	struct commit_graph *g;
+
+	if (!prepare_commit_graph(r))
+		return 0;
+
+	for (g = r->objects->commit_graph; g; g = g->base_graph)
+		if (g->chunk_path_list_index)
+			return 1;
+	return 0;
+}
+
+int get_commit_changed_paths(struct repository *r, struct commit *c,
+			     struct commit_changed_paths *paths)
+{
+	struct commit_graph *g;
+	uint32_t graph_pos, lex_pos, start, end, nr_names;
+
+	g = repo_find_commit_pos_in_graph(r, c, &graph_pos);
+	if (!g)
+		return -1;
+
+	while (graph_pos < g->num_commits_in_base)
+		g = g->base_graph;
+	if (!g->chunk_path_list_index)
+		return -1;
+
+	lex_pos = graph_pos - g->num_commits_in_base;
+	end = get_be32(g->chunk_path_list_index + st_mult(4, lex_pos));
+	if (end & GRAPH_PATH_LIST_NONE)
+		return -1;
+	start = lex_pos ? get_be32(g->chunk_path_list_index +
+				   st_mult(4, lex_pos - 1)) : 0;
+	start &= ~GRAPH_PATH_LIST_NONE;
+
+	if (start > end || end > g->chunk_path_list_data_size / 4) {
+		warning(_("ignoring out-of-range changed-path list for commit %s in %s"),
+			oid_to_hex(&c->object.oid), g->filename);
+		return -1;
+	}
+
+	paths->graph = g;
+	paths->ids = g->chunk_path_list_data + st_mult(4, start);
+	paths->nr = end - start;
+
+	nr_names = g->chunk_path_name_offsets_size / 4;
+	for (size_t i = 0; i < paths->nr; i++) {
+		uint32_t id = get_be32(paths->ids + st_mult(4, i));
+
+		if (id >= nr_names ||
+		    get_be32(g->chunk_path_name_offsets + st_mult(4, id)) >=
+		    g->chunk_path_names_size) {
+			warning(_("ignoring invalid changed-path list for commit %s in %s"),
+				oid_to_hex(&c->object.oid), g->filename);
+			return -1;
+		}
+	}
+
+	return 0;
+}
+
+const char *commit_changed_path(const struct commit_changed_paths *paths,
+				size_t n)
+{
+	const struct commit_graph *g = paths->graph;
+	uint32_t id = get_be32(paths->ids + st_mult(4, n));
+	uint32_t offset = get_be32(g->chunk_path_name_offsets + st_mult(4, id));
+
+	return (const char *)g->chunk_path_names + offset;
+}
+
 void close_commit_graph(struct object_database *o)
 {
 	if (!o->commit_graph)
@@ -876,46 +1086,58 @@ static struct commit_list **insert_parent_or_die(struct commit_graph *g,
 	return &commit_list_insert(c, pptr)->next;
 }
 
-static void fill_commit_graph_info(struct commit *item, struct commit_graph *g, uint32_t pos)
+/*
+ * Read the commit date and the generation number of the commit at "pos"
+ * in the layer "g" it belongs to.
+ */
+static timestamp_t read_graph_generation(struct commit_graph *g, uint32_t pos,
+					 timestamp_t *date)
 {
 	const unsigned char *commit_data;
-	struct commit_graph_data *graph_data;
 	uint32_t lex_index, offset_pos;
 	uint64_t date_high, date_low, offset;
 
-	while (pos < g->num_commits_in_base)
-		g = g->base_graph;
-
 	if (pos >= g->num_commits + g->num_commits_in_base)
 		die(_("invalid commit position. commit-graph is likely corrupt"));
 
 	lex_index = pos - g->num_commits_in_base;
 	commit_data = g->chunk_commit_data + st_mult(graph_data_width(g->hash_algo), lex_index);
 
-	graph_data = commit_graph_data_at(item);
-	graph_data->graph_pos = pos;
-
 	date_high = get_be32(commit_data + g->hash_algo->rawsz + 8) & 0x3;
 	date_low = get_be32(commit_data + g->hash_algo->rawsz + 12);
-	item->date = (timestamp_t)((date_high << 32) | date_low);
+	*date = (timestamp_t)((date_high << 32) | date_low);
 
-	if (g->read_generation_data) {
-		offset = (timestamp_t)get_be32(g->chunk_generation_data + st_mult(sizeof(uint32_t), lex_index));
+	if (!g->read_generation_data)
+		return get_be32(commit_data + g->hash_algo->rawsz + 8) >> 2;
 
-		if (offset & CORRECTED_COMMIT_DATE_OFFSET_OVERFLOW) {
-			if (!g->chunk_generation_data_overflow)
-				die(_("commit-graph requires overflow generation data but has none"));
+	offset = (timestamp_t)get_be32(g->chunk_generation_data + st_mult(sizeof(uint32_t), lex_index));
+	if (!(offset & CORRECTED_COMMIT_DATE_OFFSET_OVERFLOW))
+		return *date + offset;
 
-			offset_pos = offset ^ CORRECTED_COMMIT_DATE_OFFSET_OVERFLOW;
-			if (g->chunk_generation_data_overflow_size / sizeof(uint64_t) <= offset_pos)
-				die(_("commit-graph overflow generation data is too small"));
-			graph_data->generation = item->date +
-				get_be64(g->chunk_generation_data_overflow + sizeof(uint64_t) * offset_pos);
-		} else
-			graph_data->generation = item->date + offset;
-	} else
-		graph_data->generation = get_be32(commit_data + g->hash_algo->rawsz + 8) >> 2;
+	if (!g->chunk_generation_data_overflow)
+		die(_("commit-graph requires overflow generation data but has none"));
 
+	offset_pos = offset ^ CORRECTED_COMMIT_DATE_OFFSET_OVERFLOW;
+	if (g->chunk_generation_data_overflow_size / sizeof(uint64_t) <= offset_pos)
+		die(_("commit-graph overflow generation data is too small"));
+	return *date + get_be64(g->chunk_generation_data_overflow +
+				sizeof(uint64_t) * offset_pos);
+}
+
+static void fill_commit_graph_info(struct commit *item, struct commit_graph *g, uint32_t pos)
+{
+	const unsigned char *commit_data;
+	struct commit_graph_data *graph_data;
+
+	while (pos < g->num_commits_in_base)
+		g = g->base_graph;
+
+	graph_data = commit_graph_data_at(item);
+	graph_data->graph_pos = pos;
+	graph_data->generation = read_graph_generation(g, pos, &item->date);
+
+	commit_data = g->chunk_commit_data +
+		st_mult(graph_data_width(g->hash_algo), pos - g->num_commits_in_base);
 	if (g->topo_levels)
 		*topo_level_slab_at(g->topo_levels, item) = get_be32(commit_data + g->hash_algo->rawsz + 8) >> 2;
 }
@@ -981,6 +1203,461 @@ static int fill_commit_in_graph(struct commit *item,
 	return 1;
 }
 
+static int commit_graph_threads(struct repository *r)
+{
+	int nr_threads;
+
+	if (!HAVE_THREADS)
+		return 1;
+	if (repo_config_get_int(r, "commitgraph.threads", &nr_threads) ||
+	    nr_threads <= 0)
+		nr_threads = online_cpus();
+	return nr_threads;
+}
+
+struct graph_positions {
+	uint32_t *pos;
+	size_t nr, alloc;
+};
+
+static void push_graph_position(struct graph_positions *p, uint32_t pos)
+{
+	ALLOC_GROW(p->pos, p->nr + 1, p->alloc);
+	p->pos[p->nr++] = pos;
+}
+
+/*
+ * Append the positions of the parents of the commit at "pos" to "parents".
+ * This only reads from the commit-graph and can be called from several
+ * threads at once.
+ */
+static void read_graph_parents(struct commit_graph *g, uint32_t pos,
+			       struct graph_positions *parents)
+{
+	const unsigned char *commit_data;
+	uint32_t edge_value, parent_data_pos;
+
+	while (pos < g->num_commits_in_base)
+		g = g->base_graph;
+	if (pos >= g->num_commits + g->num_commits_in_base)
+		die(_("invalid commit position. commit-graph is likely corrupt"));
+
+	commit_data = g->chunk_commit_data +
+		st_mult(graph_data_width(g->hash_algo), pos - g->num_commits_in_base);
+
+	edge_value = get_be32(commit_data + g->hash_algo->rawsz);
+	if (edge_value == GRAPH_PARENT_NONE)
+		return;
+	push_graph_position(parents, edge_value);
+
+	edge_value = get_be32(commit_data + g->hash_algo->rawsz + 4);
+	if (edge_value == GRAPH_PARENT_NONE)
+		return;
+	if (!(edge_value & GRAPH_EXTRA_EDGES_NEEDED)) {
+		push_graph_position(parents, edge_value);
+		return;
+	}
+
+	parent_data_pos = edge_value & GRAPH_EDGE_LAST_MASK;
+	do {
+		if (g->chunk_extra_edges_size / sizeof(uint32_t) <= parent_data_pos)
+			die(_("commit-graph extra-edges pointer out of bounds"));
+		edge_value = get_be32(g->chunk_extra_edges +
+				      sizeof(uint32_t) * parent_data_pos);
+		push_graph_position(parents, edge_value & GRAPH_EDGE_LAST_MASK);
+		parent_data_pos++;
+	} while (!(edge_value & GRAPH_LAST_EDGE));
+}
+
+static timestamp_t graph_generation_at(struct commit_graph *g, uint32_t pos)
+{
+	timestamp_t date;
+
+	while (pos < g->num_commits_in_base)
+		g = g->base_graph;
+	return read_graph_generation(g, pos, &date);
+}
+
+/*
+ * The walk of commit_graph_find_redundant() is split up by generation
+ * number: each thread owns a range of generations and walks the commits
+ * in it, handing parents that fall into a lower range to the thread that
+ * owns it. As parents always have a lower generation than their children,
+ * work only ever flows towards lower ranges, and a thread is done once its
+ * inbox is empty and all threads owning higher ranges are done.
+ *
+ * Each thread only ever marks the commits in its own range as visited, so
+ * the threads do not need to synchronize anything but their inboxes.
+ */
+struct redundant_walk_range {
+	struct redundant_walk *walk;
+	int nr;
+	/* Lowest generation of this range. */
+	timestamp_t min_generation;
+	pthread_t thread;
+
+	pthread_mutex_t mutex;
+	pthread_cond_t cond;
+	struct graph_positions inbox;
+	int upstream_done;
+};
+
+struct redundant_walk {
+	struct commit_graph *g;
+	timestamp_t min_generation;
+	unsigned char *visited;
+	struct redundant_walk_range *ranges;
+	int nr_ranges;
+};
+
+static int redundant_walk_owner(struct redundant_walk *walk,
+				timestamp_t generation)
+{
+	int i;
+
+	for (i = 0; i < walk->nr_ranges - 1; i++)
+		if (generation >= walk->ranges[i].min_generation)
+			break;
+	return i;
+}
+
+static void redundant_walk_send(struct redundant_walk_range *range,
+				struct graph_positions *positions)
+{
+	pthread_mutex_lock(&range->mutex);
+	for (size_t i = 0; i < positions->nr; i++)
+		push_graph_position(&range->inbox, positions->pos[i]);
+	pthread_cond_signal(&range->cond);
+	pthread_mutex_unlock(&range->mutex);
+	positions->nr = 0;
+}
+
+static void redundant_walk_finish(struct redundant_walk_range *range)
+{
+	pthread_mutex_lock(&range->mutex);
+	range->upstream_done = 1;
+	pthread_cond_signal(&range->cond);
+	pthread_mutex_unlock(&range->mutex);
+}
+
+static void *redundant_walk_thread(void *data)
+{
+	struct redundant_walk_range *range = data;
+	struct redundant_walk *walk = range->walk;
+	struct graph_positions stack = { 0 }, parents = { 0 };
+	struct graph_positions *outbox;
+
+	CALLOC_ARRAY(outbox, walk->nr_ranges);
+
+	for (;;) {
+		pthread_mutex_lock(&range->mutex);
+		while (!range->inbox.nr && !range->upstream_done)
+			pthread_cond_wait(&range->cond, &range->mutex);
+		if (!range->inbox.nr) {
+			pthread_mutex_unlock(&range->mutex);
+			break;
+		}
+		SWAP(stack, range->inbox);
+		pthread_mutex_unlock(&range->mutex);
+
+		while (stack.nr) {
+			uint32_t pos = stack.pos[--stack.nr];
+
+			if (walk->visited[pos])
+				continue;
+			walk->visited[pos] = 1;
+
+			parents.nr = 0;
+			read_graph_parents(walk->g, pos, &parents);
+			for (size_t i = 0; i < parents.nr; i++) {
+				timestamp_t generation;
+				int owner;
+
+				generation = graph_generation_at(walk->g, parents.pos[i]);
+				if (generation < walk->min_generation)
+					continue;
+
+				owner = redundant_walk_owner(walk, generation);
+				if (owner == range->nr)
+					push_graph_position(&stack, parents.pos[i]);
+				else
+					push_graph_position(&outbox[owner], parents.pos[i]);
+			}
+		}
+
+		for (int i = range->nr + 1; i < walk->nr_ranges; i++)
+			if (outbox[i].nr)
+				redundant_walk_send(&walk->ranges[i], &outbox[i]);
+	}
+
+	if (range->nr + 1 < walk->nr_ranges)
+		redundant_walk_finish(&walk->ranges[range->nr + 1]);
+
+	for (int i = 0; i < walk->nr_ranges; i++)
+		free(outbox[i].pos);
+	free(outbox);
+	free(stack.pos);
+	free(parents.pos);
+	return NULL;
+}
+
+int commit_graph_find_redundant(struct repository *r,
+				struct commit **array, size_t cnt,
+				unsigned char *redundant)
+{
+	struct commit_graph *g = prepare_commit_graph(r);
+	struct redundant_walk walk = { 0 };
+	struct graph_positions starts = { 0 };
+	timestamp_t max_generation = 0;
+	int nr_threads = commit_graph_threads(r);
+	uint32_t *head_pos;
+	int i;
+
+	if (nr_threads < 2 || !g || !cnt)
+		return -1;
+
+	ALLOC_ARRAY(head_pos, cnt);
+	walk.min_generation = GENERATION_NUMBER_INFINITY;
+	for (size_t j = 0; j < cnt; j++) {
+		timestamp_t generation;
+
+		if (repo_parse_commit(r, array[j]) ||
+		    commit_graph_position(array[j]) == COMMIT_NOT_FROM_GRAPH) {
+			free(head_pos);
+			return -1;
+		}
+		head_pos[j] = commit_graph_position(array[j]);
+		generation = commit_graph_generation(array[j]);
+		if (generation < walk.min_generation)
+			walk.min_generation = generation;
+		read_graph_parents(g, head_pos[j], &starts);
+	}
+
+	/*
+	 * Split the generations between the lowest head and the highest
+	 * parent of a head evenly between the threads.
+	 */
+	for (size_t j = 0; j < starts.nr; j++) {
+		timestamp_t generation = graph_generation_at(g, starts.pos[j]);
+		if (generation > max_generation)
+			max_generation = generation;
+	}
+	if (max_generation < walk.min_generation)
+		max_generation = walk.min_generation;
+	if ((timestamp_t)nr_threads > max_generation - walk.min_generation + 1)
+		nr_threads = max_generation - walk.min_generation + 1;
+
+	walk.g = g;
+	walk.visited = xcalloc(g->num_commits + g->num_commits_in_base, 1);
+	walk.nr_ranges = nr_threads;
+	CALLOC_ARRAY(walk.ranges, walk.nr_ranges);
+	for (i = 0; i < walk.nr_ranges; i++) {
+		struct redundant_walk_range *range = &walk.ranges[i];
+		timestamp_t span = max_generation - walk.min_generation + 1;
+
+		range->walk = &walk;
+		range->nr = i;
+		range->min_generation = max_generation + 1 -
+			span / walk.nr_ranges * (i + 1);
+		pthread_mutex_init(&range->mutex, NULL);
+		pthread_cond_init(&range->cond, NULL);
+	}
+	walk.ranges[walk.nr_ranges - 1].min_generation = walk.min_generation;
+	walk.ranges[0].upstream_done = 1;
+
+	for (size_t j = 0; j < starts.nr; j++) {
+		timestamp_t generation = graph_generation_at(g, starts.pos[j]);
+
+		if (generation < walk.min_generation)
+			continue;
+		push_graph_position(&walk.ranges[redundant_walk_owner(&walk, generation)].inbox,
+				    starts.pos[j]);
+	}
+
+	trace2_region_enter("commit-graph", "find-redundant", r);
+	trace2_data_intmax("commit-graph", r, "find-redundant/threads",
+			   walk.nr_ranges);
+	for (i = 0; i < walk.nr_ranges; i++)
+		if (pthread_create(&walk.ranges[i].thread, NULL,
+				   redundant_walk_thread, &walk.ranges[i]))
+			die(_("unable to create thread"));
+	for (i = 0; i < walk.nr_ranges; i++)
+		if (pthread_join(walk.ranges[i].thread, NULL))
+			die(_("unable to join thread"));
+	trace2_region_leave("commit-graph", "find-redundant", r);
+
+	for (size_t j = 0; j < cnt; j++)
+		redundant[j] = walk.visited[head_pos[j]];
+
+	for (i = 0; i < walk.nr_ranges; i++) {
+		pthread_mutex_destroy(&walk.ranges[i].mutex);
+		pthread_cond_destroy(&walk.ranges[i].cond);
+		free(walk.ranges[i].inbox.pos);
+	}
+	free(walk.ranges);
+	free(walk.visited);
+	free(starts.pos);
+	free(head_pos);
+	return 0;
+}
+
+/*
+ * A priority queue of commit-graph positions, highest generation first.
+ * Unlike a "struct prio_queue" of commits, it does not need a "struct
+ * commit" for each entry.
+ */
+struct graph_queue_entry {
+	timestamp_t generation;
+	uint32_t pos;
+};
+
+struct graph_queue {
+	struct graph_queue_entry *array;
+	size_t nr, alloc;
+};
+
+static void graph_queue_put(struct graph_queue *queue,
+			    timestamp_t generation, uint32_t pos)
+{
+	size_t ix, parent;
+
+	ALLOC_GROW(queue->array, queue->nr + 1, queue->alloc);
+	for (ix = queue->nr++; ix; ix = parent) {
+		parent = (ix - 1) / 2;
+		if (queue->array[parent].generation >= generation)
+			break;
+		queue->array[ix] = queue->array[parent];
+	}
+	queue->array[ix].generation = generation;
+	queue->array[ix].pos = pos;
+}
+
+static uint32_t graph_queue_get(struct graph_queue *queue)
+{
+	uint32_t pos = queue->array[0].pos;
+	struct graph_queue_entry last = queue->array[--queue->nr];
+	size_t ix = 0, child;
+
+	while ((child = 2 * ix + 1) < queue->nr) {
+		if (child + 1 < queue->nr &&
+		    queue->array[child + 1].generation > queue->array[child].generation)
+			child++;
+		if (last.generation >= queue->array[child].generation)
+			break;
+		queue->array[ix] = queue->array[child];
+		ix = child;
+	}
+	queue->array[ix] = last;
+	return pos;
+}
+
+#define COUNT_WALK_INCLUDED (1u<<0)
+#define COUNT_WALK_EXCLUDED (1u<<1)
+#define COUNT_WALK_SEEN     (1u<<2)
+#define COUNT_WALK_QUEUED   (1u<<3)
+
+struct count_walk {
+	struct commit_graph *g;
+	struct graph_queue queue;
+	/* One byte of COUNT_WALK_* flags per commit-graph position. */
+	unsigned char *flags;
+	/* Queued commits that are included, but not excluded. */
+	size_t nr_interesting;
+};
+
+static void count_walk_mark(struct count_walk *walk, uint32_t pos,
+			    unsigned char flag)
+{
+	unsigned char old = walk->flags[pos];
+
+	if (old & flag)
+		return;
+	walk->flags[pos] |= flag;
+
+	if (!(old & COUNT_WALK_SEEN)) {
+		walk->flags[pos] |= COUNT_WALK_SEEN | COUNT_WALK_QUEUED;
+		graph_queue_put(&walk->queue, graph_generation_at(walk->g, pos), pos);
+		if (flag == COUNT_WALK_INCLUDED)
+			walk->nr_interesting++;
+	} else if (old == (COUNT_WALK_SEEN | COUNT_WALK_QUEUED | COUNT_WALK_INCLUDED)) {
+		walk->nr_interesting--;
+	}
+}
+
+int commit_graph_count_reachable(struct repository *r,
+				 struct commit **include, size_t include_nr,
+				 struct commit **exclude, size_t exclude_nr,
+				 enum count_walk_flags walk_flags,
+				 uint32_t *count)
+{
+	struct commit_graph *g = prepare_commit_graph(r);
+	struct count_walk walk = { .g = g };
+	struct graph_positions parents = { 0 };
+	uint32_t visited = 0;
+
+	/*
+	 * Parents must be visited after all of their children, which the
+	 * generation numbers only guarantee if there are any.
+	 */
+	if (!g || !generation_numbers_enabled(r))
+		return -1;
+	for (size_t i = 0; i < include_nr + exclude_nr; i++) {
+		struct commit *c = i < include_nr ? include[i] : exclude[i - include_nr];
+
+		if (repo_parse_commit(r, c) ||
+		    commit_graph_position(c) == COMMIT_NOT_FROM_GRAPH)
+			return -1;
+	}
+
+	walk.flags = xcalloc(g->num_commits + g->num_commits_in_base, 1);
+	for (size_t i = 0; i < include_nr; i++)
+		count_walk_mark(&walk, commit_graph_position(include[i]),
+				COUNT_WALK_INCLUDED);
+	for (size_t i = 0; i < exclude_nr; i++)
+		count_walk_mark(&walk, commit_graph_position(exclude[i]),
+				COUNT_WALK_EXCLUDED);
+
+	trace2_region_enter("commit-graph", "count-reachable", r);
+
+	*count = 0;
+	while (walk.nr_interesting) {
+		uint32_t pos = graph_queue_get(&walk.queue);
+		unsigned char flag = walk.flags[pos] & COUNT_WALK_EXCLUDED;
+		int first_parent_only;
+
+		walk.flags[pos] &= ~COUNT_WALK_QUEUED;
+		visited++;
+		if (!flag) {
+			walk.nr_interesting--;
+			(*count)++;
+			flag = COUNT_WALK_INCLUDED;
+			first_parent_only = walk_flags & COUNT_WALK_FIRST_PARENT_ONLY;
+		} else {
+			first_parent_only = walk_flags & COUNT_WALK_EXCLUDE_FIRST_PARENT_ONLY;
+		}
+
+		/*
+		 * Like the revision walk, only pass on that a commit is
+		 * excluded if it is.
+		 */
+		parents.nr = 0;
+		read_graph_parents(g, pos, &parents);
+		for (size_t i = 0; i < parents.nr; i++) {
+			count_walk_mark(&walk, parents.pos[i], flag);
+			if (first_parent_only)
+				break;
+		}
+	}
+
+	trace2_data_intmax("commit-graph", r, "count-reachable/visited", visited);
+	trace2_region_leave("commit-graph", "count-reachable", r);
+
+	free(walk.queue.array);
+	free(walk.flags);
+	free(parents.pos);
+	return 0;
+}
+
 static int search_commit_pos_in_graph(const struct object_id *id, struct commit_graph *g, uint32_t *pos)
 {
 	struct commit_graph *cur_g = g;
@@ -1155,12 +1832,27 @@ struct write_commit_graph_context {
 		 changed_paths:1,
 		 order_by_pack:1,
 		 write_generation_data:1,
-		 trust_generation_numbers:1;
+		 trust_generation_numbers:1,
+		 reachability_index:1,
+		 changed_path_lists:1;
 
 	struct topo_level_slab *topo_levels;
 	const struct commit_graph_opts *opts;
 	size_t total_bloom_filter_data_size;
 	const struct bloom_filter_settings *bloom_settings;
+	struct reachability_label *reachability_labels;
+
+	/*
+	 * For each commit, the end of its changed-path list in
+	 * "path_list_data", which holds indexes into the sorted
+	 * "path_names".
+	 */
+	uint32_t *path_list_index;
+	uint32_t *path_list_data;
+	size_t path_list_data_nr, path_list_data_alloc;
+	char **path_names;
+	size_t path_names_nr, path_names_alloc;
+	size_t path_names_size;
 
 	int count_bloom_filter_computed;
 	int count_bloom_filter_not_computed;
@@ -1393,6 +2085,24 @@ static int write_graph_chunk_generation_data_overflow(struct hashfile *f,
 	return 0;
 }
 
+static int write_graph_chunk_reachability_index(struct hashfile *f,
+						void *data)
+{
+	struct write_commit_graph_context *ctx = data;
+	size_t i;
+
+	for (i = 0; i < ctx->commits.nr; i++) {
+		struct reachability_label *label = &ctx->reachability_labels[i];
+		display_progress(ctx->progress, ++ctx->progress_cnt);
+
+		hashwrite_be32(f, label->post);
+		hashwrite_be32(f, label->low);
+		hashwrite_be32(f, label->tree_low);
+	}
+
+	return 0;
+}
+
 static int write_graph_chunk_extra_edges(struct hashfile *f,
 					 void *data)
 {
@@ -1510,6 +2220,51 @@ static int write_graph_chunk_bloom_data(struct hashfile *f,
 	return 0;
 }
 
+static int write_graph_chunk_path_list_index(struct hashfile *f,
+					     void *data)
+{
+	struct write_commit_graph_context *ctx = data;
+
+	for (size_t i = 0; i < ctx->commits.nr; i++) {
+		display_progress(ctx->progress, ++ctx->progress_cnt);
+		hashwrite_be32(f, ctx->path_list_index[i]);
+	}
+	return 0;
+}
+
+static int write_graph_chunk_path_list_data(struct hashfile *f,
+					    void *data)
+{
+	struct write_commit_graph_context *ctx = data;
+
+	for (size_t i = 0; i < ctx->path_list_data_nr; i++)
+		hashwrite_be32(f, ctx->path_list_data[i]);
+	return 0;
+}
+
+static int write_graph_chunk_path_name_offsets(struct hashfile *f,
+					       void *data)
+{
+	struct write_commit_graph_context *ctx = data;
+	uint32_t offset = 0;
+
+	for (size_t i = 0; i < ctx->path_names_nr; i++) {
+		hashwrite_be32(f, offset);
+		offset += strlen(ctx->path_names[i]) + 1;
+	}
+	return 0;
+}
+
+static int write_graph_chunk_path_names(struct hashfile *f,
+					void *data)
+{
+	struct write_commit_graph_context *ctx = data;
+
+	for (size_t i = 0; i < ctx->path_names_nr; i++)
+		hashwrite(f, ctx->path_names[i], strlen(ctx->path_names[i]) + 1);
+	return 0;
+}
+
 static int add_packed_commits_oi(const struct object_id *oid,
 				 struct object_info *oi,
 				 void *data)
@@ -1730,6 +2485,109 @@ static void compute_topological_levels(struct write_commit_graph_context *ctx)
 	stop_progress(&ctx->progress);
 }
 
+/*
+ * Label the commits with a depth-first walk along their parents, starting
+ * from the commits which have no children in the graph. Post-order numbers
+ * start at 1, which leaves 0 to mark commits that have not been visited.
+ */
+static void compute_reachability_index(struct write_commit_graph_context *ctx)
+{
+	struct commit **list = ctx->commits.items;
+	size_t nr = ctx->commits.nr, i, nr_edges = 0;
+	size_t *edge_start;
+	uint32_t *edges;
+	unsigned char *has_child;
+	struct reachability_label *labels;
+	struct reachability_stack_entry {
+		uint32_t pos;
+		size_t next_edge;
+	} *stack;
+	size_t stack_nr = 0;
+	uint32_t next_post = 0;
+
+	if (ctx->report_progress)
+		ctx->progress = start_delayed_progress(
+					ctx->r,
+					_("Computing commit graph reachability index"),
+					nr);
+
+	ALLOC_ARRAY(edge_start, st_add(nr, 1));
+	for (i = 0; i < nr; i++) {
+		if (repo_parse_commit_no_graph(ctx->r, list[i]))
+			die(_("unable to parse commit %s"),
+			    oid_to_hex(&list[i]->object.oid));
+		edge_start[i] = nr_edges;
+		nr_edges += commit_list_count(list[i]->parents);
+	}
+	edge_start[nr] = nr_edges;
+
+	ALLOC_ARRAY(edges, nr_edges);
+	CALLOC_ARRAY(has_child, nr);
+	for (i = 0; i < nr; i++) {
+		struct commit_list *parent;
+		size_t e = edge_start[i];
+
+		for (parent = list[i]->parents; parent; parent = parent->next) {
+			int pos = oid_pos(&parent->item->object.oid,
+					  list, nr, commit_to_oid);
+			if (pos < 0)
+				BUG("missing parent %s for commit %s",
+				    oid_to_hex(&parent->item->object.oid),
+				    oid_to_hex(&list[i]->object.oid));
+			edges[e++] = pos;
+			has_child[pos] = 1;
+		}
+	}
+
+	CALLOC_ARRAY(labels, nr);
+	ALLOC_ARRAY(stack, nr);
+	for (i = 0; i < nr; i++) {
+		if (has_child[i])
+			continue;
+
+		labels[i].tree_low = next_post + 1;
+		stack[stack_nr].pos = i;
+		stack[stack_nr++].next_edge = edge_start[i];
+
+		while (stack_nr) {
+			struct reachability_stack_entry *top = &stack[stack_nr - 1];
+			struct reachability_label *label = &labels[top->pos];
+			size_t e;
+
+			if (top->next_edge < edge_start[top->pos + 1]) {
+				uint32_t parent = edges[top->next_edge++];
+
+				if (labels[parent].tree_low)
+					continue;
+				labels[parent].tree_low = next_post + 1;
+				stack[stack_nr].pos = parent;
+				stack[stack_nr++].next_edge = edge_start[parent];
+				continue;
+			}
+
+			label->post = label->low = ++next_post;
+			for (e = edge_start[top->pos]; e < edge_start[top->pos + 1]; e++)
+				if (labels[edges[e]].low < label->low)
+					label->low = labels[edges[e]].low;
+
+			display_progress(ctx->progress, next_post);
+			stack_nr--;
+		}
+	}
+
+	if (next_post != nr)
+		BUG("reachability index labeled %"PRIu32" of %"PRIuMAX" commits",
+		    next_post, (uintmax_t)nr);
+
+	ctx->reachability_labels = labels;
+
+	free(stack);
+	free(has_child);
+	free(edges);
+	free(edge_start);
+	stop_progress(&ctx->progress);
+}
+
 static timestamp_t get_generation_from_graph_data(struct commit *c,
 						  void *data UNUSED)
 {
@@ -1822,12 +2680,91 @@ static void trace2_bloom_filter_write_statistics(struct write_commit_graph_conte
 			   ctx->count_bloom_filter_upgraded);
 }
 
+static void count_bloom_filter(struct write_commit_graph_context *ctx,
+			       struct bloom_filter *filter,
+			       enum bloom_filter_computed computed)
+{
+	if (computed & BLOOM_COMPUTED) {
+		ctx->count_bloom_filter_computed++;
+		if (computed & BLOOM_TRUNC_EMPTY)
+			ctx->count_bloom_filter_trunc_empty++;
+		if (computed & BLOOM_TRUNC_LARGE)
+			ctx->count_bloom_filter_trunc_large++;
+	} else if (computed & BLOOM_UPGRADED) {
+		ctx->count_bloom_filter_upgraded++;
+	} else if (computed & BLOOM_NOT_COMPUTED)
+		ctx->count_bloom_filter_not_computed++;
+	ctx->total_bloom_filter_data_size += filter
+		? sizeof(unsigned char) * filter->len : 0;
+}
+
+/* Number of filters handed to the worker threads at once, per thread. */
+#define BLOOM_FILTER_JOBS_PER_THREAD 256
+
+struct bloom_filter_job {
+	struct commit *commit;
+	struct bloom_filter *filter;
+	enum bloom_filter_computed computed;
+};
+
+struct bloom_filter_jobs {
+	struct write_commit_graph_context *ctx;
+	struct bloom_filter_job *jobs;
+	size_t nr, alloc, next;
+	pthread_mutex_t mutex;
+};
+
+static void *run_bloom_filter_jobs_thread(void *data)
+{
+	struct bloom_filter_jobs *jobs = data;
+
+	for (;;) {
+		struct bloom_filter_job *job = NULL;
+
+		pthread_mutex_lock(&jobs->mutex);
+		if (jobs->next < jobs->nr)
+			job = &jobs->jobs[jobs->next++];
+		pthread_mutex_unlock(&jobs->mutex);
+
+		if (!job)
+			return NULL;
+
+		job->computed = compute_bloom_filter(jobs->ctx->r, job->commit,
+						     jobs->ctx->bloom_settings,
+						     job->filter);
+	}
+}
+
+static void run_bloom_filter_jobs(struct bloom_filter_jobs *jobs,
+				  pthread_t *threads, int nr_threads)
+{
+	size_t i;
+	int t;
+
+	jobs->next = 0;
+	for (t = 0; t < nr_threads; t++)
+		if (pthread_create(&threads[t], NULL,
+				   run_bloom_filter_jobs_thread, jobs))
+			die(_("unable to create thread"));
+	for (t = 0; t < nr_threads; t++)
+		if (pthread_join(threads[t], NULL))
+			die(_("unable to join thread"));
+
+	for (i = 0; i < jobs->nr; i++)
+		count_bloom_filter(jobs->ctx, jobs->jobs[i].filter,
+				   jobs->jobs[i].computed);
+	jobs->nr = 0;
+}
+
 static void compute_bloom_filters(struct write_commit_graph_context *ctx)
 {
 	int i;
 	struct progress *progress = NULL;
 	struct commit **sorted_commits;
 	int max_new_filters;
+	int nr_threads;
+	pthread_t *threads = NULL;
+	struct bloom_filter_jobs jobs = { .ctx = ctx };
 
 	init_bloom_filters();
 
@@ -1847,30 +2784,61 @@ static void compute_bloom_filters(struct write_commit_graph_context *ctx)
 	max_new_filters = ctx->opts && ctx->opts->max_new_filters >= 0 ?
 		ctx->opts->max_new_filters : ctx->commits.nr;
 
+	nr_threads = commit_graph_threads(ctx->r);
+
+	if (nr_threads > 1) {
+		enable_obj_read_lock();
+		pthread_mutex_init(&jobs.mutex, NULL);
+		CALLOC_ARRAY(threads, nr_threads);
+		jobs.alloc = st_mult(nr_threads, BLOOM_FILTER_JOBS_PER_THREAD);
+		ALLOC_ARRAY(jobs.jobs, jobs.alloc);
+	}
+
 	for (i = 0; i < ctx->commits.nr; i++) {
 		enum bloom_filter_computed computed = 0;
 		struct commit *c = sorted_commits[i];
-		struct bloom_filter *filter = get_or_compute_bloom_filter(
-			ctx->r,
-			c,
-			ctx->count_bloom_filter_computed < max_new_filters,
-			ctx->bloom_settings,
-			&computed);
-		if (computed & BLOOM_COMPUTED) {
-			ctx->count_bloom_filter_computed++;
-			if (computed & BLOOM_TRUNC_EMPTY)
-				ctx->count_bloom_filter_trunc_empty++;
-			if (computed & BLOOM_TRUNC_LARGE)
-				ctx->count_bloom_filter_trunc_large++;
-		} else if (computed & BLOOM_UPGRADED) {
-			ctx->count_bloom_filter_upgraded++;
-		} else if (computed & BLOOM_NOT_COMPUTED)
-			ctx->count_bloom_filter_not_computed++;
-		ctx->total_bloom_filter_data_size += filter
-			? sizeof(unsigned char) * filter->len : 0;
+		struct bloom_filter *filter;
+		int budget_left = ctx->count_bloom_filter_computed + jobs.nr <
+				  max_new_filters;
+
+		/*
+		 * Filters that have to be computed from scratch are handed to
+		 * the worker threads. Everything else, as well as the budget
+		 * of new filters, is handled here in order, so the result is
+		 * the same as if we computed them one by one.
+		 */
+		if (nr_threads > 1 && budget_left) {
+			filter = load_bloom_filter(ctx->r, c);
+			if (!filter->data || !filter->len) {
+				struct bloom_filter_job *job = &jobs.jobs[jobs.nr++];
+
+				/* the workers need the parents */
+				repo_parse_commit(ctx->r, c);
+				job->commit = c;
+				job->filter = filter;
+				if (jobs.nr == jobs.alloc)
+					run_bloom_filter_jobs(&jobs, threads, nr_threads);
+				display_progress(progress, i + 1);
+				continue;
+			}
+		}
+
+		filter = get_or_compute_bloom_filter(ctx->r, c, budget_left,
+						     ctx->bloom_settings,
+						     &computed);
+		count_bloom_filter(ctx, filter, computed);
 		display_progress(progress, i + 1);
 	}
 
+	if (nr_threads > 1) {
+		if (jobs.nr)
+			run_bloom_filter_jobs(&jobs, threads, nr_threads);
+		free(jobs.jobs);
+		free(threads);
+		pthread_mutex_destroy(&jobs.mutex);
+		disable_obj_read_lock();
+	}
+
 	if (trace2_is_enabled())
 		trace2_bloom_filter_write_statistics(ctx);
 
@@ -1878,6 +2846,189 @@ static void compute_bloom_filters(struct write_commit_graph_context *ctx)
 	stop_progress(&progress);
 }
 
+static void add_changed_path(struct write_commit_graph_context *ctx,
+			     struct strintmap *ids, const char *path)
+{
+	int id = strintmap_get(ids, path);
+
+	if (id < 0) {
+		char *name = xstrdup(path);
+
+		id = ctx->path_names_nr;
+		ALLOC_GROW(ctx->path_names, ctx->path_names_nr + 1,
+			   ctx->path_names_alloc);
+		ctx->path_names[ctx->path_names_nr++] = name;
+		ctx->path_names_size += strlen(name) + 1;
+		strintmap_set(ids, name, id);
+	}
+
+	ALLOC_GROW(ctx->path_list_data, ctx->path_list_data_nr + 1,
+		   ctx->path_list_data_alloc);
+	ctx->path_list_data[ctx->path_list_data_nr++] = id;
+}
+
+/*
+ * Add the paths "c" changed against its first parent to the lists. Return
+ * -1 if there are more than "max_paths" of them.
+ */
+static int add_changed_paths(struct write_commit_graph_context *ctx,
+			     struct strintmap *ids, struct commit *c,
+			     size_t max_paths)
+{
+	struct commit_changed_paths paths;
+	struct diff_options diffopt;
+	int ret = 0;
+
+	/* Reuse the list from the existing commit-graph, if there is one. */
+	if (!get_commit_changed_paths(ctx->r, c, &paths)) {
+		for (size_t i = 0; i < paths.nr; i++)
+			add_changed_path(ctx, ids, commit_changed_path(&paths, i));
+		return 0;
+	}
+
+	repo_diff_setup(ctx->r, &diffopt);
+	diffopt.flags.recursive = 1;
+	diffopt.detect_rename = 0;
+	diffopt.max_changes = max_paths;
+	/*
+	 * Make sure we see changes to submodules no matter how they are
+	 * configured to be shown; see below.
+	 */
+	diffopt.flags.override_submodule_config = 1;
+	diffopt.flags.ignore_submodules = 0;
+	diff_setup_done(&diffopt);
+
+	if (c->parents)
+		diff_tree_oid(&c->parents->item->object.oid, &c->object.oid, "", &diffopt);
+	else
+		diff_tree_oid(NULL, &c->object.oid, "", &diffopt);
+	diff_free(&diffopt);
+
+	if (diff_queued_diff.nr > max_paths)
+		ret = -1;
+
+	/*
+	 * Whether a change to a submodule counts depends on configuration,
+	 * so readers would have to look at the trees anyway. Do not record
+	 * a list for such commits at all, so that the lists that we record
+	 * give an exact answer.
+	 */
+	for (int i = 0; !ret && i < diff_queued_diff.nr; i++) {
+		struct diff_filepair *p = diff_queued_diff.queue[i];
+
+		if (S_ISGITLINK(p->one->mode) || S_ISGITLINK(p->two->mode))
+			ret = -1;
+	}
+
+	for (int i = 0; !ret && i < diff_queued_diff.nr; i++)
+		add_changed_path(ctx, ids, diff_queued_diff.queue[i]->two->path);
+
+	diff_queue_clear(&diff_queued_diff);
+	return ret;
+}
+
+struct path_name_entry {
+	const char *name;
+	uint32_t id;
+};
+
+static int path_name_entry_cmp(const void *va, const void *vb)
+{
+	const struct path_name_entry *a = va, *b = vb;
+	return strcmp(a->name, b->name);
+}
+
+static int uint32_cmp(const void *va, const void *vb)
+{
+	uint32_t a = *(const uint32_t *)va, b = *(const uint32_t *)vb;
+	return a < b ? -1 : a > b;
+}
+
+/*
+ * Number the paths in sorted order, and sort the list of each commit
+ * accordingly, dropping duplicates.
+ */
+static void sort_changed_path_lists(struct write_commit_graph_context *ctx)
+{
+	struct path_name_entry *entries;
+	uint32_t *rank;
+	size_t start = 0, nr = 0;
+
+	ALLOC_ARRAY(entries, ctx->path_names_nr);
+	for (size_t i = 0; i < ctx->path_names_nr; i++) {
+		entries[i].name = ctx->path_names[i];
+		entries[i].id = i;
+	}
+	QSORT(entries, ctx->path_names_nr, path_name_entry_cmp);
+
+	ALLOC_ARRAY(rank, ctx->path_names_nr);
+	for (size_t i = 0; i < ctx->path_names_nr; i++) {
+		rank[entries[i].id] = i;
+		ctx->path_names[i] = (char *)entries[i].name;
+	}
+
+	for (size_t i = 0; i < ctx->commits.nr; i++) {
+		uint32_t end = ctx->path_list_index[i] & ~GRAPH_PATH_LIST_NONE;
+		uint32_t *list = ctx->path_list_data + start;
+
+		for (size_t j = 0; j < end - start; j++)
+			list[j] = rank[list[j]];
+		QSORT(list, end - start, uint32_cmp);
+
+		for (size_t j = 0; j < end - start; j++)
+			if (!j || list[j] != list[j - 1])
+				ctx->path_list_data[nr++] = list[j];
+
+		ctx->path_list_index[i] = nr |
+			(ctx->path_list_index[i] & GRAPH_PATH_LIST_NONE);
+		start = end;
+	}
+	ctx->path_list_data_nr = nr;
+
+	free(rank);
+	free(entries);
+}
+
+static void compute_changed_path_lists(struct write_commit_graph_context *ctx)
+{
+	struct strintmap ids;
+	struct progress *progress = NULL;
+	size_t max_paths = ctx->bloom_settings->max_changed_paths;
+
+	strintmap_init_with_options(&ids, -1, NULL, 0);
+	ALLOC_ARRAY(ctx->path_list_index, ctx->commits.nr);
+
+	if (ctx->report_progress)
+		progress = start_delayed_progress(
+			ctx->r,
+			_("Computing commit changed-path lists"),
+			ctx->commits.nr);
+
+	for (size_t i = 0; i < ctx->commits.nr; i++) {
+		size_t start = ctx->path_list_data_nr;
+
+		if (add_changed_paths(ctx, &ids, ctx->commits.items[i], max_paths) < 0 ||
+		    ctx->path_list_data_nr >= GRAPH_PATH_LIST_NONE) {
+			ctx->path_list_data_nr = start;
+			ctx->path_list_index[i] = start | GRAPH_PATH_LIST_NONE;
+		} else {
+			ctx->path_list_index[i] = ctx->path_list_data_nr;
+		}
+		display_progress(progress, i + 1);
+	}
+	stop_progress(&progress);
+
+	strintmap_clear(&ids);
+
+	if (ctx->path_names_size > UINT32_MAX) {
+		warning(_("too many changed paths, not writing changed-path lists"));
+		ctx->changed_path_lists = 0;
+		return;
+	}
+
+	sort_changed_path_lists(ctx);
+}
+
 struct refs_cb_data {
 	struct repository *repo;
 	struct oidset *commits;
@@ -2177,6 +3328,23 @@ static int write_commit_graph_file(struct write_commit_graph_context *ctx)
 				 ctx->total_bloom_filter_data_size),
 			  write_graph_chunk_bloom_data);
 	}
+	if (ctx->reachability_index)
+		add_chunk(cf, GRAPH_CHUNKID_REACHABILITY,
+			  st_mult(GRAPH_REACHABILITY_LABEL_WIDTH, ctx->commits.nr),
+			  write_graph_chunk_reachability_index);
+	if (ctx->changed_path_lists) {
+		add_chunk(cf, GRAPH_CHUNKID_PATH_LIST_INDEX,
+			  st_mult(sizeof(uint32_t), ctx->commits.nr),
+			  write_graph_chunk_path_list_index);
+		add_chunk(cf, GRAPH_CHUNKID_PATH_LIST_DATA,
+			  st_mult(sizeof(uint32_t), ctx->path_list_data_nr),
+			  write_graph_chunk_path_list_data);
+		add_chunk(cf, GRAPH_CHUNKID_PATH_NAME_OFFSETS,
+			  st_mult(sizeof(uint32_t), ctx->path_names_nr),
+			  write_graph_chunk_path_name_offsets);
+		add_chunk(cf, GRAPH_CHUNKID_PATH_NAMES, ctx->path_names_size,
+			  write_graph_chunk_path_names);
+	}
 	if (ctx->num_commit_graphs_after > 1)
 		add_chunk(cf, GRAPH_CHUNKID_BASE,
 			  st_mult(hashsz, ctx->num_commit_graphs_after - 1),
@@ -2277,6 +3445,74 @@ static int write_commit_graph_file(struct write_commit_graph_context *ctx)
 	return 0;
 }
 
+/*
+ * Looking up a commit in a chain probes one layer after another, starting
+ * at the tip. Return the total number of layers probed to look up each
+ * commit of the chain once, if "top_commits" are written on top of "g",
+ * and store the number of commits in the chain in "total".
+ */
+static uint64_t chain_lookup_cost(uint32_t top_commits, struct commit_graph *g,
+				  uint64_t *total)
+{
+	uint64_t cost = top_commits;
+	uint64_t depth = 1;
+
+	*total = top_commits;
+	for (; g; g = g->base_graph) {
+		depth++;
+		cost += depth * g->num_commits;
+		*total += g->num_commits;
+	}
+	return cost;
+}
+
+/*
+ * Keep merging the layers below the new one while looking up a commit
+ * probes more than "max_lookup_cost" layers on average, or while the next
+ * layer lacks Bloom filters that we are going to write anyway and that fit
+ * into the budget of new filters. Every merged layer is rewritten, but its
+ * existing filters are copied rather than computed again.
+ */
+static struct commit_graph *merge_by_cost(struct write_commit_graph_context *ctx,
+					  struct commit_graph *g,
+					  uint32_t *num_commits)
+{
+	int max_lookup_cost = ctx->opts->max_lookup_cost;
+	int max_new_filters = ctx->opts->max_new_filters;
+	uint64_t missing_filters = 0;
+	int merged = 0;
+
+	while (g && g->odb_source == ctx->odb_source) {
+		uint64_t total, cost = chain_lookup_cost(*num_commits, g, &total);
+		int close_gap = 0;
+
+		if (ctx->changed_paths && !g->chunk_bloom_indexes &&
+		    (max_new_filters < 0 ||
+		     missing_filters + g->num_commits <= (uint64_t)max_new_filters))
+			close_gap = 1;
+
+		if (cost <= st_mult(max_lookup_cost, total) && !close_gap)
+			break;
+
+		if (unsigned_add_overflows(*num_commits, g->num_commits))
+			die(_("cannot merge graphs with %"PRIuMAX", "
+			      "%"PRIuMAX" commits"),
+			    (uintmax_t)*num_commits,
+			    (uintmax_t)g->num_commits);
+		if (close_gap)
+			missing_filters += g->num_commits;
+		*num_commits += g->num_commits;
+		g = g->base_graph;
+
+		ctx->num_commit_graphs_after--;
+		merged++;
+	}
+
+	trace2_data_intmax("commit-graph", ctx->r, "split/cost-merged-layers",
+			   merged);
+	return g;
+}
+
 static void split_graph_merge_strategy(struct write_commit_graph_context *ctx,
 				       struct commit_graph *graph_to_merge)
 {
@@ -2321,6 +3557,18 @@ static void split_graph_merge_strategy(struct write_commit_graph_context *ctx,
 
 			ctx->num_commit_graphs_after--;
 		}
+
+		if (flags == COMMIT_GRAPH_SPLIT_MERGE_BY_COST)
+			g = merge_by_cost(ctx, g, &num_commits);
+	}
+
+	if (flags != COMMIT_GRAPH_SPLIT_REPLACE) {
+		uint64_t total, cost = chain_lookup_cost(num_commits, g, &total);
+
+		if (total)
+			trace2_data_intmax("commit-graph", ctx->r,
+					   "split/lookup-cost-percent",
+					   cost * 100 / total);
 	}
 
 	if (flags != COMMIT_GRAPH_SPLIT_REPLACE)
@@ -2625,6 +3873,23 @@ int write_commit_graph(struct odb_source *source,
 
 	bloom_settings.hash_version = bloom_settings.hash_version == 2 ? 2 : 1;
 
+	if (flags & COMMIT_GRAPH_WRITE_REACHABILITY_INDEX)
+		ctx.reachability_index = 1;
+	if (!(flags & COMMIT_GRAPH_NO_WRITE_REACHABILITY_INDEX)) {
+		/* Keep the reachability index if the base layer has one. */
+		struct commit_graph *base = g;
+		while (base && base->base_graph)
+			base = base->base_graph;
+		if (base && base->chunk_reachability_index)
+			ctx.reachability_index = 1;
+	}
+
+	if (flags & COMMIT_GRAPH_WRITE_CHANGED_PATH_LISTS)
+		ctx.changed_path_lists = 1;
+	if (!(flags & COMMIT_GRAPH_NO_WRITE_CHANGED_PATH_LISTS) &&
+	    g && g->chunk_path_list_index)
+		ctx.changed_path_lists = 1;
+
 	if (ctx.split) {
 		for (struct commit_graph *chain = g; chain; chain = chain->base_graph)
 			ctx.num_commit_graphs_before++;
@@ -2638,7 +3903,7 @@ int write_commit_graph(struct odb_source *source,
 		}
 
 		if (ctx.opts)
-			replace = ctx.opts->split_flags & COMMIT_GRAPH_SPLIT_REPLACE;
+			replace = ctx.opts->split_flags == COMMIT_GRAPH_SPLIT_REPLACE;
 	}
 
 	if (odb_count_objects(r->objects, ODB_COUNT_OBJECTS_APPROXIMATE, &ctx.approx_nr_objects) < 0)
@@ -2700,6 +3965,17 @@ int write_commit_graph(struct odb_source *source,
 	if (ctx.changed_paths)
 		compute_bloom_filters(&ctx);
 
+	/*
+	 * The labels of the reachability index are only meaningful if all
+	 * ancestors of the commits are numbered in the same file.
+	 */
+	if (ctx.num_commit_graphs_after > 1)
+		ctx.reachability_index = 0;
+	if (ctx.reachability_index)
+		compute_reachability_index(&ctx);
+	if (ctx.changed_path_lists)
+		compute_changed_path_lists(&ctx);
+
 	res = write_commit_graph_file(&ctx);
 
 	if (ctx.changed_paths)
@@ -2713,6 +3989,12 @@ int write_commit_graph(struct odb_source *source,
 cleanup:
 	free(ctx.graph_name);
 	free(ctx.base_graph_name);
+	free(ctx.reachability_labels);
+	free(ctx.path_list_index);
+	free(ctx.path_list_data);
+	for (size_t j = 0; j < ctx.path_names_nr; j++)
+		free(ctx.path_names[j]);
+	free(ctx.path_names);
 	commit_stack_clear(&ctx.commits);
 	oid_array_clear(&ctx.oids);
 	clear_topo_level_slab(&topo_levels);
@@ -2770,6 +4052,7 @@ static int verify_one_commit_graph(struct commit_graph *g,
 	struct object_id prev_oid, cur_oid;
 	struct commit *seen_gen_zero = NULL;
 	struct commit *seen_gen_non_zero = NULL;
+	int check_labels = g->chunk_reachability_index && !g->num_commits_in_base;
 
 	if (!commit_graph_checksum_valid(g)) {
 		graph_report(_("the commit-graph file has incorrect checksum and is likely corrupt"));
@@ -2820,6 +4103,7 @@ static int verify_one_commit_graph(struct commit_graph *g,
 	for (i = 0; i < g->num_commits; i++) {
 		struct commit *graph_commit, *odb_commit;
 		struct commit_list *graph_parents, *odb_parents;
+		struct reachability_label label;
 		timestamp_t max_generation = 0;
 		timestamp_t generation;
 
@@ -2845,6 +4129,13 @@ static int verify_one_commit_graph(struct commit_graph *g,
 		graph_parents = graph_commit->parents;
 		odb_parents = odb_commit->parents;
 
+		if (check_labels) {
+			load_reachability_label(g, i, &label);
+			if (label.low > label.tree_low || label.tree_low > label.post)
+				graph_report(_("commit-graph reachability labels for commit %s are inconsistent"),
+					     oid_to_hex(&cur_oid));
+		}
+
 		while (graph_parents) {
 			if (!odb_parents) {
 				graph_report(_("commit-graph parent list for commit %s is too long"),
@@ -2865,6 +4156,23 @@ static int verify_one_commit_graph(struct commit_graph *g,
 			if (generation > max_generation)
 				max_generation = generation;
 
+			if (check_labels) {
+				struct reachability_label parent_label;
+				uint32_t pos = commit_graph_position(graph_parents->item);
+
+				if (pos >= g->num_commits)
+					graph_report(_("commit-graph parent for %s is outside of the file"),
+						     oid_to_hex(&cur_oid));
+				else {
+					load_reachability_label(g, pos, &parent_label);
+					if (parent_label.post >= label.post ||
+					    parent_label.low < label.low)
+						graph_report(_("commit-graph reachability labels for commit %s do not cover parent %s"),
+							     oid_to_hex(&cur_oid),
+							     oid_to_hex(&graph_parents->item->object.oid));
+				}
+			}
+
 			graph_parents = graph_parents->next;
 			odb_parents = odb_parents->next;
 		}
@@ -35,6 +35,14 @@ int open_commit_graph(const char *graph_file, int *fd, struct stat *st);
 int open_commit_graph_chain(const char *chain_file, int *fd, struct stat *st,
 			    const struct git_hash_algo *hash_algo);
 
+/*
+ * Return whether the history of the repository is the one described by
+ * its commit objects, i.e. it is not altered by grafts, replace refs or
+ * a shallow clone. Data derived from the commit history (like the
+ * commit-graph) can only be used in that case.
+ */
+int commit_graph_compatible(struct repository *r);
+
 /*
  * Given a commit struct, try to fill the commit struct info, including:
  *  1. tree object
@@ -109,6 +117,14 @@ struct commit_graph {
 	const unsigned char *chunk_bloom_indexes;
 	const unsigned char *chunk_bloom_data;
 	size_t chunk_bloom_data_size;
+	const unsigned char *chunk_reachability_index;
+	const unsigned char *chunk_path_list_index;
+	const unsigned char *chunk_path_list_data;
+	size_t chunk_path_list_data_size;
+	const unsigned char *chunk_path_name_offsets;
+	size_t chunk_path_name_offsets_size;
+	const unsigned char *chunk_path_names;
+	size_t chunk_path_names_size;
 
 	struct topo_level_slab *topo_levels;
 	struct bloom_filter_settings *bloom_filter_settings;
@@ -144,18 +160,90 @@ int corrected_commit_dates_enabled(struct repository *r);
 
 struct bloom_filter_settings *get_bloom_filter_settings(struct repository *r);
 
+/*
+ * Use the reachability index of the commit-graph to decide whether "to"
+ * can be reached from "from" without walking any commits. Return 1 if it
+ * can, 0 if it cannot and -1 if the index does not know, in which case
+ * the caller has to walk.
+ */
+int commit_graph_can_reach(struct repository *r,
+			   struct commit *from, struct commit *to);
+
+/*
+ * Set "redundant[i]" for each commit in "array" that can be reached from
+ * another one of them, walking the commit-graph with the number of threads
+ * given by "commitGraph.threads". Return -1 without doing anything if not
+ * all commits are in the commit-graph or if only one thread would be used.
+ */
+int commit_graph_find_redundant(struct repository *r,
+				struct commit **array, size_t cnt,
+				unsigned char *redundant);
+
+enum count_walk_flags {
+	COUNT_WALK_FIRST_PARENT_ONLY         = (1 << 0),
+	COUNT_WALK_EXCLUDE_FIRST_PARENT_ONLY = (1 << 1),
+};
+
+/*
+ * Count the commits that can be reached from one of "include", but from
+ * none of "exclude", like "git rev-list --count" does. The walk runs on
+ * commit-graph positions, reading parents and generation numbers from the
+ * commit-graph, and does not look up a "struct commit" for any commit it
+ * visits. Return -1 without doing anything if not all commits are in the
+ * commit-graph or if it has no generation numbers.
+ */
+int commit_graph_count_reachable(struct repository *r,
+				 struct commit **include, size_t include_nr,
+				 struct commit **exclude, size_t exclude_nr,
+				 enum count_walk_flags walk_flags,
+				 uint32_t *count);
+
+/*
+ * The paths a commit changed compared to its first parent (or to the
+ * empty tree for a root commit), as recorded in the commit-graph. Only
+ * the paths of the files themselves are recorded, not their leading
+ * directories. They are sorted and no rename detection is done.
+ */
+struct commit_changed_paths {
+	const struct commit_graph *graph;
+	const unsigned char *ids;
+	size_t nr;
+};
+
+/*
+ * Return whether any layer of the commit-graph records changed-path lists.
+ */
+int commit_graph_has_changed_path_lists(struct repository *r);
+
+/*
+ * Fill in "paths" with the changed paths of "c" and return 0. Return -1
+ * if the commit-graph does not record them for this commit, e.g. because
+ * it changed too many paths or a submodule.
+ */
+int get_commit_changed_paths(struct repository *r, struct commit *c,
+			     struct commit_changed_paths *paths);
+
+/* Return the "n"-th path of "paths". */
+const char *commit_changed_path(const struct commit_changed_paths *paths,
+				size_t n);
+
 enum commit_graph_write_flags {
 	COMMIT_GRAPH_WRITE_APPEND     = (1 << 0),
 	COMMIT_GRAPH_WRITE_PROGRESS   = (1 << 1),
 	COMMIT_GRAPH_WRITE_SPLIT      = (1 << 2),
 	COMMIT_GRAPH_WRITE_BLOOM_FILTERS = (1 << 3),
 	COMMIT_GRAPH_NO_WRITE_BLOOM_FILTERS = (1 << 4),
+	COMMIT_GRAPH_WRITE_REACHABILITY_INDEX = (1 << 5),
+	COMMIT_GRAPH_NO_WRITE_REACHABILITY_INDEX = (1 << 6),
+	COMMIT_GRAPH_WRITE_CHANGED_PATH_LISTS = (1 << 7),
+	COMMIT_GRAPH_NO_WRITE_CHANGED_PATH_LISTS = (1 << 8),
 };
 
 enum commit_graph_split_flags {
 	COMMIT_GRAPH_SPLIT_UNSPECIFIED      = 0,
 	COMMIT_GRAPH_SPLIT_MERGE_PROHIBITED = 1,
-	COMMIT_GRAPH_SPLIT_REPLACE          = 2
+	COMMIT_GRAPH_SPLIT_REPLACE          = 2,
+	COMMIT_GRAPH_SPLIT_MERGE_BY_COST    = 3
 };
 
 struct commit_graph_opts {
@@ -164,6 +252,7 @@ struct commit_graph_opts {
 	timestamp_t expire_time;
 	enum commit_graph_split_flags split_flags;
 	int max_new_filters;
+	int max_lookup_cost;
 };
 
 /*
@@ -455,6 +455,32 @@ static int remove_redundant_with_gen(struct repository *r,
 	return 0;
 }
 
+/*
+ * Below this many commits, walking with a single thread is fast enough and
+ * setting up threads does not pay off.
+ */
+#define REMOVE_REDUNDANT_THREADED_MIN 64
+
+static int remove_redundant_threaded(struct repository *r,
+				     struct commit **array, size_t cnt,
+				     size_t *dedup_cnt)
+{
+	unsigned char *redundant = xcalloc(cnt, 1);
+	size_t i, filled;
+
+	if (commit_graph_find_redundant(r, array, cnt, redundant)) {
+		free(redundant);
+		return -1;
+	}
+
+	for (i = filled = 0; i < cnt; i++)
+		if (!redundant[i])
+			array[filled++] = array[i];
+	*dedup_cnt = filled;
+	free(redundant);
+	return 0;
+}
+
 static int remove_redundant(struct repository *r, struct commit **array,
 			    size_t cnt, size_t *dedup_cnt)
 {
@@ -466,6 +492,10 @@ static int remove_redundant(struct repository *r, struct commit **array,
 	 * that number.
 	 */
 	if (generation_numbers_enabled(r)) {
+		if (cnt >= REMOVE_REDUNDANT_THREADED_MIN &&
+		    !remove_redundant_threaded(r, array, cnt, dedup_cnt))
+			return 0;
+
 		/*
 		 * If we have a single commit with finite generation
 		 * number, then the _with_gen algorithm is preferred.
@@ -590,6 +620,28 @@ int repo_is_descendant_of(struct repository *r,
 	}
 }
 
+/*
+ * Ask the reachability index whether any of "from" can reach "to". Return 1
+ * if one of them can, 0 if none can and -1 if we have to walk to find out.
+ */
+static int can_reach_any(struct repository *r,
+			 int nr_from, struct commit **from,
+			 struct commit *to)
+{
+	int i, ret = 0;
+
+	for (i = 0; i < nr_from; i++) {
+		switch (commit_graph_can_reach(r, from[i], to)) {
+		case 1:
+			return 1;
+		case -1:
+			ret = -1;
+			break;
+		}
+	}
+	return ret;
+}
+
 /*
  * Is "commit" an ancestor of one of the "references"?
  */
@@ -620,6 +672,13 @@ int repo_in_merge_bases_many(struct repository *r, struct commit *commit,
 	if (generation > max_generation)
 		return ret;
 
+	switch (can_reach_any(r, nr_reference, reference, commit)) {
+	case 1:
+		return 1;
+	case 0:
+		return 0;
+	}
+
 	if (paint_down_to_common(r, commit,
 				 nr_reference, reference,
 				 generation, mb_flags, &bases))
@@ -755,6 +814,27 @@ static int in_commit_list(const struct commit_list *want, struct commit *c)
 	return 0;
 }
 
+/*
+ * Ask the reachability index whether "from" can reach any commit in "to".
+ * Return 1 if it can, 0 if it cannot and -1 if that is unknown.
+ */
+static int can_reach_any_in_list(struct commit *from,
+				 const struct commit_list *to)
+{
+	int ret = 0;
+
+	for (; to; to = to->next) {
+		switch (commit_graph_can_reach(the_repository, from, to->item)) {
+		case 1:
+			return 1;
+		case -1:
+			ret = -1;
+			break;
+		}
+	}
+	return ret;
+}
+
 /*
  * Test whether the candidate is contained in the list.
  * Do not recurse to find out, though, but return -1 if inconclusive.
@@ -782,6 +862,16 @@ static enum contains_result contains_test(struct commit *candidate,
 	if (commit_graph_generation(candidate) < cutoff)
 		return CONTAINS_NO;
 
+	/* or can the reachability index tell? */
+	switch (can_reach_any_in_list(candidate, want)) {
+	case 1:
+		*cached = CONTAINS_YES;
+		return CONTAINS_YES;
+	case 0:
+		*cached = CONTAINS_NO;
+		return CONTAINS_NO;
+	}
+
 	return CONTAINS_UNKNOWN;
 }
 
@@ -996,9 +1086,26 @@ int can_all_from_reach(struct commit_list *from, struct commit_list *to,
 		to_iter = to_iter->next;
 	}
 
+	/*
+	 * Commits the reachability index knows to reach one of "to" need no
+	 * walk, so mark them as done; if it knows one of them cannot reach
+	 * any, we are done altogether.
+	 */
+	for (from_iter = from; from_iter; from_iter = from_iter->next) {
+		int reach = can_reach_any_in_list(from_iter->item, to);
+
+		if (reach == 1) {
+			from_iter->item->object.flags |= PARENT1;
+		} else if (!reach) {
+			result = 0;
+			goto cleanup;
+		}
+	}
+
 	result = can_all_from_reach_with_flag(&from_objs, PARENT2, PARENT1,
 					      min_commit_date, min_generation);
 
+cleanup:
 	while (from) {
 		clear_commit_marks(from->item, PARENT1);
 		from = from->next;
@@ -0,0 +1,294 @@
+#include "git-compat-util.h"
+#include "batch-lstat.h"
+
+#ifdef HAVE_IO_URING
+
+#include <linux/io_uring.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <sys/sysmacros.h>
+
+/*
+ * We talk to io_uring through the raw system calls rather than
+ * liburing; all we need is a single ring that we fill with statx
+ * requests and then drain, which is little enough code to not warrant
+ * another dependency.
+ */
+#define BATCH_LSTAT_DEPTH 64
+
+struct batch_lstat {
+	int fd;
+	unsigned int entries;
+
+	void *sq_ring, *cq_ring;
+	size_t sq_ring_size, cq_ring_size;
+	struct io_uring_sqe *sqes;
+	size_t sqes_size;
+
+	unsigned *sq_tail, *sq_mask, *sq_array;
+	unsigned *cq_head, *cq_tail, *cq_mask;
+	struct io_uring_cqe *cqes;
+
+	struct statx *stx;
+};
+
+static int sys_io_uring_setup(unsigned entries, struct io_uring_params *p)
+{
+	return (int)syscall(__NR_io_uring_setup, entries, p);
+}
+
+static int sys_io_uring_enter(int fd, unsigned to_submit,
+			      unsigned min_complete, unsigned flags)
+{
+	return (int)syscall(__NR_io_uring_enter, fd, to_submit, min_complete,
+			    flags, NULL, 0);
+}
+
+static int sys_io_uring_register(int fd, unsigned opcode, void *arg,
+				 unsigned nr_args)
+{
+	return (int)syscall(__NR_io_uring_register, fd, opcode, arg, nr_args);
+}
+
+static int statx_supported(int fd)
+{
+	struct io_uring_probe *probe;
+	size_t len = st_add(sizeof(*probe),
+			    st_mult(256, sizeof(struct io_uring_probe_op)));
+	int ret = 0;
+
+	probe = xcalloc(1, len);
+	if (!sys_io_uring_register(fd, IORING_REGISTER_PROBE, probe, 256) &&
+	    probe->ops_len > IORING_OP_STATX &&
+	    (probe->ops[IORING_OP_STATX].flags & IO_URING_OP_SUPPORTED))
+		ret = 1;
+	free(probe);
+	return ret;
+}
+
+static void unmap_rings(struct batch_lstat *b)
+{
+	if (b->sqes && b->sqes != MAP_FAILED)
+		munmap(b->sqes, b->sqes_size);
+	if (b->cq_ring && b->cq_ring != MAP_FAILED && b->cq_ring != b->sq_ring)
+		munmap(b->cq_ring, b->cq_ring_size);
+	if (b->sq_ring && b->sq_ring != MAP_FAILED)
+		munmap(b->sq_ring, b->sq_ring_size);
+}
+
+struct batch_lstat *batch_lstat_init(void)
+{
+	struct io_uring_params p;
+	struct batch_lstat *b;
+	int fd;
+
+	memset(&p, 0, sizeof(p));
+	fd = sys_io_uring_setup(BATCH_LSTAT_DEPTH, &p);
+	if (fd < 0)
+		return NULL;
+	if (!statx_supported(fd)) {
+		close(fd);
+		return NULL;
+	}
+
+	CALLOC_ARRAY(b, 1);
+	b->fd = fd;
+	b->entries = p.sq_entries;
+	if (b->entries > p.cq_entries)
+		b->entries = p.cq_entries;
+
+	b->sq_ring_size = p.sq_off.array + p.sq_entries * sizeof(unsigned);
+	b->cq_ring_size = p.cq_off.cqes +
+		p.cq_entries * sizeof(struct io_uring_cqe);
+	if (p.features & IORING_FEAT_SINGLE_MMAP) {
+		if (b->cq_ring_size > b->sq_ring_size)
+			b->sq_ring_size = b->cq_ring_size;
+		b->cq_ring_size = b->sq_ring_size;
+	}
+
+	b->sq_ring = mmap(NULL, b->sq_ring_size, PROT_READ | PROT_WRITE,
+			  MAP_SHARED | MAP_POPULATE, fd, IORING_OFF_SQ_RING);
+	if (b->sq_ring == MAP_FAILED)
+		goto fail;
+	if (p.features & IORING_FEAT_SINGLE_MMAP)
+		b->cq_ring = b->sq_ring;
+	else
+		b->cq_ring = mmap(NULL, b->cq_ring_size, PROT_READ | PROT_WRITE,
+				  MAP_SHARED | MAP_POPULATE, fd,
+				  IORING_OFF_CQ_RING);
+	if (b->cq_ring == MAP_FAILED)
+		goto fail;
+	b->sqes_size = p.sq_entries * sizeof(struct io_uring_sqe);
+	b->sqes = mmap(NULL, b->sqes_size, PROT_READ | PROT_WRITE,
+		       MAP_SHARED | MAP_POPULATE, fd, IORING_OFF_SQES);
+	if (b->sqes == MAP_FAILED)
+		goto fail;
+
+	b->sq_tail = (unsigned *)((char *)b->sq_ring + p.sq_off.tail);
+	b->sq_mask = (unsigned *)((char *)b->sq_ring + p.sq_off.ring_mask);
+	b->sq_array = (unsigned *)((char *)b->sq_ring + p.sq_off.array);
+	b->cq_head = (unsigned *)((char *)b->cq_ring + p.cq_off.head);
+	b->cq_tail = (unsigned *)((char *)b->cq_ring + p.cq_off.tail);
+	b->cq_mask = (unsigned *)((char *)b->cq_ring + p.cq_off.ring_mask);
+	b->cqes = (struct io_uring_cqe *)((char *)b->cq_ring + p.cq_off.cqes);
+
+	CALLOC_ARRAY(b->stx, b->entries);
+	return b;
+
+fail:
+	unmap_rings(b);
+	close(fd);
+	free(b);
+	return NULL;
+}
+
+unsigned int batch_lstat_size(struct batch_lstat *b)
+{
+	return b->entries;
+}
+
+static void statx_to_stat(const struct statx *stx, struct stat *st)
+{
+	memset(st, 0, sizeof(*st));
+	st->st_dev = makedev(stx->stx_dev_major, stx->stx_dev_minor);
+	st->st_ino = stx->stx_ino;
+	st->st_mode = stx->stx_mode;
+	st->st_nlink = stx->stx_nlink;
+	st->st_uid = stx->stx_uid;
+	st->st_gid = stx->stx_gid;
+	st->st_rdev = makedev(stx->stx_rdev_major, stx->stx_rdev_minor);
+	st->st_size = stx->stx_size;
+	st->st_blksize = stx->stx_blksize;
+	st->st_blocks = stx->stx_blocks;
+	st->st_atim.tv_sec = stx->stx_atime.tv_sec;
+	st->st_atim.tv_nsec = stx->stx_atime.tv_nsec;
+	st->st_mtim.tv_sec = stx->stx_mtime.tv_sec;
+	st->st_mtim.tv_nsec = stx->stx_mtime.tv_nsec;
+	st->st_ctim.tv_sec = stx->stx_ctime.tv_sec;
+	st->st_ctim.tv_nsec = stx->stx_ctime.tv_nsec;
+}
+
+/*
+ * Reap "pending" completions without looking at them. The kernel writes
+ * the results of requests that are in flight into b->stx, so they must
+ * be done before we give up on the ring. If even that fails, b->stx is
+ * leaked rather than freed under the kernel's feet.
+ */
+static void drain_completions(struct batch_lstat *b, unsigned int pending)
+{
+	while (pending) {
+		unsigned int head, cq_tail;
+
+		if (sys_io_uring_enter(b->fd, 0, pending,
+				       IORING_ENTER_GETEVENTS) < 0 &&
+		    errno != EINTR && errno != EAGAIN) {
+			b->stx = NULL;
+			return;
+		}
+
+		head = *b->cq_head;
+		cq_tail = __atomic_load_n(b->cq_tail, __ATOMIC_ACQUIRE);
+		pending -= cq_tail - head;
+		__atomic_store_n(b->cq_head, cq_tail, __ATOMIC_RELEASE);
+	}
+}
+
+int batch_lstat(struct batch_lstat *b, const char **paths,
+		struct stat *st, int *err, unsigned int nr)
+{
+	unsigned int i, tail, mask, submitted = 0, done = 0;
+
+	if (nr > b->entries)
+		BUG("batch_lstat() called with %u paths, max is %u",
+		    nr, b->entries);
+
+	tail = *b->sq_tail;
+	mask = *b->sq_mask;
+	for (i = 0; i < nr; i++) {
+		unsigned int idx = tail & mask;
+		struct io_uring_sqe *sqe = &b->sqes[idx];
+
+		memset(sqe, 0, sizeof(*sqe));
+		sqe->opcode = IORING_OP_STATX;
+		sqe->fd = AT_FDCWD;
+		sqe->addr = (uintptr_t)paths[i];
+		sqe->len = STATX_BASIC_STATS;
+		sqe->off = (uintptr_t)&b->stx[i];
+		sqe->statx_flags = AT_SYMLINK_NOFOLLOW;
+		sqe->user_data = i;
+		b->sq_array[idx] = idx;
+		tail++;
+	}
+	__atomic_store_n(b->sq_tail, tail, __ATOMIC_RELEASE);
+
+	while (done < nr) {
+		unsigned int head, cq_tail;
+		int ret;
+
+		ret = sys_io_uring_enter(b->fd, nr - submitted, nr - done,
+					 IORING_ENTER_GETEVENTS);
+		if (ret < 0) {
+			if (errno == EINTR || errno == EAGAIN)
+				continue;
+			/*
+			 * Hand the whole batch back to the caller, once
+			 * nothing is in flight anymore.
+			 */
+			drain_completions(b, submitted - done);
+			return -1;
+		}
+		submitted += ret;
+
+		head = *b->cq_head;
+		cq_tail = __atomic_load_n(b->cq_tail, __ATOMIC_ACQUIRE);
+		while (head != cq_tail) {
+			struct io_uring_cqe *cqe = &b->cqes[head & *b->cq_mask];
+			unsigned int pos = cqe->user_data;
+
+			if (cqe->res < 0) {
+				err[pos] = -cqe->res;
+			} else {
+				err[pos] = 0;
+				statx_to_stat(&b->stx[pos], &st[pos]);
+			}
+			head++;
+			done++;
+		}
+		__atomic_store_n(b->cq_head, head, __ATOMIC_RELEASE);
+	}
+	return 0;
+}
+
+void batch_lstat_release(struct batch_lstat *b)
+{
+	if (!b)
+		return;
+	unmap_rings(b);
+	close(b->fd);
+	free(b->stx);
+	free(b);
+}
+
+#else
+
+struct batch_lstat *batch_lstat_init(void)
+{
+	return NULL;
+}
+
+unsigned int batch_lstat_size(struct batch_lstat *b UNUSED)
+{
+	return 0;
+}
+
+int batch_lstat(struct batch_lstat *b UNUSED, const char **paths UNUSED,
+		struct stat *st UNUSED, int *err UNUSED, unsigned int nr UNUSED)
+{
+	return -1;
+}
+
+void batch_lstat_release(struct batch_lstat *b UNUSED)
+{
+}
+
+#endif
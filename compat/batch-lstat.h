@@ -0,0 +1,38 @@
+#ifndef COMPAT_BATCH_LSTAT_H
+#define COMPAT_BATCH_LSTAT_H
+
+/*
+ * Submit many lstat() calls to the kernel at once, on platforms that
+ * have a way to do so (currently io_uring's statx on Linux).
+ *
+ * A context is not thread-safe; each thread needs its own.
+ */
+struct batch_lstat;
+
+/*
+ * Return a new context, or NULL if batched lstat() is not available on
+ * this platform or kernel, in which case the caller should fall back to
+ * calling lstat() itself.
+ */
+struct batch_lstat *batch_lstat_init(void);
+
+/*
+ * The maximum number of paths that can be passed to a single call of
+ * batch_lstat().
+ */
+unsigned int batch_lstat_size(struct batch_lstat *b);
+
+/*
+ * lstat() each of the "nr" paths into "st". "err" receives 0 for paths
+ * that were successfully stat'ed, or the errno lstat() would have set.
+ *
+ * Returns 0 on success, or -1 if the batch could not be completed; the
+ * results are unusable then, and the caller should release the context
+ * and fall back to lstat() for these (and later) paths.
+ */
+int batch_lstat(struct batch_lstat *b, const char **paths,
+		struct stat *st, int *err, unsigned int nr);
+
+void batch_lstat_release(struct batch_lstat *b);
+
+#endif
@@ -27,12 +27,14 @@
 #include "varint.h"
 #include "ewah/ewok.h"
 #include "fsmonitor-ll.h"
+#include "lockfile.h"
 #include "read-cache-ll.h"
 #include "setup.h"
 #include "sparse-index.h"
 #include "strbuf.h"
 #include "submodule-config.h"
 #include "symlinks.h"
+#include "thread-utils.h"
 #include "trace2.h"
 #include "tree.h"
 #include "hex.h"
@@ -1013,6 +1015,8 @@ static int read_skip_worktree_file_from_index(struct index_state *istate,
  * Frees memory within pl which was allocated for exclude patterns and
  * the file buffer.  Does not free pl itself.
  */
+static void free_pattern_index(struct pattern_index *index);
+
 void clear_pattern_list(struct pattern_list *pl)
 {
 	int i;
@@ -1022,6 +1026,7 @@ void clear_pattern_list(struct pattern_list *pl)
 	free(pl->patterns);
 	clear_pattern_entry_hashmap(&pl->recursive_hashmap);
 	clear_pattern_entry_hashmap(&pl->parent_hashmap);
+	free_pattern_index(pl->index);
 
 	memset(pl, 0, sizeof(*pl));
 }
@@ -1462,6 +1467,324 @@ int match_pathname(const char *pathname, int pathlen,
 				 WM_PATHNAME) == 0;
 }
 
+/*
+ * Long pattern lists, like generated ignore files, mostly consist of
+ * patterns without wildcards. Matching them one by one against every
+ * path is wasteful, so we use a "struct pattern_index" for them. As
+ * the last matching pattern wins, we look for the match with the
+ * highest position.
+ */
+#define PATTERN_INDEX_MIN_PATTERNS 32
+
+struct pattern_index_entry {
+	struct hashmap_entry ent;
+	const char *key;
+	size_t keylen;
+	char *key_to_free;
+	/* positions of the patterns, in increasing order */
+	int *pos;
+	size_t nr, alloc;
+};
+
+static unsigned int pattern_index_hash(const char *key, size_t len)
+{
+	return ignore_case ? memihash(key, len) : memhash(key, len);
+}
+
+static int pattern_index_entry_cmp(const void *cmp_data UNUSED,
+				   const struct hashmap_entry *eptr,
+				   const struct hashmap_entry *entry_or_key,
+				   const void *keydata UNUSED)
+{
+	const struct pattern_index_entry *e1, *e2;
+
+	e1 = container_of(eptr, const struct pattern_index_entry, ent);
+	e2 = container_of(entry_or_key, const struct pattern_index_entry, ent);
+	return e1->keylen != e2->keylen ||
+	       fspathncmp(e1->key, e2->key, e1->keylen);
+}
+
+static struct pattern_index_entry *pattern_index_find(struct hashmap *map,
+						      const char *key,
+						      size_t keylen)
+{
+	struct pattern_index_entry k;
+
+	hashmap_entry_init(&k.ent, pattern_index_hash(key, keylen));
+	k.key = key;
+	k.keylen = keylen;
+	return hashmap_get_entry(map, &k, ent, NULL);
+}
+
+static void pattern_index_map_add(struct hashmap *map, const char *key,
+				  size_t keylen, char *key_to_free, int pos)
+{
+	struct pattern_index_entry *e = pattern_index_find(map, key, keylen);
+
+	if (!e) {
+		CALLOC_ARRAY(e, 1);
+		hashmap_entry_init(&e->ent, pattern_index_hash(key, keylen));
+		e->key = key;
+		e->keylen = keylen;
+		e->key_to_free = key_to_free;
+		hashmap_add(map, &e->ent);
+	} else {
+		free(key_to_free);
+	}
+	ALLOC_GROW(e->pos, e->nr + 1, e->alloc);
+	e->pos[e->nr++] = pos;
+}
+
+static void pattern_index_map_clear(struct hashmap *map)
+{
+	struct hashmap_iter iter;
+	struct pattern_index_entry *e;
+
+	hashmap_for_each_entry(map, &iter, e, ent) {
+		free(e->key_to_free);
+		free(e->pos);
+	}
+	hashmap_clear_and_free(map, struct pattern_index_entry, ent);
+}
+
+void pattern_index_init(struct pattern_index *index)
+{
+	memset(index, 0, sizeof(*index));
+	hashmap_init(&index->basenames, pattern_index_entry_cmp, NULL, 0);
+	hashmap_init(&index->suffixes, pattern_index_entry_cmp, NULL, 0);
+	hashmap_init(&index->paths, pattern_index_entry_cmp, NULL, 0);
+}
+
+void pattern_index_clear(struct pattern_index *index)
+{
+	pattern_index_map_clear(&index->basenames);
+	pattern_index_map_clear(&index->suffixes);
+	pattern_index_map_clear(&index->paths);
+	free(index->suffix_len);
+	free(index->other);
+	memset(index, 0, sizeof(*index));
+}
+
+static void pattern_index_add_suffix_len(struct pattern_index *index, size_t len)
+{
+	size_t i;
+
+	for (i = 0; i < index->suffix_len_nr; i++) {
+		if (index->suffix_len[i] == len)
+			return;
+		if (index->suffix_len[i] > len)
+			break;
+	}
+	ALLOC_GROW(index->suffix_len, index->suffix_len_nr + 1,
+		   index->suffix_len_alloc);
+	MOVE_ARRAY(index->suffix_len + i + 1, index->suffix_len + i,
+		   index->suffix_len_nr - i);
+	index->suffix_len[i] = len;
+	index->suffix_len_nr++;
+}
+
+void pattern_index_add(struct pattern_index *index, int pos,
+		       const char *pattern, int patternlen,
+		       int nowildcardlen, unsigned flags,
+		       const char *base, size_t baselen)
+{
+	const char *p = pattern;
+	int len = patternlen;
+
+	index->nr++;
+	if (flags & PATTERN_FLAG_NODIR) {
+		if (nowildcardlen == len) {
+			pattern_index_map_add(&index->basenames, p, len, NULL, pos);
+			return;
+		}
+		if (flags & PATTERN_FLAG_ENDSWITH) {
+			pattern_index_map_add(&index->suffixes, p + 1, len - 1,
+					      NULL, pos);
+			pattern_index_add_suffix_len(index, len - 1);
+			return;
+		}
+	} else if (nowildcardlen == len) {
+		/* see match_pathname() */
+		if (*p == '/') {
+			p++;
+			len--;
+		}
+		if (len) {
+			struct strbuf path = STRBUF_INIT;
+			size_t pathlen;
+			char *key;
+
+			strbuf_add(&path, base, baselen);
+			strbuf_add(&path, p, len);
+			key = strbuf_detach(&path, &pathlen);
+			pattern_index_map_add(&index->paths, key, pathlen, key, pos);
+			return;
+		}
+	}
+	ALLOC_GROW(index->other, index->other_nr + 1, index->other_alloc);
+	index->other[index->other_nr++] = pos;
+}
+
+static void pattern_index_entry_each(const struct pattern_index_entry *e,
+				     pattern_index_match_fn fn, void *data)
+{
+	if (!e)
+		return;
+	for (size_t i = 0; i < e->nr; i++)
+		fn(e->pos[i], data);
+}
+
+void pattern_index_for_each_match(struct pattern_index *index,
+				  const char *path, size_t pathlen,
+				  size_t basename_offset,
+				  pattern_index_match_fn fn, void *data)
+{
+	const char *basename = path + basename_offset;
+	size_t basenamelen = pathlen - basename_offset;
+
+	pattern_index_entry_each(pattern_index_find(&index->paths, path,
+						    pathlen), fn, data);
+	pattern_index_entry_each(pattern_index_find(&index->basenames,
+						    basename, basenamelen),
+				 fn, data);
+	for (size_t i = 0; i < index->suffix_len_nr; i++) {
+		size_t len = index->suffix_len[i];
+
+		if (len > basenamelen)
+			break;
+		pattern_index_entry_each(
+			pattern_index_find(&index->suffixes,
+					   basename + basenamelen - len, len),
+			fn, data);
+	}
+}
+
+static struct pattern_index *build_pattern_index(struct pattern_list *pl)
+{
+	struct pattern_index *index;
+
+	ALLOC_ARRAY(index, 1);
+	pattern_index_init(index);
+	for (int i = 0; i < pl->nr; i++) {
+		struct path_pattern *pattern = pl->patterns[i];
+
+		pattern_index_add(index, i, pattern->pattern,
+				  pattern->patternlen, pattern->nowildcardlen,
+				  pattern->flags, pattern->base,
+				  pattern->baselen);
+	}
+	return index;
+}
+
+static void free_pattern_index(struct pattern_index *index)
+{
+	if (!index)
+		return;
+	pattern_index_clear(index);
+	free(index);
+}
+
+static struct pattern_index *get_pattern_index(struct pattern_list *pl)
+{
+	static int min_patterns = -1;
+
+	if (min_patterns < 0)
+		min_patterns = git_env_ulong("GIT_TEST_PATTERN_INDEX_MIN",
+					     PATTERN_INDEX_MIN_PATTERNS);
+	if (pl->nr < min_patterns)
+		return NULL;
+	if (pl->index && pl->index->nr != pl->nr)
+		FREE_AND_NULL(pl->index);
+	if (!pl->index)
+		pl->index = build_pattern_index(pl);
+	return pl->index;
+}
+
+static int pattern_matches(struct path_pattern *pattern,
+			   const char *pathname, int pathlen,
+			   const char *basename, int *dtype,
+			   struct index_state *istate)
+{
+	const char *exclude = pattern->pattern;
+	int prefix = pattern->nowildcardlen;
+
+	if (pattern->flags & PATTERN_FLAG_MUSTBEDIR) {
+		*dtype = resolve_dtype(*dtype, istate, pathname, pathlen);
+		if (*dtype != DT_DIR)
+			return 0;
+	}
+
+	if (pattern->flags & PATTERN_FLAG_NODIR)
+		return match_basename(basename,
+				      pathlen - (basename - pathname),
+				      exclude, prefix, pattern->patternlen,
+				      pattern->flags);
+
+	assert(pattern->baselen == 0 ||
+	       pattern->base[pattern->baselen - 1] == '/');
+	return match_pathname(pathname, pathlen,
+			      pattern->base,
+			      pattern->baselen ? pattern->baselen - 1 : 0,
+			      exclude, prefix, pattern->patternlen);
+}
+
+struct last_indexed_match {
+	struct pattern_list *pl;
+	const char *pathname;
+	int pathlen;
+	int *dtype;
+	struct index_state *istate;
+	int best;
+};
+
+static void last_indexed_match_fn(int pos, void *data)
+{
+	struct last_indexed_match *m = data;
+
+	if (pos <= m->best)
+		return;
+	if (m->pl->patterns[pos]->flags & PATTERN_FLAG_MUSTBEDIR) {
+		*m->dtype = resolve_dtype(*m->dtype, m->istate,
+					  m->pathname, m->pathlen);
+		if (*m->dtype != DT_DIR)
+			return;
+	}
+	m->best = pos;
+}
+
+static struct path_pattern *last_matching_pattern_from_index(
+		struct pattern_index *index, struct pattern_list *pl,
+		const char *pathname, int pathlen,
+		const char *basename, int *dtype,
+		struct index_state *istate)
+{
+	struct last_indexed_match m = {
+		.pl = pl,
+		.pathname = pathname,
+		.pathlen = pathlen,
+		.dtype = dtype,
+		.istate = istate,
+		.best = -1,
+	};
+	int best;
+
+	pattern_index_for_each_match(index, pathname, pathlen,
+				     basename - pathname,
+				     last_indexed_match_fn, &m);
+	best = m.best;
+
+	for (size_t i = index->other_nr; i && index->other[i - 1] > best; i--) {
+		int pos = index->other[i - 1];
+
+		if (pattern_matches(pl->patterns[pos], pathname, pathlen,
+				    basename, dtype, istate)) {
+			best = pos;
+			break;
+		}
+	}
+	return best < 0 ? NULL : pl->patterns[best];
+}
+
 /*
  * Scan the given exclude list in reverse to see whether pathname
  * should be ignored.  The first match (i.e. the last on the list), if
@@ -1475,45 +1798,26 @@ static struct path_pattern *last_matching_pattern_from_list(const char *pathname
 						       struct pattern_list *pl,
 						       struct index_state *istate)
 {
-	struct path_pattern *res = NULL; /* undecided */
+	struct pattern_index *index;
 	int i;
 
 	if (!pl->nr)
 		return NULL;	/* undefined */
 
+	index = get_pattern_index(pl);
+	if (index)
+		return last_matching_pattern_from_index(index, pl, pathname,
+							pathlen, basename,
+							dtype, istate);
+
 	for (i = pl->nr - 1; 0 <= i; i--) {
 		struct path_pattern *pattern = pl->patterns[i];
-		const char *exclude = pattern->pattern;
-		int prefix = pattern->nowildcardlen;
-
-		if (pattern->flags & PATTERN_FLAG_MUSTBEDIR) {
-			*dtype = resolve_dtype(*dtype, istate, pathname, pathlen);
-			if (*dtype != DT_DIR)
-				continue;
-		}
 
-		if (pattern->flags & PATTERN_FLAG_NODIR) {
-			if (match_basename(basename,
-					   pathlen - (basename - pathname),
-					   exclude, prefix, pattern->patternlen,
-					   pattern->flags)) {
-				res = pattern;
-				break;
-			}
-			continue;
-		}
-
-		assert(pattern->baselen == 0 ||
-		       pattern->base[pattern->baselen - 1] == '/');
-		if (match_pathname(pathname, pathlen,
-				   pattern->base,
-				   pattern->baselen ? pattern->baselen - 1 : 0,
-				   exclude, prefix, pattern->patternlen)) {
-			res = pattern;
-			break;
-		}
+		if (pattern_matches(pattern, pathname, pathlen, basename,
+				    dtype, istate))
+			return pattern;
 	}
-	return res;
+	return NULL;
 }
 
 /*
@@ -2583,7 +2887,10 @@ static int valid_cached_dir(struct dir_struct *dir,
 	 * With fsmonitor, we can trust the untracked cache's valid field.
 	 */
 	refresh_fsmonitor(istate);
-	if (!(dir->untracked->use_fsmonitor && untracked->valid)) {
+	if (untracked->stat_ok) {
+		/* checked by preload_untracked_cache() */
+		untracked->stat_ok = 0;
+	} else if (!(dir->untracked->use_fsmonitor && untracked->valid)) {
 		if (lstat(path->len ? path->buf : ".", &st)) {
 			memset(&untracked->stat_data, 0, sizeof(untracked->stat_data));
 			return 0;
@@ -3180,10 +3487,166 @@ static void emit_traversal_statistics(struct dir_struct *dir,
 			   "opendir", dir->untracked->dir_opened);
 }
 
+/*
+ * Validating the untracked cache costs an lstat() for each directory
+ * it knows about, which read_directory_recursive() would do one at a
+ * time. Check the directories that are still valid in parallel
+ * upfront instead, in the same way as preload_index() does for the
+ * index entries, and let valid_cached_dir() trust what we found.
+ */
+#define PRELOAD_MAX_PARALLEL (20)
+#define PRELOAD_THREAD_COST (500)
+
+struct untracked_preload {
+	struct untracked_cache_dir **dirs;
+	size_t *path_offsets;
+	size_t nr, alloc;
+	struct strbuf paths;
+};
+
+struct untracked_preload_thread {
+	pthread_t pthread;
+	const struct index_state *istate;
+	const struct untracked_preload *preload;
+	size_t offset, nr;
+};
+
+static void collect_untracked_dirs(struct untracked_preload *preload,
+				   struct untracked_cache_dir *ucd,
+				   struct strbuf *path)
+{
+	size_t len = path->len;
+
+	if (!ucd->valid)
+		return;
+
+	ALLOC_GROW(preload->dirs, preload->nr + 1, preload->alloc);
+	REALLOC_ARRAY(preload->path_offsets, preload->alloc);
+	preload->dirs[preload->nr] = ucd;
+	preload->path_offsets[preload->nr++] = preload->paths.len;
+	strbuf_add(&preload->paths, path->len ? path->buf : ".",
+		   path->len ? path->len : 1);
+	strbuf_addch(&preload->paths, '\0');
+
+	for (size_t i = 0; i < ucd->dirs_nr; i++) {
+		strbuf_addf(path, "%s/", ucd->dirs[i]->name);
+		collect_untracked_dirs(preload, ucd->dirs[i], path);
+		strbuf_setlen(path, len);
+	}
+}
+
+static struct untracked_cache_dir *find_untracked_subdir(struct untracked_cache_dir *ucd,
+							 const char *name,
+							 size_t len)
+{
+	for (size_t i = 0; i < ucd->dirs_nr; i++)
+		if (!strncmp(ucd->dirs[i]->name, name, len) &&
+		    !ucd->dirs[i]->name[len])
+			return ucd->dirs[i];
+	return NULL;
+}
+
+static void *preload_untracked_thread(void *_data)
+{
+	struct untracked_preload_thread *p = _data;
+	const struct untracked_preload *preload = p->preload;
+
+	for (size_t i = p->offset; i < p->offset + p->nr; i++) {
+		struct untracked_cache_dir *ucd = preload->dirs[i];
+		const char *path = preload->paths.buf + preload->path_offsets[i];
+		struct stat st;
+
+		if (lstat(path, &st) ||
+		    match_stat_data_racy(p->istate, &ucd->stat_data, &st))
+			continue;
+		ucd->stat_ok = 1;
+	}
+	return NULL;
+}
+
+static void preload_untracked_cache(struct untracked_preload *preload,
+				    struct dir_struct *dir,
+				    struct index_state *istate,
+				    struct untracked_cache_dir *root,
+				    const char *base, int baselen)
+{
+	struct untracked_preload_thread data[PRELOAD_MAX_PARALLEL];
+	struct strbuf path = STRBUF_INIT;
+	struct untracked_cache_dir *ucd = root;
+	const char *p = base, *end = base + baselen;
+	int core_preload_index = 1;
+	size_t threads, work, offset = 0;
+
+	if (!HAVE_THREADS || !root || dir->untracked->use_fsmonitor)
+		return;
+	repo_config_get_bool(istate->repo, "core.preloadindex", &core_preload_index);
+	if (!core_preload_index)
+		return;
+
+	/*
+	 * The walk starts at "base" (the common prefix of the pathspec),
+	 * so only the directories below it are worth checking.
+	 */
+	while (p < end) {
+		const char *slash = memchr(p, '/', end - p);
+		size_t n = slash ? slash - p : end - p;
+
+		ucd = find_untracked_subdir(ucd, p, n);
+		if (!ucd)
+			return;
+		p += n + 1;
+	}
+	strbuf_add(&path, base, baselen);
+	collect_untracked_dirs(preload, ucd, &path);
+	strbuf_release(&path);
+
+	threads = preload->nr / PRELOAD_THREAD_COST;
+	if (preload->nr > 1 && threads < 2 &&
+	    git_env_bool("GIT_TEST_PRELOAD_INDEX", 0))
+		threads = 2;
+	if (threads < 2)
+		return;
+	if (threads > PRELOAD_MAX_PARALLEL)
+		threads = PRELOAD_MAX_PARALLEL;
+
+	trace2_region_enter("dir", "preload-untracked", istate->repo);
+	work = DIV_ROUND_UP(preload->nr, threads);
+	for (size_t i = 0; i < threads; i++) {
+		struct untracked_preload_thread *p = &data[i];
+		int err;
+
+		p->istate = istate;
+		p->preload = preload;
+		p->offset = offset;
+		p->nr = offset + work > preload->nr ? preload->nr - offset : work;
+		offset += p->nr;
+		err = pthread_create(&p->pthread, NULL, preload_untracked_thread, p);
+		if (err)
+			die(_("unable to create threaded lstat: %s"), strerror(err));
+	}
+	for (size_t i = 0; i < threads; i++)
+		if (pthread_join(data[i].pthread, NULL))
+			die("unable to join threaded lstat");
+	trace2_data_intmax("dir", istate->repo, "preload-untracked/dirs",
+			   preload->nr);
+	trace2_region_leave("dir", "preload-untracked", istate->repo);
+}
+
+static void release_untracked_preload(struct untracked_preload *preload)
+{
+	/* directories we did not visit must not be trusted next time */
+	for (size_t i = 0; i < preload->nr; i++)
+		preload->dirs[i]->stat_ok = 0;
+	free(preload->dirs);
+	free(preload->path_offsets);
+	strbuf_release(&preload->paths);
+}
+
 int read_directory(struct dir_struct *dir, struct index_state *istate,
 		   const char *path, int len, const struct pathspec *pathspec)
 {
 	struct untracked_cache_dir *untracked;
+	struct untracked_preload preload = { .paths = STRBUF_INIT };
 
 	trace2_region_enter("dir", "read_directory", istate->repo);
 	dir->internal.visited_paths = 0;
@@ -3201,8 +3664,12 @@ int read_directory(struct dir_struct *dir, struct index_state *istate,
 		 * e.g. prep_exclude()
 		 */
 		dir->untracked = NULL;
+	else
+		preload_untracked_cache(&preload, dir, istate, untracked,
+					path, len);
 	if (!len || treat_leading_path(dir, istate, path, len, pathspec))
 		read_directory_recursive(dir, istate, path, len, untracked, 0, 0, pathspec);
+	release_untracked_preload(&preload);
 	QSORT(dir->entries, dir->nr, cmp_dir_entry);
 	QSORT(dir->ignored, dir->ignored_nr, cmp_dir_entry);
 
@@ -3532,6 +3999,63 @@ int remove_dir_recursively(struct strbuf *path, int flag)
 	return remove_dir_recurse(path, flag, NULL);
 }
 
+struct file_age {
+	time_t mtime;
+	char *name;
+};
+
+static int compare_file_age(const void *a_, const void *b_)
+{
+	const struct file_age *a = a_, *b = b_;
+
+	if (a->mtime != b->mtime)
+		return a->mtime < b->mtime ? -1 : 1;
+	return strcmp(a->name, b->name);
+}
+
+void remove_oldest_files(const char *path, size_t keep)
+{
+	struct file_age *files = NULL;
+	size_t nr = 0, alloc = 0, i;
+	struct strbuf sb = STRBUF_INIT;
+	struct dirent *de;
+	DIR *d;
+
+	d = opendir(path);
+	if (!d)
+		return;
+
+	while ((de = readdir_skip_dot_and_dotdot(d))) {
+		struct stat st;
+
+		if (ends_with(de->d_name, LOCK_SUFFIX))
+			continue;
+		strbuf_reset(&sb);
+		strbuf_addf(&sb, "%s/%s", path, de->d_name);
+		if (lstat(sb.buf, &st) < 0 || !S_ISREG(st.st_mode))
+			continue;
+		ALLOC_GROW(files, nr + 1, alloc);
+		files[nr].mtime = st.st_mtime;
+		files[nr].name = xstrdup(de->d_name);
+		nr++;
+	}
+	closedir(d);
+
+	if (nr > keep) {
+		QSORT(files, nr, compare_file_age);
+		for (i = 0; i < nr - keep; i++) {
+			strbuf_reset(&sb);
+			strbuf_addf(&sb, "%s/%s", path, files[i].name);
+			unlink(sb.buf);
+		}
+	}
+
+	for (i = 0; i < nr; i++)
+		free(files[i].name);
+	free(files);
+	strbuf_release(&sb);
+}
+
 static GIT_PATH_FUNC(git_path_info_exclude, "info/exclude")
 
 void setup_standard_excludes(struct dir_struct *dir)
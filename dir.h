@@ -118,6 +118,12 @@ struct pattern_list {
 	 * Used to check single-level parents of blobs.
 	 */
 	struct hashmap parent_hashmap;
+
+	/*
+	 * Lookup tables for the patterns without wildcards, built on
+	 * demand for long lists in dir.c.
+	 */
+	struct pattern_index *index;
 };
 
 /*
@@ -182,6 +188,8 @@ struct untracked_cache_dir {
 	/* all data except 'dirs' in this struct are good */
 	unsigned int valid : 1;
 	unsigned int recurse : 1;
+	/* stat_data was found to match the directory in read_directory() */
+	unsigned int stat_ok : 1;
 	/* null object ID means this directory does not have .gitignore */
 	struct object_id exclude_oid;
 	char name[FLEX_ARRAY];
@@ -442,6 +450,52 @@ int match_pathname(const char *, int,
 		   const char *, int,
 		   const char *, int, int);
 
+/*
+ * Lookup tables for long pattern lists, used by dir.c and attr.c. The
+ * patterns without wildcards are put into hash tables keyed by the
+ * basename, the suffix ("*.o") or the full path they match, so that
+ * only the remaining ones in "other" have to be matched one by one.
+ * Patterns are identified by their position in the caller's list.
+ */
+struct pattern_index {
+	/* number of patterns added */
+	int nr;
+	struct hashmap basenames;
+	struct hashmap suffixes;
+	struct hashmap paths;
+	/* distinct lengths of the keys in "suffixes", in increasing order */
+	size_t *suffix_len;
+	size_t suffix_len_nr, suffix_len_alloc;
+	/* positions of the patterns to match one by one, in increasing order */
+	int *other;
+	size_t other_nr, other_alloc;
+};
+
+void pattern_index_init(struct pattern_index *index);
+void pattern_index_clear(struct pattern_index *index);
+
+/*
+ * Add the pattern at position "pos", which must come after the positions
+ * of the patterns added before. The arguments are those of a "struct
+ * path_pattern"; "base" is the directory the pattern applies to and
+ * ends with a slash unless it is empty.
+ */
+void pattern_index_add(struct pattern_index *index, int pos,
+		       const char *pattern, int patternlen,
+		       int nowildcardlen, unsigned flags,
+		       const char *base, size_t baselen);
+
+/*
+ * Call "fn" with the position of each pattern in the hash tables that
+ * matches "path" (without a trailing slash), in no particular order.
+ * PATTERN_FLAG_MUSTBEDIR is not checked; that is left to "fn".
+ */
+typedef void (*pattern_index_match_fn)(int pos, void *data);
+void pattern_index_for_each_match(struct pattern_index *index,
+				  const char *path, size_t pathlen,
+				  size_t basename_offset,
+				  pattern_index_match_fn fn, void *data);
+
 struct path_pattern *last_matching_pattern(struct dir_struct *dir,
 					   struct index_state *istate,
 					   const char *name, int *dtype);
@@ -536,6 +590,14 @@ int get_sparse_checkout_patterns(struct pattern_list *pl);
  */
 int remove_dir_recursively(struct strbuf *path, int flag);
 
+/*
+ * Remove the regular files in the directory "path" with the oldest
+ * modification times, so that at most "keep" of them are left. Lock
+ * files of lockfile.h are neither counted nor removed. Meant for
+ * directories of cache files that must not grow without bound.
+ */
+void remove_oldest_files(const char *path, size_t keep);
+
 /*
  * This function pointer type is called on each file discovered in
  * for_each_file_in_dir. The iteration stops if this method returns
@@ -12,6 +12,7 @@
 #include "pkt-line.h"
 #include "config.h"
 #include "string-list.h"
+#include "ref-advert-cache.h"
 
 static enum {
 	UNBORN_IGNORE = 0,
@@ -72,6 +73,7 @@ struct ls_refs_data {
 	struct strvec prefixes;
 	struct strbuf buf;
 	struct strvec hidden_refs;
+	struct ref_advert_cache *cache;
 	unsigned unborn : 1;
 };
 
@@ -116,6 +118,8 @@ static int send_ref(const struct reference *ref, void *cb_data)
 
 	strbuf_addch(&data->buf, '\n');
 	packet_fwrite(stdout, data->buf.buf, data->buf.len);
+	if (data->cache)
+		ref_advert_cache_add(data->cache, data->buf.buf, data->buf.len);
 
 	return 0;
 }
@@ -158,9 +162,24 @@ static int ls_refs_config(const char *var, const char *value,
 	return parse_hide_refs_config(var, value, "uploadpack", &data->hidden_refs);
 }
 
+/*
+ * Describe everything that influences the lines sent by `send_ref()` for
+ * refs found while iterating, so that it can serve as a cache key.
+ */
+static void ls_refs_cache_key(struct ls_refs_data *data, struct strbuf *key)
+{
+	strbuf_addf(key, "ls-refs\npeel=%u\nsymrefs=%u\nnamespace=%s\n",
+		    data->peel, data->symrefs, get_git_namespace());
+	for (size_t i = 0; i < data->prefixes.nr; i++)
+		strbuf_addf(key, "prefix=%s\n", data->prefixes.v[i]);
+	for (size_t i = 0; i < data->hidden_refs.nr; i++)
+		strbuf_addf(key, "hide=%s\n", data->hidden_refs.v[i]);
+}
+
 int ls_refs(struct repository *r, struct packet_reader *request)
 {
 	struct refs_for_each_ref_options opts = { 0 };
+	struct ref_advert_cache cache = REF_ADVERT_CACHE_INIT;
 	struct ls_refs_data data;
 
 	memset(&data, 0, sizeof(data));
@@ -203,12 +222,28 @@ int ls_refs(struct repository *r, struct packet_reader *request)
 	if (!data.prefixes.nr)
 		strvec_push(&data.prefixes, "");
 
+	if (ref_advert_cache_enabled(r)) {
+		struct strbuf key = STRBUF_INIT;
+
+		ls_refs_cache_key(&data, &key);
+		ref_advert_cache_init(&cache, r, key.buf);
+		strbuf_release(&key);
+
+		if (ref_advert_cache_replay(&cache, stdout))
+			goto done;
+		data.cache = &cache;
+	}
+
 	opts.exclude_patterns = hidden_refs_to_excludes(&data.hidden_refs);
 	opts.namespace = get_git_namespace();
 
 	refs_for_each_ref_in_prefixes(get_main_ref_store(r), data.prefixes.v,
 				      &opts, send_ref, &data);
+	ref_advert_cache_store(&cache);
+
+done:
 	packet_fflush(stdout);
+	ref_advert_cache_release(&cache);
 	strvec_clear(&data.prefixes);
 	strbuf_release(&data.buf);
 	strvec_clear(&data.hidden_refs);
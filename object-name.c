@@ -1641,6 +1641,46 @@ static void diagnose_invalid_oid_path(struct repository *r,
 	}
 }
 
+/*
+ * Look up ":<stage>:<path>" in a mapped index, if the index file allows
+ * it, to avoid reading the whole index for a single path. Return -1 when
+ * the path is not found, leaving it to the caller to read the index and
+ * diagnose the failure.
+ */
+static int get_oid_from_mapped_index(struct repository *repo,
+				     const char *path, int namelen, int stage,
+				     struct object_id *oid,
+				     struct object_context *oc)
+{
+	struct mapped_index *mi;
+	unsigned int nr;
+	int pos, ret = -1;
+
+	mi = mapped_index_open(repo, repo_get_index_file(repo));
+	if (!mi)
+		return -1;
+
+	nr = mapped_index_nr(mi);
+	pos = mapped_index_name_pos(mi, path, namelen);
+	if (pos < 0)
+		pos = -pos - 1;
+	for (; pos < nr; pos++) {
+		const struct cache_entry *ce = mapped_index_entry(mi, pos);
+
+		if (ce_namelen(ce) != namelen || memcmp(ce->name, path, namelen))
+			break;
+		if (ce_stage(ce) == stage) {
+			oidcpy(oid, &ce->oid);
+			oc->mode = ce->ce_mode;
+			ret = 0;
+			break;
+		}
+	}
+
+	mapped_index_close(mi);
+	return ret;
+}
+
 /* Must be called only when :stage:filename doesn't exist. */
 static void diagnose_invalid_index_path(struct repository *r,
 					int stage,
@@ -1792,8 +1832,14 @@ static enum get_oid_result get_oid_with_context_1(struct repository *repo,
 		if (flags & GET_OID_RECORD_PATH)
 			oc->path = xstrdup(cp);
 
-		if (!repo->index || !repo->index->cache)
+		if (!repo->index || !repo->index->cache) {
+			if (!get_oid_from_mapped_index(repo, cp, namelen, stage,
+						       oid, oc)) {
+				free(new_path);
+				return 0;
+			}
 			repo_read_index(repo);
+		}
 		pos = index_name_pos(repo->index, cp, namelen);
 		if (pos < 0)
 			pos = -pos - 1;
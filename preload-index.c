@@ -5,6 +5,7 @@
 #define DISABLE_SIGN_COMPARE_WARNINGS
 
 #include "git-compat-util.h"
+#include "compat/batch-lstat.h"
 #include "pathspec.h"
 #include "dir.h"
 #include "environment.h"
@@ -44,8 +45,74 @@ struct thread_data {
 	struct progress_data *progress;
 	int offset, nr;
 	int t2_nr_lstat;
+	int t2_nr_batched;
 };
 
+/*
+ * Entries whose lstat() we have queued up but not looked at yet. When
+ * the platform can submit many lstat() calls at once we collect up to
+ * one batch worth of them before asking the kernel.
+ */
+struct preload_batch {
+	struct batch_lstat *ctx;
+	unsigned int nr, alloc;
+	struct cache_entry **ce;
+	const char **path;
+	struct stat *st;
+	int *err;
+};
+
+static void preload_batch_init(struct preload_batch *b)
+{
+	memset(b, 0, sizeof(*b));
+	b->ctx = batch_lstat_init();
+	b->alloc = b->ctx ? batch_lstat_size(b->ctx) : 1;
+	ALLOC_ARRAY(b->ce, b->alloc);
+	ALLOC_ARRAY(b->path, b->alloc);
+	ALLOC_ARRAY(b->st, b->alloc);
+	ALLOC_ARRAY(b->err, b->alloc);
+}
+
+static void preload_batch_release(struct preload_batch *b)
+{
+	batch_lstat_release(b->ctx);
+	free(b->ce);
+	free(b->path);
+	free(b->st);
+	free(b->err);
+}
+
+static void preload_batch_flush(struct thread_data *p, struct preload_batch *b)
+{
+	struct index_state *index = p->index;
+	unsigned int i;
+
+	if (!b->nr)
+		return;
+
+	if (b->ctx && !batch_lstat(b->ctx, b->path, b->st, b->err, b->nr)) {
+		p->t2_nr_batched += b->nr;
+	} else {
+		/* fall back to lstat() for the rest of this thread's work */
+		batch_lstat_release(b->ctx);
+		b->ctx = NULL;
+		for (i = 0; i < b->nr; i++)
+			b->err[i] = lstat(b->path[i], &b->st[i]) ? errno : 0;
+	}
+
+	for (i = 0; i < b->nr; i++) {
+		struct cache_entry *ce = b->ce[i];
+
+		if (b->err[i])
+			continue;
+		if (ie_match_stat(index, ce, &b->st[i], CE_MATCH_RACY_IS_DIRTY|CE_MATCH_IGNORE_FSMONITOR))
+			continue;
+		ce_mark_uptodate(ce);
+		mark_fsmonitor_valid(index, ce);
+	}
+	b->nr = 0;
+}
+
 static void *preload_thread(void *_data)
 {
 	int nr, last_nr;
@@ -53,6 +120,7 @@ static void *preload_thread(void *_data)
 	struct index_state *index = p->index;
 	struct cache_entry **cep = index->cache + p->offset;
 	struct cache_def cache = CACHE_DEF_INIT;
+	struct preload_batch batch;
 
 	nr = p->nr;
 	if (nr + p->offset > index->cache_nr)
@@ -60,9 +128,9 @@ static void *preload_thread(void *_data)
 	last_nr = nr;
 
 	enable_fscache(nr);
+	preload_batch_init(&batch);
 	do {
 		struct cache_entry *ce = *cep++;
-		struct stat st;
 
 		if (ce_stage(ce))
 			continue;
@@ -88,13 +156,13 @@ static void *preload_thread(void *_data)
 		if (threaded_has_symlink_leading_path(&cache, ce->name, ce_namelen(ce)))
 			continue;
 		p->t2_nr_lstat++;
-		if (lstat(ce->name, &st))
-			continue;
-		if (ie_match_stat(index, ce, &st, CE_MATCH_RACY_IS_DIRTY|CE_MATCH_IGNORE_FSMONITOR))
-			continue;
-		ce_mark_uptodate(ce);
-		mark_fsmonitor_valid(index, ce);
+		batch.ce[batch.nr] = ce;
+		batch.path[batch.nr] = ce->name;
+		if (++batch.nr == batch.alloc)
+			preload_batch_flush(p, &batch);
 	} while (--nr > 0);
+	preload_batch_flush(p, &batch);
+	preload_batch_release(&batch);
 	if (p->progress) {
 		struct progress_data *pd = p->progress;
 
@@ -115,6 +183,7 @@ void preload_index(struct index_state *index,
 	struct thread_data data[MAX_PARALLEL];
 	struct progress_data pd;
 	int t2_sum_lstat = 0;
+	int t2_sum_batched = 0;
 	int core_preload_index = 1;
 
 	repo_config_get_bool(index->repo, "core.preloadindex", &core_preload_index);
@@ -168,6 +237,7 @@ void preload_index(struct index_state *index,
 		if (pthread_join(p->pthread, NULL))
 			die("unable to join threaded lstat");
 		t2_sum_lstat += p->t2_nr_lstat;
+		t2_sum_batched += p->t2_nr_batched;
 	}
 	stop_progress(&pd.progress);
 
@@ -180,6 +250,7 @@ void preload_index(struct index_state *index,
 	trace_performance_leave("preload index");
 
 	trace2_data_intmax("index", NULL, "preload/sum_lstat", t2_sum_lstat);
+	trace2_data_intmax("index", NULL, "preload/sum_batched", t2_sum_batched);
 	trace2_region_leave("index", "preload", NULL);
 }
 
@@ -281,6 +281,33 @@ int read_index_from(struct index_state *, const char *path,
 		    const char *gitdir);
 int is_index_unborn(struct index_state *);
 
+/*
+ * A read-only view of an index file that leaves the entries in the
+ * memory-mapped file and decodes them one at a time on access, instead
+ * of materializing a cache_entry for each of them.
+ *
+ * This only works for index files that were written with an "Index Entry
+ * Lookup Table" (see `index.recordLookupTable`) and that are neither a
+ * split nor a sparse index. mapped_index_open() returns NULL for all
+ * other index files, in which case the caller should read the index as
+ * usual. No extensions are loaded and no stat data is refreshed.
+ */
+struct mapped_index;
+
+struct mapped_index *mapped_index_open(struct repository *r, const char *path);
+void mapped_index_close(struct mapped_index *mi);
+unsigned int mapped_index_nr(const struct mapped_index *mi);
+
+/* Like index_name_pos(), but searching the entries of a mapped index. */
+int mapped_index_name_pos(struct mapped_index *mi, const char *name, int namelen);
+
+/*
+ * Decode the entry at "pos". The returned entry is only valid until the
+ * next call, and must neither be freed nor added to an index.
+ */
+const struct cache_entry *mapped_index_entry(struct mapped_index *mi,
+					     unsigned int pos);
+
 /* For use with `write_locked_index()`. */
 #define COMMIT_LOCK		(1 << 0)
 #define SKIP_IF_UNCHANGED	(1 << 1)
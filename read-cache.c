@@ -73,6 +73,7 @@
 #define CACHE_EXT_FSMONITOR 0x46534D4E	  /* "FSMN" */
 #define CACHE_EXT_ENDOFINDEXENTRIES 0x454F4945	/* "EOIE" */
 #define CACHE_EXT_INDEXENTRYOFFSETTABLE 0x49454F54 /* "IEOT" */
+#define CACHE_EXT_INDEXENTRYLOOKUPTABLE 0x49454C54 /* "IELT" */
 #define CACHE_EXT_SPARSE_DIRECTORIES 0x73646972 /* "sdir" */
 
 /* changes that can be kept in $GIT_DIR/index (basically all extensions) */
@@ -550,14 +551,15 @@ static int index_name_stage_pos(struct index_state *istate,
 		/*
 		 * If we are in a sparse-index _and_ the entry before the
 		 * insertion position is a sparse-directory entry that is
-		 * an ancestor of 'name', then we need to expand the index
-		 * and search again. This will only trigger once, because
-		 * thereafter the index is fully expanded.
+		 * an ancestor of 'name', then we need to expand that
+		 * directory and search again. This descends one level of
+		 * sparse directories at a time, and only along 'name'.
 		 */
 		if (S_ISSPARSEDIR(ce->ce_mode) &&
 		    ce_namelen(ce) < namelen &&
 		    !strncmp(name, ce->name, ce_namelen(ce))) {
-			ensure_full_index(istate);
+			if (expand_sparse_directory(istate, first - 1))
+				ensure_full_index(istate);
 			return index_name_stage_pos(istate, name, namelen, stage, search_mode);
 		}
 	}
@@ -1755,6 +1757,9 @@ static int read_index_extension(struct index_state *istate,
 	case CACHE_EXT_INDEXENTRYOFFSETTABLE:
 		/* already handled in do_read_index() */
 		break;
+	case CACHE_EXT_INDEXENTRYLOOKUPTABLE:
+		/* only used by mapped_index_open() */
+		break;
 	case CACHE_EXT_SPARSE_DIRECTORIES:
 		/* no content, only an indicator */
 		istate->sparse_index = INDEX_COLLAPSED;
@@ -1769,6 +1774,38 @@ static int read_index_extension(struct index_state *istate,
 	return 0;
 }
 
+/*
+ * Parses the stat data, mode and object name of the on-disk cache entry in
+ * the 'ondisk' buffer into 'ce'.
+ */
+static void read_ondisk_stat_data(struct cache_entry *ce, const char *ondisk)
+{
+	/*
+	 * NEEDSWORK: using 'offsetof()' is cumbersome and should be replaced
+	 * with something more akin to 'load_bitmap_entries_v1()'s use of
+	 * 'read_be16'/'read_be32'. For consistency with the corresponding
+	 * ondisk entry write function ('copy_cache_entry_to_ondisk()'), this
+	 * should be done at the same time as removing references to
+	 * 'ondisk_cache_entry' there.
+	 */
+	ce->ce_stat_data.sd_ctime.sec = get_be32(ondisk + offsetof(struct ondisk_cache_entry, ctime)
+							+ offsetof(struct cache_time, sec));
+	ce->ce_stat_data.sd_mtime.sec = get_be32(ondisk + offsetof(struct ondisk_cache_entry, mtime)
+							+ offsetof(struct cache_time, sec));
+	ce->ce_stat_data.sd_ctime.nsec = get_be32(ondisk + offsetof(struct ondisk_cache_entry, ctime)
+							 + offsetof(struct cache_time, nsec));
+	ce->ce_stat_data.sd_mtime.nsec = get_be32(ondisk + offsetof(struct ondisk_cache_entry, mtime)
+							 + offsetof(struct cache_time, nsec));
+	ce->ce_stat_data.sd_dev   = get_be32(ondisk + offsetof(struct ondisk_cache_entry, dev));
+	ce->ce_stat_data.sd_ino   = get_be32(ondisk + offsetof(struct ondisk_cache_entry, ino));
+	ce->ce_mode  = get_be32(ondisk + offsetof(struct ondisk_cache_entry, mode));
+	ce->ce_stat_data.sd_uid   = get_be32(ondisk + offsetof(struct ondisk_cache_entry, uid));
+	ce->ce_stat_data.sd_gid   = get_be32(ondisk + offsetof(struct ondisk_cache_entry, gid));
+	ce->ce_stat_data.sd_size  = get_be32(ondisk + offsetof(struct ondisk_cache_entry, size));
+	oidread(&ce->oid, (const unsigned char *)ondisk + offsetof(struct ondisk_cache_entry, data),
+		the_repository->hash_algo);
+}
+
 /*
  * Parses the contents of the cache entry contained within the 'ondisk' buffer
  * into a new incore 'cache_entry'.
@@ -1841,34 +1878,10 @@ static struct cache_entry *create_from_disk(struct mem_pool *ce_mem_pool,
 	}
 
 	ce = mem_pool__ce_alloc(ce_mem_pool, len);
-
-	/*
-	 * NEEDSWORK: using 'offsetof()' is cumbersome and should be replaced
-	 * with something more akin to 'load_bitmap_entries_v1()'s use of
-	 * 'read_be16'/'read_be32'. For consistency with the corresponding
-	 * ondisk entry write function ('copy_cache_entry_to_ondisk()'), this
-	 * should be done at the same time as removing references to
-	 * 'ondisk_cache_entry' there.
-	 */
-	ce->ce_stat_data.sd_ctime.sec = get_be32(ondisk + offsetof(struct ondisk_cache_entry, ctime)
-							+ offsetof(struct cache_time, sec));
-	ce->ce_stat_data.sd_mtime.sec = get_be32(ondisk + offsetof(struct ondisk_cache_entry, mtime)
-							+ offsetof(struct cache_time, sec));
-	ce->ce_stat_data.sd_ctime.nsec = get_be32(ondisk + offsetof(struct ondisk_cache_entry, ctime)
-							 + offsetof(struct cache_time, nsec));
-	ce->ce_stat_data.sd_mtime.nsec = get_be32(ondisk + offsetof(struct ondisk_cache_entry, mtime)
-							 + offsetof(struct cache_time, nsec));
-	ce->ce_stat_data.sd_dev   = get_be32(ondisk + offsetof(struct ondisk_cache_entry, dev));
-	ce->ce_stat_data.sd_ino   = get_be32(ondisk + offsetof(struct ondisk_cache_entry, ino));
-	ce->ce_mode  = get_be32(ondisk + offsetof(struct ondisk_cache_entry, mode));
-	ce->ce_stat_data.sd_uid   = get_be32(ondisk + offsetof(struct ondisk_cache_entry, uid));
-	ce->ce_stat_data.sd_gid   = get_be32(ondisk + offsetof(struct ondisk_cache_entry, gid));
-	ce->ce_stat_data.sd_size  = get_be32(ondisk + offsetof(struct ondisk_cache_entry, size));
+	read_ondisk_stat_data(ce, ondisk);
 	ce->ce_flags = flags & ~CE_NAMEMASK;
 	ce->ce_namelen = len;
 	ce->index = 0;
-	oidread(&ce->oid, (const unsigned char *)ondisk + offsetof(struct ondisk_cache_entry, data),
-		the_repository->hash_algo);
 
 	if (expand_name_field) {
 		if (copy_len)
@@ -1989,6 +2002,8 @@ static void write_ieot_extension(struct strbuf *sb, struct index_entry_offset_ta
 static size_t read_eoie_extension(const char *mmap, size_t mmap_size);
 static void write_eoie_extension(struct strbuf *sb, struct git_hash_ctx *eoie_context, size_t offset);
 
+static void write_ielt_extension(struct strbuf *sb, const uint32_t *ielt, size_t nr);
+
 struct load_index_extensions
 {
 	pthread_t pthread;
@@ -2335,6 +2350,201 @@ int do_read_index(struct index_state *istate, const char *path, int must_exist)
 	die(_("index file corrupt"));
 }
 
+#define IELT_VERSION	(1)
+
+struct mapped_index {
+	const char *mmap;
+	size_t mmap_size;
+	size_t entries_end;
+	unsigned int nr;
+	const char *lookup_table;
+	struct cache_entry *ce;
+	size_t ce_alloc;
+};
+
+/*
+ * Find the "Index Entry Lookup Table" among the extensions starting at
+ * "offset". Give up on indexes with extensions we must understand to make
+ * sense of the entries, e.g. those of a split or a sparse index.
+ */
+static const char *find_ielt_extension(const char *mmap, size_t mmap_size,
+				       size_t offset, unsigned int nr)
+{
+	const char *table = NULL;
+
+	while (offset <= mmap_size - the_hash_algo->rawsz - 8) {
+		const char *ext = mmap + offset;
+		uint32_t extsize = get_be32(ext + 4);
+
+		if (*ext < 'A' || 'Z' < *ext)
+			return NULL;
+		if (CACHE_EXT(ext) == CACHE_EXT_INDEXENTRYLOOKUPTABLE) {
+			if (extsize != st_mult(st_add(nr, 1), sizeof(uint32_t)) ||
+			    get_be32(ext + 8) != IELT_VERSION)
+				return NULL;
+			table = ext + 8 + sizeof(uint32_t);
+		}
+		offset += 8;
+		offset += extsize;
+	}
+	return table;
+}
+
+struct mapped_index *mapped_index_open(struct repository *r, const char *path)
+{
+	int fd;
+	struct stat st;
+	const struct cache_header *hdr;
+	const char *mmap, *table = NULL;
+	size_t mmap_size, extension_offset = 0;
+	unsigned int version;
+	struct mapped_index *mi;
+
+	fd = open(path, O_RDONLY);
+	if (fd < 0)
+		return NULL;
+	if (fstat(fd, &st) ||
+	    xsize_t(st.st_size) < sizeof(struct cache_header) + the_hash_algo->rawsz) {
+		close(fd);
+		return NULL;
+	}
+	mmap_size = xsize_t(st.st_size);
+	mmap = xmmap_gently(NULL, mmap_size, PROT_READ, MAP_PRIVATE, fd, 0);
+	close(fd);
+	if (mmap == MAP_FAILED)
+		return NULL;
+
+	/*
+	 * Entries of version 4 are prefix-compressed and cannot be decoded
+	 * on their own, so Git does not write the lookup table for them.
+	 */
+	hdr = (const struct cache_header *)mmap;
+	version = ntohl(hdr->hdr_version);
+	if (hdr->hdr_signature == htonl(CACHE_SIGNATURE) &&
+	    (version == 2 || version == 3))
+		extension_offset = read_eoie_extension(mmap, mmap_size);
+	if (extension_offset)
+		table = find_ielt_extension(mmap, mmap_size, extension_offset,
+					    ntohl(hdr->hdr_entries));
+	if (!table) {
+		munmap((void *)mmap, mmap_size);
+		return NULL;
+	}
+
+	CALLOC_ARRAY(mi, 1);
+	mi->mmap = mmap;
+	mi->mmap_size = mmap_size;
+	mi->entries_end = extension_offset;
+	mi->nr = ntohl(hdr->hdr_entries);
+	mi->lookup_table = table;
+
+	trace2_data_intmax("index", r, "mapped/cache_nr", mi->nr);
+	return mi;
+}
+
+void mapped_index_close(struct mapped_index *mi)
+{
+	if (!mi)
+		return;
+	munmap((void *)mi->mmap, mi->mmap_size);
+	free(mi->ce);
+	free(mi);
+}
+
+unsigned int mapped_index_nr(const struct mapped_index *mi)
+{
+	return mi->nr;
+}
+
+/*
+ * Locate the on-disk entry at "pos" and parse its flags and name, without
+ * decoding the rest of it.
+ */
+static const char *mapped_index_ondisk(struct mapped_index *mi, unsigned int pos,
+				       unsigned int *flags, const char **name,
+				       size_t *len)
+{
+	const unsigned hashsz = the_hash_algo->rawsz;
+	size_t offset = get_be32(mi->lookup_table + st_mult(pos, sizeof(uint32_t)));
+	const char *ondisk, *flagsp;
+
+	if (offset < sizeof(struct cache_header) ||
+	    offset + ondisk_cache_entry_size(ondisk_data_size(0, 0)) > mi->entries_end)
+		die(_("index file corrupt"));
+	ondisk = mi->mmap + offset;
+	flagsp = ondisk + offsetof(struct ondisk_cache_entry, data) + hashsz;
+
+	*flags = get_be16(flagsp);
+	if (*flags & CE_EXTENDED) {
+		unsigned int extended_flags = get_be16(flagsp + sizeof(uint16_t)) << 16;
+
+		if (extended_flags & ~CE_EXTENDED_FLAGS)
+			die(_("unknown index entry format 0x%08x"), extended_flags);
+		*flags |= extended_flags;
+		*name = flagsp + 2 * sizeof(uint16_t);
+	} else {
+		*name = flagsp + sizeof(uint16_t);
+	}
+
+	*len = *flags & CE_NAMEMASK;
+	if (*len == CE_NAMEMASK)
+		*len = strnlen(*name, mi->mmap + mi->entries_end - *name);
+	if (*name + *len >= mi->mmap + mi->entries_end)
+		die(_("index file corrupt"));
+	return ondisk;
+}
+
+int mapped_index_name_pos(struct mapped_index *mi, const char *name, int namelen)
+{
+	int first = 0, last = mi->nr;
+
+	while (last > first) {
+		int next = first + ((last - first) >> 1);
+		unsigned int flags;
+		const char *ce_name;
+		size_t len;
+		int cmp;
+
+		mapped_index_ondisk(mi, next, &flags, &ce_name, &len);
+		cmp = cache_name_stage_compare(name, namelen, 0, ce_name, len,
+					       (flags & CE_STAGEMASK) >> CE_STAGESHIFT);
+		if (!cmp)
+			return next;
+		if (cmp < 0) {
+			last = next;
+			continue;
+		}
+		first = next + 1;
+	}
+	return -first - 1;
+}
+
+const struct cache_entry *mapped_index_entry(struct mapped_index *mi,
+					     unsigned int pos)
+{
+	unsigned int flags;
+	const char *ondisk, *name;
+	size_t len;
+
+	if (pos >= mi->nr)
+		BUG("mapped index entry %u out of range", pos);
+
+	ondisk = mapped_index_ondisk(mi, pos, &flags, &name, &len);
+	if (cache_entry_size(len) > mi->ce_alloc) {
+		free(mi->ce);
+		mi->ce_alloc = cache_entry_size(len);
+		mi->ce = xmalloc(mi->ce_alloc);
+	}
+
+	memset(mi->ce, 0, offsetof(struct cache_entry, name));
+	read_ondisk_stat_data(mi->ce, ondisk);
+	mi->ce->ce_flags = flags & ~CE_NAMEMASK;
+	mi->ce->ce_namelen = len;
+	memcpy(mi->ce->name, name, len);
+	mi->ce->name[len] = '\0';
+	return mi->ce;
+}
+
 /*
  * Signal that the shared index is used by updating its mtime.
  *
@@ -2773,6 +2983,15 @@ static int record_eoie(void)
 	return !repo_config_get_index_threads(the_repository, &val) && val != 1;
 }
 
+static int record_ielt(void)
+{
+	int val;
+
+	if (!repo_config_get_bool(the_repository, "index.recordlookuptable", &val))
+		return val;
+	return 0;
+}
+
 static int record_ieot(void)
 {
 	int val;
@@ -2823,6 +3042,8 @@ static int do_write_index(struct index_state *istate, struct tempfile *tempfile,
 	int csum_fsync_flag;
 	int ieot_entries = 1;
 	struct index_entry_offset_table *ieot = NULL;
+	uint32_t *ielt = NULL;
+	size_t ielt_nr = 0;
 	struct repository *r = istate->repo;
 	struct strbuf sb = STRBUF_INIT;
 	int nr, nr_threads, ret;
@@ -2892,6 +3113,16 @@ static int do_write_index(struct index_state *istate, struct tempfile *tempfile,
 		}
 	}
 
+	/*
+	 * The lookup table cannot help with prefix-compressed entries, nor
+	 * with an index that only makes sense together with its shared index.
+	 */
+	if (hdr_version != 4 && !istate->sparse_index &&
+	    !(write_extensions & WRITE_SPLIT_INDEX_EXTENSION &&
+	      istate->split_index) &&
+	    record_ielt())
+		ALLOC_ARRAY(ielt, entries - removed);
+
 	offset = hashfile_total(f);
 
 	nr = 0;
@@ -2931,6 +3162,14 @@ static int do_write_index(struct index_state *istate, struct tempfile *tempfile,
 
 			offset = hashfile_total(f);
 		}
+		if (ielt) {
+			off_t entry_offset = hashfile_total(f);
+
+			if (entry_offset > UINT32_MAX)
+				FREE_AND_NULL(ielt);
+			else
+				ielt[ielt_nr++] = entry_offset;
+		}
 		if (ce_write_entry(f, ce, previous_name, (struct ondisk_cache_entry *)&ondisk) < 0)
 			err = -1;
 
@@ -2956,7 +3195,7 @@ static int do_write_index(struct index_state *istate, struct tempfile *tempfile,
 	 * The extension headers must be hashed on their own for the
 	 * EOIE extension. Create a hashfile here to compute that hash.
 	 */
-	if (offset && record_eoie()) {
+	if (offset && (record_eoie() || ielt)) {
 		CALLOC_ARRAY(eoie_c, 1);
 		the_hash_algo->init_fn(eoie_c);
 	}
@@ -2980,6 +3219,18 @@ static int do_write_index(struct index_state *istate, struct tempfile *tempfile,
 		}
 	}
 
+	if (ielt) {
+		strbuf_reset(&sb);
+
+		write_ielt_extension(&sb, ielt, ielt_nr);
+		err = write_index_ext_header(f, eoie_c, CACHE_EXT_INDEXENTRYLOOKUPTABLE, sb.len) < 0;
+		hashwrite(f, sb.buf, sb.len);
+		if (err) {
+			ret = -1;
+			goto out;
+		}
+	}
+
 	if (write_extensions & WRITE_SPLIT_INDEX_EXTENSION &&
 	    istate->split_index) {
 		strbuf_reset(&sb);
@@ -3104,6 +3355,7 @@ static int do_write_index(struct index_state *istate, struct tempfile *tempfile,
 	strbuf_release(&sb);
 	free(eoie_c);
 	free(ieot);
+	free(ielt);
 	return ret;
 }
 
@@ -3718,6 +3970,22 @@ static void write_ieot_extension(struct strbuf *sb, struct index_entry_offset_ta
 	}
 }
 
+static void write_ielt_extension(struct strbuf *sb, const uint32_t *ielt, size_t nr)
+{
+	uint32_t buffer;
+	size_t i;
+
+	/* version */
+	put_be32(&buffer, IELT_VERSION);
+	strbuf_add(sb, &buffer, sizeof(uint32_t));
+
+	/* offset of each entry */
+	for (i = 0; i < nr; i++) {
+		put_be32(&buffer, ielt[i]);
+		strbuf_add(sb, &buffer, sizeof(uint32_t));
+	}
+}
+
 void prefetch_cache_entries(const struct index_state *istate,
 			    must_prefetch_predicate must_prefetch)
 {
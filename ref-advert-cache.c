@@ -0,0 +1,177 @@
+#include "git-compat-util.h"
+#include "abspath.h"
+#include "config.h"
+#include "dir.h"
+#include "hash.h"
+#include "hex.h"
+#include "lockfile.h"
+#include "path.h"
+#include "pkt-line.h"
+#include "ref-advert-cache.h"
+#include "refs.h"
+#include "repository.h"
+
+/*
+ * Cache entries live in "$GIT_DIR/ref-advert-cache/<token>/<key>", where
+ * both components are hashed. Whenever a new token directory is created,
+ * directories for all other tokens are stale and get removed.
+ */
+#define REF_ADVERT_CACHE_DIR "ref-advert-cache"
+#define REF_ADVERT_CACHE_MAX_ENTRIES 64
+
+int ref_advert_cache_enabled(struct repository *r)
+{
+	int enabled;
+
+	if (repo_config_get_bool(r, "uploadpack.advertisementcache", &enabled))
+		return 0;
+	return enabled;
+}
+
+static void add_hashed(struct strbuf *out, const struct git_hash_algo *algo,
+		       const char *buf, size_t len)
+{
+	struct git_hash_ctx ctx;
+	unsigned char hash[GIT_MAX_RAWSZ];
+
+	algo->init_fn(&ctx);
+	git_hash_update(&ctx, buf, len);
+	git_hash_final(hash, &ctx);
+	strbuf_addstr(out, hash_to_hex_algop(hash, algo));
+}
+
+void ref_advert_cache_init(struct ref_advert_cache *cache,
+			   struct repository *r, const char *key)
+{
+	struct strbuf token = STRBUF_INIT;
+	char *dir;
+
+	cache->repo = r;
+	cache->recording = 0;
+	cache->max_entries = REF_ADVERT_CACHE_MAX_ENTRIES;
+	repo_config_get_int(r, "uploadpack.advertisementcacheentries",
+			    &cache->max_entries);
+	strbuf_reset(&cache->path);
+	strbuf_reset(&cache->lines);
+
+	if (cache->max_entries <= 0 ||
+	    refs_generation_token(get_main_ref_store(r), &token) < 0)
+		goto out;
+
+	dir = repo_git_path(r, REF_ADVERT_CACHE_DIR);
+	strbuf_addf(&cache->path, "%s/", dir);
+	add_hashed(&cache->path, r->hash_algo, token.buf, token.len);
+	strbuf_addch(&cache->path, '/');
+	add_hashed(&cache->path, r->hash_algo, key, strlen(key));
+	free(dir);
+
+out:
+	strbuf_release(&token);
+}
+
+int ref_advert_cache_replay(struct ref_advert_cache *cache, FILE *out)
+{
+	struct strbuf buf = STRBUF_INIT;
+	const char *p, *end;
+
+	if (!cache->path.len)
+		return 0;
+
+	if (strbuf_read_file(&buf, cache->path.buf, 0) < 0) {
+		cache->recording = 1;
+		strbuf_release(&buf);
+		return 0;
+	}
+
+	p = buf.buf;
+	end = buf.buf + buf.len;
+	while (p < end) {
+		const char *eol = memchr(p, '\n', end - p);
+
+		eol = eol ? eol + 1 : end;
+		packet_fwrite(out, p, eol - p);
+		p = eol;
+	}
+
+	strbuf_release(&buf);
+	return 1;
+}
+
+void ref_advert_cache_add(struct ref_advert_cache *cache,
+			  const char *line, size_t len)
+{
+	if (cache->recording)
+		strbuf_add(&cache->lines, line, len);
+}
+
+static void prune_stale_tokens(const char *dir, const char *current)
+{
+	struct strbuf path = STRBUF_INIT;
+	struct dirent *de;
+	DIR *d;
+
+	d = opendir(dir);
+	if (!d)
+		return;
+
+	while ((de = readdir_skip_dot_and_dotdot(d))) {
+		if (!strcmp(de->d_name, current))
+			continue;
+		strbuf_reset(&path);
+		strbuf_addf(&path, "%s/%s", dir, de->d_name);
+		remove_dir_recursively(&path, 0);
+	}
+
+	closedir(d);
+	strbuf_release(&path);
+}
+
+void ref_advert_cache_store(struct ref_advert_cache *cache)
+{
+	struct lock_file lock = LOCK_INIT;
+	char *token_dir, *slash;
+	int is_new;
+
+	if (!cache->recording)
+		return;
+	cache->recording = 0;
+
+	token_dir = xstrdup(cache->path.buf);
+	slash = strrchr(token_dir, '/');
+	*slash = '\0';
+	is_new = !is_directory(token_dir);
+
+	if (safe_create_leading_directories(cache->repo, cache->path.buf) != SCLD_OK)
+		goto out;
+	if (is_new) {
+		slash = strrchr(token_dir, '/');
+		*slash = '\0';
+		prune_stale_tokens(token_dir, slash + 1);
+	} else {
+		/* make room for the new entry */
+		remove_oldest_files(token_dir, cache->max_entries - 1);
+	}
+
+	/*
+	 * If somebody else is writing the same entry right now we simply
+	 * leave it to them.
+	 */
+	if (hold_lock_file_for_update(&lock, cache->path.buf, 0) < 0)
+		goto out;
+	if (write_in_full(get_lock_file_fd(&lock), cache->lines.buf,
+			  cache->lines.len) < 0) {
+		rollback_lock_file(&lock);
+		goto out;
+	}
+	commit_lock_file(&lock);
+
+out:
+	strbuf_reset(&cache->lines);
+	free(token_dir);
+}
+
+void ref_advert_cache_release(struct ref_advert_cache *cache)
+{
+	strbuf_release(&cache->path);
+	strbuf_release(&cache->lines);
+}
@@ -0,0 +1,89 @@
+#ifndef REF_ADVERT_CACHE_H
+#define REF_ADVERT_CACHE_H
+
+#include "strbuf.h"
+
+struct repository;
+
+/*
+ * A cache for serialized reference advertisements, as sent by upload-pack
+ * for protocol v0 and by the v2 "ls-refs" command.
+ *
+ * Cache entries are keyed on a description of the request (e.g. the ref
+ * prefixes and hidden refs) and on the generation token of the ref store
+ * (see `refs_generation_token()`). Any change to the references thus
+ * invalidates all entries, and serving an advertisement from the cache does
+ * not need to iterate through the references at all. As clients choose
+ * parts of the key, the number of entries per generation is capped by
+ * "uploadpack.advertisementCacheEntries"; the oldest ones are evicted.
+ *
+ * The cache only stores the lines produced by iterating the references.
+ * Anything that is cheap to compute or that differs between requests (HEAD,
+ * capabilities, session IDs) is left to the caller.
+ *
+ * Typical usage:
+ *
+ *	struct ref_advert_cache cache = REF_ADVERT_CACHE_INIT;
+ *
+ *	ref_advert_cache_init(&cache, r, key);
+ *	if (!ref_advert_cache_replay(&cache, stdout)) {
+ *		... iterate refs, passing each written line to
+ *		    ref_advert_cache_add() ...
+ *		ref_advert_cache_store(&cache);
+ *	}
+ *	ref_advert_cache_release(&cache);
+ */
+struct ref_advert_cache {
+	struct repository *repo;
+	/* Path of the cache entry, empty if caching is not possible. */
+	struct strbuf path;
+	/* Lines collected while recording a new entry. */
+	struct strbuf lines;
+	/* Maximum number of entries per generation token. */
+	int max_entries;
+	unsigned recording : 1;
+};
+
+#define REF_ADVERT_CACHE_INIT { \
+	.path = STRBUF_INIT, \
+	.lines = STRBUF_INIT, \
+}
+
+/*
+ * Return whether "uploadpack.advertisementCache" is enabled for the
+ * repository.
+ */
+int ref_advert_cache_enabled(struct repository *r);
+
+/*
+ * Prepare the cache for a request described by `key`. The key must
+ * contain everything that influences the advertised lines. Caching
+ * silently stays disabled if the ref store cannot provide a generation
+ * token.
+ */
+void ref_advert_cache_init(struct ref_advert_cache *cache,
+			   struct repository *r, const char *key);
+
+/*
+ * Write a cached advertisement as pkt-lines to `out`. Returns 1 if there
+ * was a cache entry. Otherwise returns 0 and starts recording, so that the
+ * caller can generate the advertisement and store it.
+ */
+int ref_advert_cache_replay(struct ref_advert_cache *cache, FILE *out);
+
+/*
+ * Record a single advertised line. The line must end with a newline and
+ * must not contain any other newlines. Does nothing when not recording.
+ */
+void ref_advert_cache_add(struct ref_advert_cache *cache,
+			  const char *line, size_t len);
+
+/*
+ * Store the recorded lines. Errors are ignored, as failing to populate the
+ * cache does not affect the advertisement itself.
+ */
+void ref_advert_cache_store(struct ref_advert_cache *cache);
+
+void ref_advert_cache_release(struct ref_advert_cache *cache);
+
+#endif /* REF_ADVERT_CACHE_H */
@@ -17,6 +17,7 @@
 #include "repo-settings.h"
 #include "repository.h"
 #include "commit.h"
+#include "commit-graph.h"
 #include "mailmap.h"
 #include "ident.h"
 #include "remote.h"
@@ -31,6 +32,7 @@
 #include "wt-status.h"
 #include "commit-slab.h"
 #include "commit-reach.h"
+#include "ahead-behind-cache.h"
 #include "worktree.h"
 #include "hashmap.h"
 
@@ -3229,7 +3231,12 @@ void filter_ahead_behind(struct repository *r,
 		commits_nr++;
 	}
 
-	ahead_behind(r, commits, commits_nr, array->counts, array->counts_nr);
+	if (ahead_behind_cache_enabled(r))
+		ahead_behind_cached(r, commits, commits_nr,
+				    array->counts, array->counts_nr);
+	else
+		ahead_behind(r, commits, commits_nr,
+			     array->counts, array->counts_nr);
 	free(commits);
 }
 
@@ -3469,17 +3476,58 @@ static int memcasecmp(const void *vs1, const void *vs2, size_t n)
 	return 0;
 }
 
+/*
+ * Sorting by the date of a commit does not need the commit object if the
+ * commit is part of the commit-graph. This lets us defer reading objects
+ * until the sorted refs get formatted, which may be never if the format
+ * does not need them or if "--count" cuts the list short.
+ */
+static int get_sort_value_from_commit_graph(struct ref_sorting *s,
+					    struct ref_array_item *ref,
+					    struct atom_value *v)
+{
+	struct used_atom *atom = &used_atom[s->atom];
+
+	/*
+	 * Dereferenced atoms need the tag object, and dates with a format
+	 * are compared as formatted strings.
+	 */
+	if (ref->value || s->sort_flags & REF_SORTING_VERSION ||
+	    (atom->atom_type != ATOM_COMMITTERDATE &&
+	     atom->atom_type != ATOM_CREATORDATE) ||
+	    *atom->name == '*' || strchr(atom->name, ':'))
+		return -1;
+
+	if (!ref->graph_commit_checked) {
+		ref->graph_commit = lookup_commit_in_graph(the_repository,
+							   &ref->objectname);
+		ref->graph_commit_checked = 1;
+	}
+	if (!ref->graph_commit)
+		return -1;
+
+	v->s = "";
+	v->s_size = ATOM_SIZE_UNSPECIFIED;
+	v->value = ref->graph_commit->date;
+	return 0;
+}
+
 static int cmp_ref_sorting(struct ref_sorting *s, struct ref_array_item *a, struct ref_array_item *b)
 {
 	struct atom_value *va, *vb;
+	struct atom_value graph_va, graph_vb;
 	int cmp;
 	int cmp_detached_head = 0;
 	cmp_type cmp_type = used_atom[s->atom].type;
 	struct strbuf err = STRBUF_INIT;
 
-	if (get_ref_atom_value(a, s->atom, &va, &err))
+	if (!get_sort_value_from_commit_graph(s, a, &graph_va))
+		va = &graph_va;
+	else if (get_ref_atom_value(a, s->atom, &va, &err))
 		die("%s", err.buf);
-	if (get_ref_atom_value(b, s->atom, &vb, &err))
+	if (!get_sort_value_from_commit_graph(s, b, &graph_vb))
+		vb = &graph_vb;
+	else if (get_ref_atom_value(b, s->atom, &vb, &err))
 		die("%s", err.buf);
 	strbuf_release(&err);
 	if (s->sort_flags & REF_SORTING_DETACHED_HEAD_FIRST &&
@@ -51,6 +51,13 @@ struct ref_array_item {
 	struct ahead_behind_count **counts;
 	char **is_base;
 
+	/*
+	 * The commit the ref points to, if it is in the commit-graph. Used
+	 * to sort without reading the object; see cmp_ref_sorting().
+	 */
+	struct commit *graph_commit;
+	unsigned graph_commit_checked : 1;
+
 	char refname[FLEX_ARRAY];
 };
 
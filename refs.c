@@ -1168,6 +1168,7 @@ int read_ref_at(struct ref_store *refs, const char *refname,
 		timestamp_t *cutoff_time, int *cutoff_tz, int *cutoff_cnt)
 {
 	struct read_ref_at_cb cb;
+	size_t skipped = 0;
 
 	memset(&cb, 0, sizeof(cb));
 	cb.at_time = at_time;
@@ -1178,7 +1179,21 @@ int read_ref_at(struct ref_store *refs, const char *refname,
 	cb.cutoff_cnt = cutoff_cnt;
 	cb.oid = oid;
 
-	refs_for_each_reflog_ent_reverse(refs, refname, read_ref_at_ent, &cb);
+	/*
+	 * When looking up an entry by date, the backend may be able to skip
+	 * over the newer entries. We only account for them afterwards,
+	 * which is fine as read_ref_at_ent() does not need their count.
+	 */
+	if (cnt < 0 && refs->be->for_each_reflog_ent_reverse_at &&
+	    refs->be->for_each_reflog_ent_reverse_at(refs, refname, at_time,
+						     &skipped, read_ref_at_ent,
+						     &cb) >= 0) {
+		cb.reccnt += skipped;
+		if (cb.found_it && cutoff_cnt)
+			*cutoff_cnt += skipped;
+	} else {
+		refs_for_each_reflog_ent_reverse(refs, refname, read_ref_at_ent, &cb);
+	}
 
 	if (!cb.reccnt) {
 		if (cnt == 0) {
@@ -2483,6 +2498,13 @@ int refs_optimize_required(struct ref_store *refs,
 	return refs->be->optimize_required(refs, opts, required);
 }
 
+int refs_generation_token(struct ref_store *refs, struct strbuf *out)
+{
+	if (!refs->be->generation_token)
+		return -1;
+	return refs->be->generation_token(refs, out);
+}
+
 int reference_get_peeled_oid(struct repository *repo,
 			     const struct reference *ref,
 			     struct object_id *peeled_oid)
@@ -563,6 +563,18 @@ struct refs_optimize_opts {
  */
 int refs_optimize(struct ref_store *refs, struct refs_optimize_opts *opts);
 
+/*
+ * Append an opaque token describing the current state of the references in
+ * the given ref store to `out`. The token changes whenever a reference gets
+ * created, updated or deleted, so callers can use it as a cache key for data
+ * derived from the set of references. Reflog-only updates may or may not
+ * change the token.
+ *
+ * Returns 0 on success, or a negative value if the backend cannot cheaply
+ * provide such a token, in which case `out` is left untouched.
+ */
+int refs_generation_token(struct ref_store *refs, struct strbuf *out);
+
 /*
  * Check if refs backend can be optimized by calling 'refs_optimize'.
  */
@@ -341,6 +341,30 @@ static int debug_for_each_reflog_ent_reverse(struct ref_store *ref_store,
 	return res;
 }
 
+static int debug_for_each_reflog_ent_reverse_at(struct ref_store *ref_store,
+						const char *refname,
+						timestamp_t at_time,
+						size_t *skipped,
+						each_reflog_ent_fn fn,
+						void *cb_data)
+{
+	struct debug_ref_store *drefs = (struct debug_ref_store *)ref_store;
+	struct debug_reflog dbg = {
+		.refname = refname,
+		.fn = fn,
+		.cb_data = cb_data,
+	};
+	int res = -1;
+
+	if (drefs->refs->be->for_each_reflog_ent_reverse_at)
+		res = drefs->refs->be->for_each_reflog_ent_reverse_at(
+			drefs->refs, refname, at_time, skipped,
+			&debug_print_reflog_ent, &dbg);
+	trace_printf_key(&trace_refs, "for_each_reflog_reverse_at: %s: %d\n",
+			 refname, res);
+	return res;
+}
+
 static int debug_reflog_exists(struct ref_store *ref_store, const char *refname)
 {
 	struct debug_ref_store *drefs = (struct debug_ref_store *)ref_store;
@@ -433,6 +457,15 @@ static int debug_fsck(struct ref_store *ref_store,
 	return res;
 }
 
+static int debug_generation_token(struct ref_store *ref_store,
+				  struct strbuf *out)
+{
+	struct debug_ref_store *drefs = (struct debug_ref_store *)ref_store;
+	int res = refs_generation_token(drefs->refs, out);
+	trace_printf_key(&trace_refs, "generation_token: %d\n", res);
+	return res;
+}
+
 struct ref_storage_be refs_be_debug = {
 	.name = "debug",
 	.init = NULL,
@@ -463,10 +496,13 @@ struct ref_storage_be refs_be_debug = {
 	.reflog_iterator_begin = debug_reflog_iterator_begin,
 	.for_each_reflog_ent = debug_for_each_reflog_ent,
 	.for_each_reflog_ent_reverse = debug_for_each_reflog_ent_reverse,
+	.for_each_reflog_ent_reverse_at = debug_for_each_reflog_ent_reverse_at,
 	.reflog_exists = debug_reflog_exists,
 	.create_reflog = debug_create_reflog,
 	.delete_reflog = debug_delete_reflog,
 	.reflog_expire = debug_reflog_expire,
 
 	.fsck = debug_fsck,
+
+	.generation_token = debug_generation_token,
 };
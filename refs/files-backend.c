@@ -27,6 +27,8 @@
 #include "../wrapper.h"
 #include "../write-or-die.h"
 #include "../revision.h"
+#include "../statinfo.h"
+#include "../strmap.h"
 #include <wildmatch.h>
 
 /*
@@ -86,9 +88,22 @@ struct files_ref_store {
 	char *gitcommondir;
 	enum log_refs_config log_all_ref_updates;
 	int prefer_symlink_refs;
+	int reflog_index;
 
 	struct ref_cache *loose;
 
+	/*
+	 * If `core.revalidateLooseRefs` is set, this maps the names of the
+	 * directories in the loose ref cache to the stat data they had when
+	 * they were read. Directories whose stat data could not be trusted
+	 * (because they may have been modified in the same second they were
+	 * read) are missing.
+	 */
+	int revalidate_loose_refs;
+	struct strmap loose_dir_stat;
+	/* The number of active iterators over the loose ref cache. */
+	unsigned int loose_iterators;
+
 	struct ref_store *packed_ref_store;
 };
 
@@ -98,6 +113,7 @@ static void clear_loose_ref_cache(struct files_ref_store *refs)
 		free_ref_cache(refs->loose);
 		refs->loose = NULL;
 	}
+	strmap_clear(&refs->loose_dir_stat, 1);
 }
 
 /*
@@ -127,6 +143,9 @@ static struct ref_store *files_ref_store_init(struct repository *repo,
 	refs->log_all_ref_updates = opts->log_all_ref_updates;
 
 	repo_config_get_bool(repo, "core.prefersymlinkrefs", &refs->prefer_symlink_refs);
+	repo_config_get_bool(repo, "core.revalidatelooserefs", &refs->revalidate_loose_refs);
+	repo_config_get_bool(repo, "core.reflogindex", &refs->reflog_index);
+	strmap_init(&refs->loose_dir_stat);
 
 	chdir_notify_reparent("files-backend $GIT_DIR", &refs->base.gitdir);
 	chdir_notify_reparent("files-backend $GIT_COMMONDIR",
@@ -175,18 +194,120 @@ static struct files_ref_store *files_downcast(struct ref_store *ref_store,
 	return refs;
 }
 
+/*
+ * The "refs-generation" file in the common directory holds a random
+ * value that gets replaced after every change to the references. It is
+ * only created once somebody asks for a generation token, so that
+ * repositories which never use tokens do not pay for the extra write.
+ */
+static void files_generation_path(struct files_ref_store *refs,
+				  struct strbuf *sb)
+{
+	strbuf_addf(sb, "%s/refs-generation", refs->gitcommondir);
+}
+
+/*
+ * Replace the contents of the "refs-generation" file with a new random
+ * value. Unless `create` is set, nothing is written if the file does not
+ * exist yet. Every writer uses its own temporary file and renames it into
+ * place, so concurrent writers cannot end up with the same value.
+ */
+static int files_bump_generation(struct files_ref_store *refs, int create)
+{
+	struct strbuf path = STRBUF_INIT;
+	struct strbuf value = STRBUF_INIT;
+	struct tempfile *tmp = NULL;
+	unsigned char rnd[16];
+	int ret = -1;
+	size_t i;
+
+	files_generation_path(refs, &path);
+	if (!create && !file_exists(path.buf)) {
+		ret = 0;
+		goto out;
+	}
+
+	if (csprng_bytes(rnd, sizeof(rnd), 0) < 0)
+		goto out;
+	for (i = 0; i < sizeof(rnd); i++)
+		strbuf_addf(&value, "%02x", rnd[i]);
+	strbuf_addch(&value, '\n');
+
+	strbuf_addstr(&path, ".XXXXXX");
+	tmp = mks_tempfile(path.buf);
+	if (!tmp)
+		goto out;
+	if (write_in_full(get_tempfile_fd(tmp), value.buf, value.len) < 0)
+		goto out;
+
+	strbuf_setlen(&path, path.len - strlen(".XXXXXX"));
+	ret = rename_tempfile(&tmp, path.buf);
+
+out:
+	if (ret < 0 && create)
+		error_errno(_("unable to update %s"), path.buf);
+	delete_tempfile(&tmp);
+	strbuf_release(&value);
+	strbuf_release(&path);
+	return ret;
+}
+
+static int files_generation_token(struct ref_store *ref_store,
+				  struct strbuf *out)
+{
+	struct files_ref_store *refs =
+		files_downcast(ref_store, REF_STORE_READ, "generation_token");
+	struct strbuf path = STRBUF_INIT;
+	struct strbuf value = STRBUF_INIT;
+	struct stat st;
+	int ret = -1;
+
+	files_generation_path(refs, &path);
+	if (strbuf_read_file(&value, path.buf, 0) < 0) {
+		if (errno != ENOENT || files_bump_generation(refs, 1) < 0 ||
+		    strbuf_read_file(&value, path.buf, 0) < 0)
+			goto out;
+	}
+	strbuf_trim(&value);
+
+	/*
+	 * Writes to "packed-refs" do not necessarily go through our own
+	 * transactions (e.g. when packing refs), so we also take its stat
+	 * data into account.
+	 */
+	strbuf_reset(&path);
+	strbuf_addf(&path, "%s/packed-refs", refs->gitcommondir);
+	strbuf_addf(out, "files:%s:", value.buf);
+	if (!stat(path.buf, &st))
+		strbuf_addf(out, "%"PRIuMAX":%"PRIuMAX":%"PRIuMAX".%u",
+			    (uintmax_t)st.st_ino, (uintmax_t)st.st_size,
+			    (uintmax_t)st.st_mtime, ST_MTIME_NSEC(st));
+	else if (errno == ENOENT)
+		strbuf_addstr(out, "none");
+	else
+		goto out;
+
+	ret = 0;
+out:
+	strbuf_release(&value);
+	strbuf_release(&path);
+	return ret;
+}
+
 static void files_ref_store_release(struct ref_store *ref_store)
 {
 	struct files_ref_store *refs = files_downcast(ref_store, 0, "release");
 	free_ref_cache(refs->loose);
+	strmap_clear(&refs->loose_dir_stat, 1);
 	free(refs->gitcommondir);
 	ref_store_release(refs->packed_ref_store);
 	free(refs->packed_ref_store);
 }
 
-static void files_reflog_path(struct files_ref_store *refs,
-			      struct strbuf *sb,
-			      const char *refname)
+static void files_logs_path(struct files_ref_store *refs,
+			    struct strbuf *sb,
+			    const char *logs_dir,
+			    const char *refname)
 {
 	const char *bare_refname;
 	const char *wtname;
@@ -196,21 +317,45 @@ static void files_reflog_path(struct files_ref_store *refs,
 
 	switch (wt_type) {
 	case REF_WORKTREE_CURRENT:
-		strbuf_addf(sb, "%s/logs/%s", refs->base.gitdir, refname);
+		strbuf_addf(sb, "%s/%s/%s", refs->base.gitdir, logs_dir, refname);
 		break;
 	case REF_WORKTREE_SHARED:
 	case REF_WORKTREE_MAIN:
-		strbuf_addf(sb, "%s/logs/%s", refs->gitcommondir, bare_refname);
+		strbuf_addf(sb, "%s/%s/%s", refs->gitcommondir, logs_dir, bare_refname);
 		break;
 	case REF_WORKTREE_OTHER:
-		strbuf_addf(sb, "%s/worktrees/%.*s/logs/%s", refs->gitcommondir,
-			    wtname_len, wtname, bare_refname);
+		strbuf_addf(sb, "%s/worktrees/%.*s/%s/%s", refs->gitcommondir,
+			    wtname_len, wtname, logs_dir, bare_refname);
 		break;
 	default:
 		BUG("unknown ref type %d of ref %s", wt_type, refname);
 	}
 }
 
+static void files_reflog_path(struct files_ref_store *refs,
+			      struct strbuf *sb,
+			      const char *refname)
+{
+	files_logs_path(refs, sb, "logs", refname);
+}
+
+static void files_reflog_index_path(struct files_ref_store *refs,
+				    struct strbuf *sb,
+				    const char *refname)
+{
+	files_logs_path(refs, sb, "logs-index", refname);
+}
+
+static void files_reflog_index_remove(struct files_ref_store *refs,
+				      const char *refname)
+{
+	struct strbuf sb = STRBUF_INIT;
+
+	files_reflog_index_path(refs, &sb, refname);
+	remove_path(sb.buf);
+	strbuf_release(&sb);
+}
+
 static void files_ref_path(struct files_ref_store *refs,
 			   struct strbuf *sb,
 			   const char *refname)
@@ -303,6 +448,34 @@ static void loose_fill_ref_dir_regular_file(struct files_ref_store *refs,
 	add_entry_to_dir(dir, create_ref_entry(refname, referent, &oid, flag));
 }
 
+/*
+ * Remember the stat data of the directory at `path` before reading it, so
+ * that we can later tell whether it has been modified. Refs are always
+ * written by renaming a lockfile into place, which updates the mtime of
+ * the containing directory. A directory modified in the same second we
+ * read it is not recorded, as further modifications in that second might
+ * go unnoticed.
+ */
+static void record_loose_dir_stat(struct files_ref_store *refs,
+				  const char *dirname, const char *path)
+{
+	time_t now = time(NULL);
+	struct stat_data *sd;
+	struct stat st;
+
+	if (lstat(path, &st) < 0 || st.st_mtime >= now) {
+		strmap_remove(&refs->loose_dir_stat, dirname, 1);
+		return;
+	}
+
+	sd = strmap_get(&refs->loose_dir_stat, dirname);
+	if (!sd) {
+		CALLOC_ARRAY(sd, 1);
+		strmap_put(&refs->loose_dir_stat, dirname, sd);
+	}
+	fill_stat_data(sd, &st);
+}
+
 /*
  * Read the loose references from the namespace dirname into dir
  * (without recursing).  dirname must end with '/'.  dir must be the
@@ -321,6 +494,9 @@ static void loose_fill_ref_dir(struct ref_store *ref_store,
 
 	files_ref_path(refs, &path, dirname);
 
+	if (refs->revalidate_loose_refs)
+		record_loose_dir_stat(refs, dirname, path.buf);
+
 	d = opendir(path.buf);
 	if (!d) {
 		strbuf_release(&path);
@@ -429,9 +605,75 @@ static void add_root_refs(struct files_ref_store *refs,
 	for_each_root_ref(refs, fill_root_ref, &data);
 }
 
+/*
+ * Check whether the directory `entry` of the loose ref cache is still up
+ * to date and re-read it if not. Directories containing symrefs are always
+ * re-read, as their cached values depend on refs stored elsewhere.
+ */
+static void revalidate_loose_ref_dir(struct files_ref_store *refs,
+				     struct ref_entry *entry,
+				     struct strbuf *path)
+{
+	struct ref_dir *dir = &entry->u.subdir;
+	struct stat_data *sd;
+	struct stat st;
+	int i, fresh = 0;
+
+	if (entry->flag & REF_INCOMPLETE)
+		return;
+
+	sd = strmap_get(&refs->loose_dir_stat, entry->name);
+	for (i = 0; sd && i < dir->nr; i++)
+		if (dir->entries[i]->flag & REF_ISSYMREF)
+			sd = NULL;
+
+	strbuf_reset(path);
+	files_ref_path(refs, path, entry->name);
+	if (sd && !lstat(path->buf, &st) && !match_stat_data(sd, &st))
+		fresh = 1;
+	else if (!sd && lstat(path->buf, &st) < 0 && errno == ENOENT && !dir->nr)
+		fresh = 1;
+
+	if (!fresh)
+		refresh_ref_dir(entry);
+
+	for (i = 0; i < dir->nr; i++)
+		if (dir->entries[i]->flag & REF_DIR)
+			revalidate_loose_ref_dir(refs, dir->entries[i], path);
+}
+
+static void revalidate_loose_ref_cache(struct files_ref_store *refs)
+{
+	struct ref_dir *root = &refs->loose->root->u.subdir;
+	struct strbuf path = STRBUF_INIT;
+	int i;
+
+	/*
+	 * Root refs live next to all kinds of other files in $GIT_DIR, so
+	 * we cannot cheaply tell whether they changed.
+	 */
+	for (i = 0; i < root->nr; i++) {
+		if (!(root->entries[i]->flag & REF_DIR)) {
+			clear_loose_ref_cache(refs);
+			return;
+		}
+	}
+
+	for (i = 0; i < root->nr; i++)
+		revalidate_loose_ref_dir(refs, root->entries[i], &path);
+	strbuf_release(&path);
+}
+
 static struct ref_cache *get_loose_ref_cache(struct files_ref_store *refs,
 					     unsigned int flags)
 {
+	/*
+	 * Iterators hold pointers into the cache, so we must not modify it
+	 * while any of them is active.
+	 */
+	if (refs->loose && refs->revalidate_loose_refs && !refs->loose_iterators)
+		revalidate_loose_ref_cache(refs);
+
 	if (!refs->loose) {
 		struct ref_dir *dir;
 
@@ -952,6 +1194,7 @@ struct files_ref_iterator {
 	struct ref_iterator base;
 
 	struct ref_iterator *iter0;
+	struct files_ref_store *refs;
 	struct repository *repo;
 	unsigned int flags;
 };
@@ -1001,6 +1244,7 @@ static void files_ref_iterator_release(struct ref_iterator *ref_iterator)
 	struct files_ref_iterator *iter =
 		(struct files_ref_iterator *)ref_iterator;
 	ref_iterator_free(iter->iter0);
+	iter->refs->loose_iterators--;
 }
 
 static struct ref_iterator_vtable files_ref_iterator_vtable = {
@@ -1066,8 +1310,10 @@ static struct ref_iterator *files_ref_iterator_begin(
 	ref_iterator = &iter->base;
 	base_ref_iterator_init(ref_iterator, &files_ref_iterator_vtable);
 	iter->iter0 = overlay_iter;
+	iter->refs = refs;
 	iter->repo = ref_store->repo;
 	iter->flags = flags;
+	refs->loose_iterators++;
 
 	return ref_iterator;
 }
@@ -1439,20 +1685,20 @@ static int should_pack_refs(struct files_ref_store *refs,
 
 	iter = cache_ref_iterator_begin(get_loose_ref_cache(refs, 0), NULL,
 					refs->base.repo, 0);
+	refs->loose_iterators++;
 	while ((ret = ref_iterator_advance(iter)) == ITER_OK) {
 		if (should_pack_ref(refs, &iter->ref, opts))
 			refcount++;
-		if (refcount >= limit) {
-			ref_iterator_free(iter);
-			return 1;
-		}
+		if (refcount >= limit)
+			break;
 	}
 
-	if (ret != ITER_DONE)
+	if (ret != ITER_OK && ret != ITER_DONE)
 		die("error while iterating over references");
 
 	ref_iterator_free(iter);
-	return 0;
+	refs->loose_iterators--;
+	return ret == ITER_OK;
 }
 
 static int files_optimize(struct ref_store *ref_store,
@@ -1479,6 +1725,7 @@ static int files_optimize(struct ref_store *ref_store,
 
 	iter = cache_ref_iterator_begin(get_loose_ref_cache(refs, 0), NULL,
 					refs->base.repo, 0);
+	refs->loose_iterators++;
 	while ((ok = ref_iterator_advance(iter)) == ITER_OK) {
 		/*
 		 * If the loose reference can be packed, add an entry
@@ -1517,8 +1764,9 @@ static int files_optimize(struct ref_store *ref_store,
 
 	packed_refs_unlock(refs->packed_ref_store);
 
-	prune_refs(refs, &refs_to_prune);
 	ref_iterator_free(iter);
+	refs->loose_iterators--;
+	prune_refs(refs, &refs_to_prune);
 	strbuf_release(&err);
 	return 0;
 }
@@ -1596,6 +1844,7 @@ static int rename_tmp_log(struct files_ref_store *refs, const char *newrefname)
 static enum ref_transaction_error write_ref_to_lockfile(struct files_ref_store *refs,
 							struct ref_lock *lock,
 							const struct object_id *oid,
+							int batch_fsync,
 							struct strbuf *err);
 static int commit_ref_update(struct files_ref_store *refs,
 			     struct ref_lock *lock,
@@ -1731,6 +1980,12 @@ static int files_copy_or_rename_ref(struct ref_store *ref_store,
 		goto rollback;
 
 	logmoved = log;
+	if (log) {
+		/* The indices are rebuilt on their next use. */
+		files_reflog_index_remove(refs, newrefname);
+		if (!copy)
+			files_reflog_index_remove(refs, oldrefname);
+	}
 
 	lock = lock_ref_oid_basic(refs, newrefname, &err);
 	if (!lock) {
@@ -1743,7 +1998,7 @@ static int files_copy_or_rename_ref(struct ref_store *ref_store,
 	}
 	oidcpy(&lock->old_oid, &orig_oid);
 
-	if (write_ref_to_lockfile(refs, lock, &orig_oid, &err) ||
+	if (write_ref_to_lockfile(refs, lock, &orig_oid, 0, &err) ||
 	    commit_ref_update(refs, lock, &orig_oid, logmsg, 0, &err)) {
 		error("unable to write current sha1 into %s: %s", newrefname, err.buf);
 		strbuf_release(&err);
@@ -1761,7 +2016,7 @@ static int files_copy_or_rename_ref(struct ref_store *ref_store,
 		goto rollbacklog;
 	}
 
-	if (write_ref_to_lockfile(refs, lock, &orig_oid, &err) ||
+	if (write_ref_to_lockfile(refs, lock, &orig_oid, 0, &err) ||
 	    commit_ref_update(refs, lock, &orig_oid, NULL, REF_SKIP_CREATE_REFLOG, &err)) {
 		error("unable to write current sha1 into %s: %s", oldrefname, err.buf);
 		strbuf_release(&err);
@@ -1771,12 +2026,15 @@ static int files_copy_or_rename_ref(struct ref_store *ref_store,
 	if (logmoved && rename(sb_newref.buf, sb_oldref.buf))
 		error("unable to restore logfile %s from %s: %s",
 			oldrefname, newrefname, strerror(errno));
+	if (logmoved)
+		files_reflog_index_remove(refs, oldrefname);
 	if (!logmoved && log &&
 	    rename(tmp_renamed_log.buf, sb_oldref.buf))
 		error("unable to restore logfile %s from logs/"TMP_RENAMED_LOG": %s",
 			oldrefname, strerror(errno));
 	ret = 1;
  out:
+	files_bump_generation(refs, 0);
 	strbuf_release(&sb_newref);
 	strbuf_release(&sb_oldref);
 	strbuf_release(&tmp_renamed_log);
@@ -1998,13 +2256,57 @@ static int files_log_ref_write(struct files_ref_store *refs,
 	return 0;
 }
 
+/*
+ * Harden a written loose ref lockfile. With `batch_fsync`, only ask
+ * for the data to be written out; the caller is then responsible for
+ * calling flush_batch_fsync() before committing the lockfile.
+ */
+static int fsync_ref_lockfile(int fd, int batch_fsync)
+{
+	if (batch_fsync) {
+		if (git_fsync(fd, FSYNC_WRITEOUT_ONLY) >= 0)
+			return 0;
+		if (errno == ENOSYS)
+			warning(_("core.fsyncMethod = batch is unsupported on this platform"));
+	}
+	return fsync_component(FSYNC_COMPONENT_REFERENCE, fd);
+}
+
+/*
+ * Issue a single hardware flush to make all lockfiles that were
+ * written with `batch_fsync` durable before they are renamed into
+ * place. The flush is issued against a temporary file, as flushing
+ * the storage hardware's writeback cache covers all files on it.
+ */
+static int flush_batch_fsync(struct files_ref_store *refs, struct strbuf *err)
+{
+	struct strbuf temp_path = STRBUF_INIT;
+	struct tempfile *temp;
+	int ret = 0;
+
+	strbuf_addf(&temp_path, "%s/bulk_fsync_XXXXXX", refs->gitcommondir);
+	temp = mks_tempfile(temp_path.buf);
+	if (!temp ||
+	    fsync_component(FSYNC_COMPONENT_REFERENCE, get_tempfile_fd(temp)) < 0) {
+		strbuf_addf(err, "couldn't flush '%s': %s",
+			    temp_path.buf, strerror(errno));
+		ret = -1;
+	}
+
+	delete_tempfile(&temp);
+	strbuf_release(&temp_path);
+	return ret;
+}
+
 /*
  * Write oid into the open lockfile, then close the lockfile. On
- * errors, rollback the lockfile, fill in *err and return -1.
+ * errors, rollback the lockfile, fill in *err and return -1. See
+ * fsync_ref_lockfile() for the meaning of `batch_fsync`.
  */
 static enum ref_transaction_error write_ref_to_lockfile(struct files_ref_store *refs,
 							struct ref_lock *lock,
 							const struct object_id *oid,
+							int batch_fsync,
 							struct strbuf *err)
 {
 	static char term = '\n';
@@ -2013,7 +2315,7 @@ static enum ref_transaction_error write_ref_to_lockfile(struct files_ref_store *
 	fd = get_lock_file_fd(&lock->lk);
 	if (write_in_full(fd, oid_to_hex(oid), refs->base.repo->hash_algo->hexsz) < 0 ||
 	    write_in_full(fd, &term, 1) < 0 ||
-	    fsync_component(FSYNC_COMPONENT_REFERENCE, get_lock_file_fd(&lock->lk)) < 0 ||
+	    fsync_ref_lockfile(fd, batch_fsync) < 0 ||
 	    close_ref_gently(lock) < 0) {
 		strbuf_addf(err,
 			    "couldn't write '%s'", get_lock_file_path(&lock->lk));
@@ -2165,6 +2467,8 @@ static int files_delete_reflog(struct ref_store *ref_store,
 	files_reflog_path(refs, &sb, refname);
 	ret = remove_path(sb.buf);
 	strbuf_release(&sb);
+	if (!ret)
+		files_reflog_index_remove(refs, refname);
 	return ret;
 }
 
@@ -2211,30 +2515,17 @@ static char *find_beginning_of_line(char *bob, char *scan)
 	return scan;
 }
 
-static int files_for_each_reflog_ent_reverse(struct ref_store *ref_store,
-					     const char *refname,
-					     each_reflog_ent_fn fn,
-					     void *cb_data)
+/*
+ * Feed the entries of the reflog in `logfp` to `fn` in reverse order,
+ * starting with the entry that ends right before `pos`.
+ */
+static int show_reflog_ents_reverse(struct files_ref_store *refs,
+				    const char *refname, FILE *logfp, long pos,
+				    each_reflog_ent_fn fn, void *cb_data)
 {
-	struct files_ref_store *refs =
-		files_downcast(ref_store, REF_STORE_READ,
-			       "for_each_reflog_ent_reverse");
 	struct strbuf sb = STRBUF_INIT;
-	FILE *logfp;
-	long pos;
 	int ret = 0, at_tail = 1;
 
-	files_reflog_path(refs, &sb, refname);
-	logfp = fopen(sb.buf, "r");
-	strbuf_release(&sb);
-	if (!logfp)
-		return -1;
-
-	/* Jump to the end */
-	if (fseek(logfp, 0, SEEK_END) < 0)
-		ret = error("cannot seek back reflog for %s: %s",
-			    refname, strerror(errno));
-	pos = ftell(logfp);
 	while (!ret && 0 < pos) {
 		int cnt;
 		size_t nread;
@@ -2320,8 +2611,394 @@ static int files_for_each_reflog_ent_reverse(struct ref_store *ref_store,
 	if (!ret && sb.len)
 		BUG("reverse reflog parser had leftover data");
 
+	strbuf_release(&sb);
+	return ret;
+}
+
+static int files_for_each_reflog_ent_reverse(struct ref_store *ref_store,
+					     const char *refname,
+					     each_reflog_ent_fn fn,
+					     void *cb_data)
+{
+	struct files_ref_store *refs =
+		files_downcast(ref_store, REF_STORE_READ,
+			       "for_each_reflog_ent_reverse");
+	struct strbuf sb = STRBUF_INIT;
+	FILE *logfp;
+	int ret;
+
+	files_reflog_path(refs, &sb, refname);
+	logfp = fopen(sb.buf, "r");
+	strbuf_release(&sb);
+	if (!logfp)
+		return -1;
+
+	/* Jump to the end */
+	if (fseek(logfp, 0, SEEK_END) < 0)
+		ret = error("cannot seek back reflog for %s: %s",
+			    refname, strerror(errno));
+	else
+		ret = show_reflog_ents_reverse(refs, refname, logfp,
+					       ftell(logfp), fn, cb_data);
+
 	fclose(logfp);
+	return ret;
+}
+
+/*
+ * With "core.reflogIndex", looking up a reflog entry by date maintains
+ * an index of the reflog in "logs-index/<refname>", which lets us find
+ * the entry with a binary search instead of parsing the reflog from its
+ * end. The index consists of a header and one record per valid reflog
+ * entry:
+ *
+ *   - 4-byte signature "RLGI"
+ *   - 4-byte version number, currently 1
+ *   - 4-byte flags
+ *   - 4-byte reserved field, zero
+ *   - one 16-byte record per entry, consisting of the 8-byte offset in
+ *     the reflog right after the entry and the 8-byte entry timestamp
+ *
+ * All numbers are stored in network byte order. The reflog itself stays
+ * the source of truth: when an index is used, we verify that its last
+ * entry still matches the reflog and index the entries that have been
+ * appended since. An index that does not match is rebuilt.
+ */
+#define REFLOG_INDEX_SIGNATURE 0x524c4749 /* "RLGI" */
+#define REFLOG_INDEX_VERSION 1
+#define REFLOG_INDEX_HEADER_SIZE 16
+#define REFLOG_INDEX_RECORD_SIZE 16
+
+/*
+ * The timestamps in the reflog are not in ascending order, so the index
+ * cannot be searched. We still keep the index around so that we need not
+ * find out again on every lookup.
+ */
+#define REFLOG_INDEX_UNORDERED (1u << 0)
+
+struct reflog_index {
+	/* The records of the on-disk index, if any. */
+	const unsigned char *map;
+	size_t map_size;
+	size_t map_nr;
+
+	/* Records of entries that were not yet in the on-disk index. */
+	struct strbuf new_records;
+	size_t new_nr;
+
+	uint32_t flags;
+};
+
+static const unsigned char *reflog_index_record(struct reflog_index *index,
+						size_t i)
+{
+	if (i < index->map_nr)
+		return index->map + REFLOG_INDEX_HEADER_SIZE +
+			i * REFLOG_INDEX_RECORD_SIZE;
+	return (const unsigned char *)index->new_records.buf +
+		(i - index->map_nr) * REFLOG_INDEX_RECORD_SIZE;
+}
+
+static long reflog_index_offset(struct reflog_index *index, size_t i)
+{
+	return get_be64(reflog_index_record(index, i));
+}
+
+static timestamp_t reflog_index_timestamp(struct reflog_index *index, size_t i)
+{
+	return get_be64(reflog_index_record(index, i) + 8);
+}
+
+static void reflog_index_release(struct reflog_index *index)
+{
+	if (index->map)
+		munmap((void *)index->map, index->map_size);
+	strbuf_release(&index->new_records);
+}
+
+struct reflog_index_ent {
+	timestamp_t timestamp;
+	int valid;
+};
+
+static int reflog_index_ent_fn(const char *refname UNUSED,
+			       struct object_id *ooid UNUSED,
+			       struct object_id *noid UNUSED,
+			       const char *email UNUSED,
+			       timestamp_t timestamp, int tz UNUSED,
+			       const char *message UNUSED, void *cb_data)
+{
+	struct reflog_index_ent *ent = cb_data;
+	ent->timestamp = timestamp;
+	ent->valid = 1;
+	return 0;
+}
+
+/*
+ * Append records for the complete reflog entries between `*pos` and
+ * `end` (or the end of the file if `end` is negative) to `out`. Lines
+ * that cannot be parsed are skipped, just like when iterating the
+ * reflog. Update `*pos` to point after the last complete line that was
+ * read and `*last` to the timestamp of the last valid entry, flagging
+ * `*flags` if the timestamps are out of order.
+ */
+static int reflog_index_scan(struct files_ref_store *refs, const char *refname,
+			     FILE *logfp, long *pos, long end,
+			     struct strbuf *out, size_t *nr,
+			     timestamp_t *last, uint32_t *flags)
+{
+	struct strbuf sb = STRBUF_INIT;
+
+	if (fseek(logfp, *pos, SEEK_SET) < 0)
+		return -1;
+
+	while ((end < 0 || *pos < end) &&
+	       !strbuf_getwholeline(&sb, logfp, '\n')) {
+		struct reflog_index_ent ent = { 0 };
+		unsigned char record[REFLOG_INDEX_RECORD_SIZE];
+
+		/* Somebody may be in the middle of appending this line. */
+		if (sb.buf[sb.len - 1] != '\n')
+			break;
+		*pos += sb.len;
+
+		show_one_reflog_ent(refs, refname, &sb, reflog_index_ent_fn, &ent);
+		if (!ent.valid)
+			continue;
+
+		if (ent.timestamp < *last)
+			*flags |= REFLOG_INDEX_UNORDERED;
+		*last = ent.timestamp;
+
+		put_be64(record, *pos);
+		put_be64(record + 8, ent.timestamp);
+		strbuf_add(out, record, sizeof(record));
+		(*nr)++;
+	}
+
+	strbuf_release(&sb);
+	return 0;
+}
+
+/*
+ * Map the on-disk index of `refname`, if it exists and still matches the
+ * reflog. Returns the offset in the reflog up to which it is indexed, or
+ * a negative value if there is no usable index.
+ */
+static long reflog_index_map(struct files_ref_store *refs, const char *refname,
+			     const char *path, FILE *logfp, long log_size,
+			     struct reflog_index *index)
+{
+	struct strbuf scratch = STRBUF_INIT;
+	struct stat st;
+	size_t nr = 0;
+	timestamp_t last = 0;
+	uint32_t flags = 0;
+	long pos, end;
+	int fd;
+
+	fd = open(path, O_RDONLY);
+	if (fd < 0)
+		return -1;
+	if (fstat(fd, &st) < 0 || st.st_size < REFLOG_INDEX_HEADER_SIZE ||
+	    (st.st_size - REFLOG_INDEX_HEADER_SIZE) % REFLOG_INDEX_RECORD_SIZE) {
+		close(fd);
+		return -1;
+	}
+
+	index->map_size = xsize_t(st.st_size);
+	index->map = xmmap(NULL, index->map_size, PROT_READ, MAP_PRIVATE, fd, 0);
+	close(fd);
+
+	if (get_be32(index->map) != REFLOG_INDEX_SIGNATURE ||
+	    get_be32(index->map + 4) != REFLOG_INDEX_VERSION)
+		goto invalid;
+	index->flags = get_be32(index->map + 8);
+	index->map_nr = (index->map_size - REFLOG_INDEX_HEADER_SIZE) /
+		REFLOG_INDEX_RECORD_SIZE;
+	if (index->flags & REFLOG_INDEX_UNORDERED)
+		return 0;
+	if (!index->map_nr)
+		goto invalid;
+
+	/*
+	 * Verify that the last indexed entry is still where the index
+	 * claims it to be. If it is, the reflog has at most been appended
+	 * to since the index was written.
+	 */
+	end = reflog_index_offset(index, index->map_nr - 1);
+	pos = index->map_nr > 1 ? reflog_index_offset(index, index->map_nr - 2) : 0;
+	if (end > log_size || pos >= end ||
+	    reflog_index_scan(refs, refname, logfp, &pos, end,
+			      &scratch, &nr, &last, &flags) < 0 ||
+	    pos != end || !nr ||
+	    memcmp(scratch.buf + scratch.len - REFLOG_INDEX_RECORD_SIZE,
+		   reflog_index_record(index, index->map_nr - 1),
+		   REFLOG_INDEX_RECORD_SIZE))
+		goto invalid;
+
+	strbuf_release(&scratch);
+	return end;
+
+invalid:
+	strbuf_release(&scratch);
+	munmap((void *)index->map, index->map_size);
+	index->map = NULL;
+	index->map_size = index->map_nr = 0;
+	index->flags = 0;
+	return -1;
+}
+
+/*
+ * Write the records that were not yet part of the on-disk index. Failing
+ * to do so is not an error, as the index is merely an optimization.
+ */
+static void reflog_index_write(char *path, struct reflog_index *index,
+			       int rewrite)
+{
+	struct lock_file lock = LOCK_INIT;
+	unsigned char header[REFLOG_INDEX_HEADER_SIZE] = { 0 };
+	struct stat st;
+	int fd;
+
+	if (safe_create_leading_directories(the_repository, path) < 0 ||
+	    hold_lock_file_for_update(&lock, path, 0) < 0)
+		return;
+
+	put_be32(header, REFLOG_INDEX_SIGNATURE);
+	put_be32(header + 4, REFLOG_INDEX_VERSION);
+	put_be32(header + 8, index->flags);
+
+	if (rewrite) {
+		fd = get_lock_file_fd(&lock);
+		if (write_in_full(fd, header, sizeof(header)) < 0 ||
+		    (!(index->flags & REFLOG_INDEX_UNORDERED) &&
+		     write_in_full(fd, index->new_records.buf,
+				   index->new_records.len) < 0) ||
+		    commit_lock_file(&lock) < 0)
+			rollback_lock_file(&lock);
+		return;
+	}
+
+	/*
+	 * Appending in place keeps updates cheap. The lock serializes us
+	 * against other writers, and we bail out if somebody else has
+	 * changed the index since we mapped it. A partially written record
+	 * makes the index invalid, so that it gets rebuilt.
+	 */
+	fd = open(path, O_WRONLY);
+	if (fd >= 0 && !fstat(fd, &st) && (size_t)st.st_size == index->map_size) {
+		if (index->flags & REFLOG_INDEX_UNORDERED)
+			write_in_full(fd, header, sizeof(header));
+		else if (lseek(fd, 0, SEEK_END) >= 0)
+			write_in_full(fd, index->new_records.buf,
+				      index->new_records.len);
+	}
+	if (fd >= 0)
+		close(fd);
+	rollback_lock_file(&lock);
+}
+
+/*
+ * Load the index of `refname`, bringing it up to date with the reflog
+ * in `logfp`. Returns 0 if the index can be used for lookups.
+ */
+static int reflog_index_load(struct files_ref_store *refs, const char *refname,
+			     FILE *logfp, long log_size,
+			     struct reflog_index *index)
+{
+	struct strbuf path = STRBUF_INIT;
+	timestamp_t last = 0;
+	uint32_t flags;
+	long pos;
+	int rewrite;
+
+	files_reflog_index_path(refs, &path, refname);
+
+	pos = reflog_index_map(refs, refname, path.buf, logfp, log_size, index);
+	rewrite = pos < 0;
+	if (rewrite)
+		pos = 0;
+	else if (index->flags & REFLOG_INDEX_UNORDERED)
+		goto out;
+	else
+		last = reflog_index_timestamp(index, index->map_nr - 1);
+
+	flags = index->flags;
+	if (reflog_index_scan(refs, refname, logfp, &pos, -1,
+			      &index->new_records, &index->new_nr,
+			      &last, &index->flags) < 0) {
+		index->flags |= REFLOG_INDEX_UNORDERED;
+		goto out;
+	}
+
+	if (rewrite || index->new_nr || index->flags != flags)
+		reflog_index_write(path.buf, index, rewrite);
+
+out:
+	strbuf_release(&path);
+	return (index->flags & REFLOG_INDEX_UNORDERED) ||
+		!(index->map_nr + index->new_nr) ? -1 : 0;
+}
+
+static int files_for_each_reflog_ent_reverse_at(struct ref_store *ref_store,
+						const char *refname,
+						timestamp_t at_time,
+						size_t *skipped,
+						each_reflog_ent_fn fn,
+						void *cb_data)
+{
+	struct files_ref_store *refs =
+		files_downcast(ref_store, REF_STORE_READ,
+			       "for_each_reflog_ent_reverse_at");
+	struct reflog_index index = { .new_records = STRBUF_INIT };
+	struct strbuf sb = STRBUF_INIT;
+	size_t lo, hi, nr, start;
+	struct stat st;
+	FILE *logfp;
+	int ret = -1;
+
+	if (!refs->reflog_index)
+		return -1;
+
+	files_reflog_path(refs, &sb, refname);
+	logfp = fopen(sb.buf, "r");
 	strbuf_release(&sb);
+	if (!logfp)
+		return -1;
+
+	if (fstat(fileno(logfp), &st) < 0 ||
+	    reflog_index_load(refs, refname, logfp, st.st_size, &index) < 0)
+		goto out;
+
+	/*
+	 * Find the number of entries at or before `at_time`, the newest of
+	 * which is the entry we are looking for.
+	 */
+	nr = index.map_nr + index.new_nr;
+	lo = 0;
+	hi = nr;
+	while (lo < hi) {
+		size_t mi = lo + (hi - lo) / 2;
+		if (reflog_index_timestamp(&index, mi) <= at_time)
+			lo = mi + 1;
+		else
+			hi = mi;
+	}
+
+	/*
+	 * Start iterating with the entry that follows the one we are
+	 * looking for, as the caller wants to compare against it.
+	 */
+	start = lo < nr ? lo : nr - 1;
+	*skipped = nr - 1 - start;
+	ret = show_reflog_ents_reverse(refs, refname, logfp,
+				       reflog_index_offset(&index, start),
+				       fn, cb_data);
+
+out:
+	reflog_index_release(&index);
+	fclose(logfp);
 	return ret;
 }
 
@@ -2616,6 +3293,12 @@ struct files_transaction_backend_data {
 	struct ref_transaction *packed_transaction;
 	int packed_refs_locked;
 	struct strmap ref_locks;
+	/*
+	 * Whether lockfiles have been written with only a writeout
+	 * request, such that a flush_batch_fsync() is needed before
+	 * committing them.
+	 */
+	int batch_fsync_pending;
 };
 
 /*
@@ -2811,9 +3494,11 @@ static enum ref_transaction_error lock_ref_for_update(struct files_ref_store *re
 			 * value, so we don't need to write it.
 			 */
 		} else {
+			int batch_fsync = batch_fsync_enabled(FSYNC_COMPONENT_REFERENCE);
+
 			ret = write_ref_to_lockfile(
 				refs, lock, &update->new_oid,
-				err);
+				batch_fsync, err);
 			if (ret) {
 				char *write_err = strbuf_detach(err, NULL);
 
@@ -2829,6 +3514,8 @@ static enum ref_transaction_error lock_ref_for_update(struct files_ref_store *re
 				goto out;
 			} else {
 				update->flags |= REF_NEEDS_COMMIT;
+				if (batch_fsync)
+					backend_data->batch_fsync_pending = 1;
 			}
 		}
 	}
@@ -3007,6 +3694,17 @@ static int files_transaction_prepare(struct ref_store *ref_store,
 		}
 	}
 
+	/*
+	 * With "core.fsyncMethod=batch", the lockfiles have only been
+	 * written out so far. Make all of them durable with a single
+	 * flush, before any of them can be committed.
+	 */
+	if (backend_data->batch_fsync_pending &&
+	    flush_batch_fsync(refs, err)) {
+		ret = REF_TRANSACTION_ERROR_GENERIC;
+		goto cleanup;
+	}
+
 	/*
 	 * Verify that none of the loose reference that we're about to write
 	 * conflict with any existing packed references. Ideally, we'd do this
@@ -3354,6 +4052,7 @@ static int files_transaction_finish(struct ref_store *ref_store,
 			if (!unlink_or_warn(sb.buf))
 				try_remove_empty_parents(refs, update->refname,
 							 REMOVE_EMPTY_PARENTS_REFLOG);
+			files_reflog_index_remove(refs, update->refname);
 		}
 	}
 
@@ -3399,6 +4098,7 @@ static int files_transaction_finish(struct ref_store *ref_store,
 	clear_loose_ref_cache(refs);
 
 cleanup:
+	files_bump_generation(refs, 0);
 	files_transaction_cleanup(refs, transaction);
 
 	for (i = 0; i < transaction->nr; i++) {
@@ -3584,8 +4284,13 @@ static int files_reflog_expire(struct ref_store *ref_store,
 		} else if (commit_lock_file(&reflog_lock)) {
 			status |= error("unable to write reflog '%s' (%s)",
 					log_file, strerror(errno));
-		} else if (update && commit_ref(lock)) {
-			status |= error("couldn't set %s", lock->ref_name);
+		} else {
+			/* The index is rebuilt on its next use. */
+			files_reflog_index_remove(refs, refname);
+			if (update && commit_ref(lock))
+				status |= error("couldn't set %s", lock->ref_name);
+			else if (update)
+				files_bump_generation(refs, 0);
 		}
 	}
 	free(log_file);
@@ -4049,10 +4754,13 @@ struct ref_storage_be refs_be_files = {
 	.reflog_iterator_begin = files_reflog_iterator_begin,
 	.for_each_reflog_ent = files_for_each_reflog_ent,
 	.for_each_reflog_ent_reverse = files_for_each_reflog_ent_reverse,
+	.for_each_reflog_ent_reverse_at = files_for_each_reflog_ent_reverse_at,
 	.reflog_exists = files_reflog_exists,
 	.create_reflog = files_create_reflog,
 	.delete_reflog = files_delete_reflog,
 	.reflog_expire = files_reflog_expire,
 
 	.fsck = files_fsck,
+
+	.generation_token = files_generation_token,
 };
@@ -94,6 +94,39 @@ static void clear_ref_dir(struct ref_dir *dir)
 	dir->sorted = dir->nr = dir->alloc = 0;
 }
 
+void refresh_ref_dir(struct ref_entry *entry)
+{
+	struct ref_dir *dir = &entry->u.subdir;
+	struct ref_dir old = *dir;
+	int i;
+
+	assert(entry->flag & REF_DIR);
+	if (!dir->cache->fill_ref_dir)
+		BUG("refreshing ref_store without fill_ref_dir function");
+
+	dir->entries = NULL;
+	dir->sorted = dir->nr = dir->alloc = 0;
+	dir->cache->fill_ref_dir(dir->cache->ref_store, dir, entry->name);
+	entry->flag &= ~REF_INCOMPLETE;
+
+	for (i = 0; i < dir->nr; i++) {
+		struct ref_entry *fresh = dir->entries[i];
+		int pos;
+
+		if (!(fresh->flag & REF_DIR))
+			continue;
+		pos = search_ref_dir(&old, fresh->name, strlen(fresh->name));
+		if (pos < 0 || !(old.entries[pos]->flag & REF_DIR))
+			continue;
+
+		/* Keep the old subdirectory and discard the fresh stub. */
+		dir->entries[i] = old.entries[pos];
+		old.entries[pos] = fresh;
+	}
+
+	clear_ref_dir(&old);
+}
+
 struct ref_entry *create_dir_entry(struct ref_cache *cache,
 				   const char *dirname, size_t len)
 {
@@ -165,6 +165,15 @@ int search_ref_dir(struct ref_dir *dir, const char *refname, size_t len);
 
 struct ref_dir *get_ref_dir(struct ref_entry *entry);
 
+/*
+ * Re-read the directory represented by `entry` via the cache's
+ * `fill_ref_dir` function, discarding the references it contained.
+ * Subdirectories that exist both before and after re-reading keep their
+ * cached contents; it is up to the caller to check whether those are still
+ * up to date.
+ */
+void refresh_ref_dir(struct ref_entry *entry);
+
 /*
  * Create a struct ref_entry object for the specified dirname.
  * dirname is the name of the directory with a trailing slash (e.g.,
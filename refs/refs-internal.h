@@ -493,6 +493,22 @@ typedef int for_each_reflog_ent_reverse_fn(struct ref_store *ref_store,
 					   const char *refname,
 					   each_reflog_ent_fn fn,
 					   void *cb_data);
+
+/*
+ * Optional: like for_each_reflog_ent_reverse_fn, but without reading
+ * the newest entries that have a timestamp after `at_time`. Iteration
+ * starts with the entry directly following the newest entry at or
+ * before `at_time` (or with the oldest entry if there is none), and the
+ * number of entries that have been skipped is stored in `skipped`.
+ * Returns a negative value without calling `fn` if the backend cannot
+ * skip entries efficiently.
+ */
+typedef int for_each_reflog_ent_reverse_at_fn(struct ref_store *ref_store,
+					      const char *refname,
+					      timestamp_t at_time,
+					      size_t *skipped,
+					      each_reflog_ent_fn fn,
+					      void *cb_data);
 typedef int reflog_exists_fn(struct ref_store *ref_store, const char *refname);
 typedef int create_reflog_fn(struct ref_store *ref_store, const char *refname,
 			     struct strbuf *err);
@@ -570,6 +586,15 @@ typedef int fsck_fn(struct ref_store *ref_store,
 		    struct fsck_options *o,
 		    struct worktree *wt);
 
+/*
+ * Append an opaque token describing the current state of the ref store to
+ * `out`. Please refer to `refs_generation_token()` for the expected
+ * behaviour. Backends that cannot provide such a token leave this callback
+ * `NULL`.
+ */
+typedef int generation_token_fn(struct ref_store *ref_store,
+				struct strbuf *out);
+
 struct ref_storage_be {
 	const char *name;
 	ref_store_init_fn *init;
@@ -598,12 +623,15 @@ struct ref_storage_be {
 	reflog_iterator_begin_fn *reflog_iterator_begin;
 	for_each_reflog_ent_fn *for_each_reflog_ent;
 	for_each_reflog_ent_reverse_fn *for_each_reflog_ent_reverse;
+	for_each_reflog_ent_reverse_at_fn *for_each_reflog_ent_reverse_at;
 	reflog_exists_fn *reflog_exists;
 	create_reflog_fn *create_reflog;
 	delete_reflog_fn *delete_reflog;
 	reflog_expire_fn *reflog_expire;
 
 	fsck_fn *fsck;
+
+	generation_token_fn *generation_token;
 };
 
 extern struct ref_storage_be refs_be_files;
@@ -38,6 +38,8 @@
 struct reftable_backend {
 	struct reftable_stack *stack;
 	struct reftable_iterator it;
+	/* Path to the "tables.list" file of the stack. */
+	char *tables_list;
 };
 
 static void reftable_backend_on_reload(void *payload)
@@ -51,9 +53,15 @@ static int reftable_backend_init(struct reftable_backend *be,
 				 const struct reftable_write_options *_opts)
 {
 	struct reftable_write_options opts = *_opts;
+	int ret;
+
 	opts.on_reload = reftable_backend_on_reload;
 	opts.on_reload_payload = be;
-	return reftable_new_stack(&be->stack, path, &opts);
+
+	ret = reftable_new_stack(&be->stack, path, &opts);
+	if (!ret)
+		be->tables_list = xstrfmt("%s/tables.list", path);
+	return ret;
 }
 
 static void reftable_backend_release(struct reftable_backend *be)
@@ -61,6 +69,7 @@ static void reftable_backend_release(struct reftable_backend *be)
 	reftable_stack_destroy(be->stack);
 	be->stack = NULL;
 	reftable_iterator_destroy(&be->it);
+	FREE_AND_NULL(be->tables_list);
 }
 
 static int reftable_backend_read_ref(struct reftable_backend *be,
@@ -2790,6 +2799,46 @@ static int reftable_be_fsck(struct ref_store *ref_store, struct fsck_options *o,
 	return ret;
 }
 
+/*
+ * Every modification of a stack rewrites its "tables.list" file with the
+ * names of the new tables, which embed the update indices and a random
+ * suffix. The contents of the file thus uniquely identify the state of
+ * the stack.
+ */
+static int reftable_be_generation_token(struct ref_store *ref_store,
+					struct strbuf *out)
+{
+	struct reftable_ref_store *refs =
+		reftable_be_downcast(ref_store, REF_STORE_READ, "generation_token");
+	struct reftable_backend *backends[] = {
+		&refs->main_backend, &refs->worktree_backend,
+	};
+	struct strbuf list = STRBUF_INIT;
+	int ret = 0;
+
+	if (refs->err < 0)
+		return refs->err;
+
+	strbuf_addstr(out, "reftable");
+	for (size_t i = 0; i < ARRAY_SIZE(backends); i++) {
+		if (!backends[i]->stack)
+			continue;
+
+		strbuf_reset(&list);
+		if (strbuf_read_file(&list, backends[i]->tables_list, 0) < 0 &&
+		    errno != ENOENT) {
+			ret = -1;
+			break;
+		}
+
+		strbuf_addch(out, ':');
+		strbuf_addbuf(out, &list);
+	}
+
+	strbuf_release(&list);
+	return ret;
+}
+
 struct ref_storage_be refs_be_reftable = {
 	.name = "reftable",
 	.init = reftable_be_init,
@@ -2820,4 +2869,6 @@ struct ref_storage_be refs_be_reftable = {
 	.reflog_expire = reftable_be_reflog_expire,
 
 	.fsck = reftable_be_fsck,
+
+	.generation_token = reftable_be_generation_token,
 };
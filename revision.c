@@ -652,7 +652,8 @@ static int forbid_bloom_filters(struct pathspec *spec)
 		PATHSPEC_MAXDEPTH |
 		PATHSPEC_LITERAL |
 		PATHSPEC_GLOB |
-		PATHSPEC_ATTR;
+		PATHSPEC_ATTR |
+		PATHSPEC_EXCLUDE;
 
 	if (spec->magic & ~allowed_magic)
 		return 1;
@@ -665,16 +666,14 @@ static int forbid_bloom_filters(struct pathspec *spec)
 
 static void release_revisions_bloom_keyvecs(struct rev_info *revs);
 
-static int convert_pathspec_to_bloom_keyvec(struct bloom_keyvec **out,
-					    const struct pathspec_item *pi,
-					    const struct bloom_filter_settings *settings)
+/*
+ * Return the length of the leading part of the pathspec item that can be
+ * looked up in a changed-path Bloom filter, or 0 if there is none.
+ */
+static size_t pathspec_item_bloom_len(const struct pathspec_item *pi)
 {
-	char *path_alloc = NULL;
-	const char *path;
-	size_t len;
-	int res = -1;
+	size_t len = pi->nowildcard_len;
 
-	len = pi->nowildcard_len;
 	if (len != pi->len) {
 		/*
 		 * for path like "dir/file*", nowildcard part would be
@@ -688,25 +687,33 @@ static int convert_pathspec_to_bloom_keyvec(struct bloom_keyvec **out,
 	if (len > 0 && pi->match[len - 1] == '/')
 		len--;
 
-	if (!len)
-		goto cleanup;
+	return len;
+}
 
-	if (len != pi->len) {
-		path_alloc = xmemdupz(pi->match, len);
-		path = path_alloc;
-	} else
-		path = pi->match;
+/*
+ * Is one of the leading directories of "path" in the (sorted) list of
+ * paths? Changes to "path" then also show up as a change to that directory.
+ */
+static int bloom_path_is_covered(const char *path, struct string_list *paths)
+{
+	struct strbuf dir = STRBUF_INIT;
+	const char *slash;
+	int ret = 0;
 
-	*out = bloom_keyvec_new(path, len, settings);
+	for (slash = strchr(path, '/'); !ret && slash; slash = strchr(slash + 1, '/')) {
+		strbuf_reset(&dir);
+		strbuf_add(&dir, path, slash - path);
+		ret = string_list_has_string(paths, dir.buf);
+	}
 
-	res = 0;
-cleanup:
-	free(path_alloc);
-	return res;
+	strbuf_release(&dir);
+	return ret;
 }
 
 static void prepare_to_use_bloom_filter(struct rev_info *revs)
 {
+	struct string_list paths = STRING_LIST_INIT_DUP;
+
 	if (!revs->commits)
 		return;
 
@@ -722,16 +729,44 @@ static void prepare_to_use_bloom_filter(struct rev_info *revs)
 	if (!revs->pruning.pathspec.nr)
 		return;
 
-	revs->bloom_keyvecs_nr = revs->pruning.pathspec.nr;
-	CALLOC_ARRAY(revs->bloom_keyvecs, revs->bloom_keyvecs_nr);
-
 	for (int i = 0; i < revs->pruning.pathspec.nr; i++) {
-		if (convert_pathspec_to_bloom_keyvec(&revs->bloom_keyvecs[i],
-						     &revs->pruning.pathspec.items[i],
-						     revs->bloom_filter_settings))
+		const struct pathspec_item *pi = &revs->pruning.pathspec.items[i];
+		size_t len;
+
+		/*
+		 * A commit that does not touch any of the positive
+		 * pathspecs cannot touch a path that is matched by them
+		 * but not excluded either, so we can ignore the negative
+		 * ones here.
+		 */
+		if (pi->magic & PATHSPEC_EXCLUDE)
+			continue;
+
+		len = pathspec_item_bloom_len(pi);
+		if (!len)
 			goto fail;
+		string_list_append_nodup(&paths, xmemdupz(pi->match, len));
 	}
 
+	/*
+	 * We only need to know whether any of the paths may have changed,
+	 * so drop duplicates and paths inside of another one; they would
+	 * only cost us extra lookups for every commit.
+	 */
+	string_list_sort(&paths);
+	string_list_remove_duplicates(&paths, 0);
+	ALLOC_ARRAY(revs->bloom_keyvecs, paths.nr);
+	for (size_t i = 0; i < paths.nr; i++) {
+		const char *path = paths.items[i].string;
+
+		if (bloom_path_is_covered(path, &paths))
+			continue;
+		revs->bloom_keyvecs[revs->bloom_keyvecs_nr++] =
+			bloom_keyvec_new(path, strlen(path),
+					 revs->bloom_filter_settings);
+	}
+	string_list_clear(&paths, 0);
+
 	if (trace2_is_enabled() && !bloom_filter_atexit_registered) {
 		atexit(trace2_bloom_filter_statistics_atexit);
 		bloom_filter_atexit_registered = 1;
@@ -740,6 +775,7 @@ static void prepare_to_use_bloom_filter(struct rev_info *revs)
 	return;
 
 fail:
+	string_list_clear(&paths, 0);
 	revs->bloom_filter_settings = NULL;
 	release_revisions_bloom_keyvecs(revs);
 }
@@ -774,6 +810,94 @@ static int check_maybe_different_in_bloom_filter(struct rev_info *revs,
 	return result;
 }
 
+static int changed_path_lists_atexit_registered;
+static unsigned int count_changed_path_list_not_present;
+static unsigned int count_changed_path_list_same;
+static unsigned int count_changed_path_list_different;
+
+static void trace2_changed_path_list_statistics_atexit(void)
+{
+	struct json_writer jw = JSON_WRITER_INIT;
+
+	jw_object_begin(&jw, 0);
+	jw_object_intmax(&jw, "list_not_present", count_changed_path_list_not_present);
+	jw_object_intmax(&jw, "same", count_changed_path_list_same);
+	jw_object_intmax(&jw, "different", count_changed_path_list_different);
+	jw_end(&jw);
+
+	trace2_data_json("changed-path-lists", the_repository, "statistics", &jw);
+
+	jw_release(&jw);
+}
+
+/*
+ * Unlike Bloom filters, the changed-path lists are used to give the final
+ * answer, so we have to be able to tell exactly whether a path matches.
+ */
+static int forbid_changed_path_lists(struct pathspec *spec)
+{
+	unsigned int allowed_magic =
+		PATHSPEC_FROMTOP |
+		PATHSPEC_LITERAL |
+		PATHSPEC_GLOB |
+		PATHSPEC_EXCLUDE;
+
+	if (spec->magic & ~allowed_magic)
+		return 1;
+	for (size_t nr = 0; nr < spec->nr; nr++)
+		if (spec->items[nr].magic & ~allowed_magic)
+			return 1;
+
+	return 0;
+}
+
+static void prepare_to_use_changed_path_lists(struct rev_info *revs)
+{
+	if (!revs->pruning.pathspec.nr ||
+	    forbid_changed_path_lists(&revs->pruning.pathspec))
+		return;
+
+	if (!commit_graph_has_changed_path_lists(revs->repo))
+		return;
+
+	revs->use_changed_path_lists = 1;
+
+	if (trace2_is_enabled() && !changed_path_lists_atexit_registered) {
+		atexit(trace2_changed_path_list_statistics_atexit);
+		changed_path_lists_atexit_registered = 1;
+	}
+}
+
+/*
+ * Return 1 if "commit" changed a path matching the pathspec compared to its
+ * first parent, 0 if it did not, and -1 if the commit-graph does not know.
+ */
+static int check_changed_path_lists(struct rev_info *revs,
+				    struct commit *commit)
+{
+	struct commit_changed_paths paths;
+	int result = 0;
+
+	if (get_commit_changed_paths(revs->repo, commit, &paths)) {
+		count_changed_path_list_not_present++;
+		return -1;
+	}
+
+	for (size_t i = 0; !result && i < paths.nr; i++) {
+		const char *path = commit_changed_path(&paths, i);
+
+		result = match_pathspec(revs->repo->index, &revs->pruning.pathspec,
+					path, strlen(path), 0, NULL, 0);
+	}
+
+	if (result)
+		count_changed_path_list_different++;
+	else
+		count_changed_path_list_same++;
+
+	return !!result;
+}
+
 static int rev_compare_tree(struct rev_info *revs,
 			    struct commit *parent, struct commit *commit, int nth_parent)
 {
@@ -804,6 +928,19 @@ static int rev_compare_tree(struct rev_info *revs,
 			return REV_TREE_SAME;
 	}
 
+	if (revs->use_changed_path_lists && !nth_parent) {
+		int ret = check_changed_path_lists(revs, commit);
+
+		if (!ret)
+			return REV_TREE_SAME;
+		/*
+		 * Only --remove-empty cares about whether the paths were
+		 * added or modified; we would need the trees for that.
+		 */
+		if (ret > 0 && !revs->remove_empty_trees)
+			return REV_TREE_DIFFERENT;
+	}
+
 	if (revs->bloom_keyvecs_nr && !nth_parent) {
 		bloom_ret = check_maybe_different_in_bloom_filter(revs, commit);
 
@@ -1418,6 +1555,47 @@ static void collect_bottom_commits(struct commit_list *list,
 			commit_list_insert(elem->item, bottom);
 }
 
+/*
+ * "--ancestry-path" without an explicit commit does not need limit_list():
+ * the incremental topo-order walk can decide for each commit whether it
+ * leads to one of the bottom commits right before showing it (see
+ * limit_topo_walk_to_ancestry()). This only works as long as nothing else
+ * asks for a limited walk and all parents of all commits are followed.
+ */
+static int ancestry_path_can_stream(const struct rev_info *revs)
+{
+	return revs->ancestry_path_implicit_bottoms &&
+	       !revs->ancestry_path_bottoms &&
+	       revs->topo_order && !revs->limited &&
+	       !revs->first_parent_only && !revs->prune_data.nr &&
+	       !revs->reflog_info && !revs->line_level_traverse &&
+	       revs->max_age == -1;
+}
+
+/*
+ * Collect the bottom commits for a streaming "--ancestry-path" walk. Their
+ * generation numbers bound the search for paths leading to them, so give
+ * up if any of them is not covered by the commit-graph.
+ */
+static int collect_ancestry_path_bottoms(struct rev_info *revs)
+{
+	struct commit_list *p;
+
+	collect_bottom_commits(revs->commits, &revs->ancestry_path_bottoms);
+	if (!revs->ancestry_path_bottoms)
+		die("--ancestry-path given but there are no bottom commits");
+
+	for (p = revs->ancestry_path_bottoms; p; p = p->next) {
+		if (repo_parse_commit_gently(revs->repo, p->item, 1) ||
+		    commit_graph_generation(p->item) == GENERATION_NUMBER_INFINITY) {
+			commit_list_free(revs->ancestry_path_bottoms);
+			revs->ancestry_path_bottoms = NULL;
+			return -1;
+		}
+	}
+	return 0;
+}
+
 /* Assumes either left_only or right_only is set */
 static void limit_left_right(struct commit_list *list, struct rev_info *revs)
 {
@@ -2406,7 +2584,6 @@ static int handle_revision_opt(struct rev_info *revs, int argc, const char **arg
 	} else if (!strcmp(arg, "--ancestry-path")) {
 		revs->ancestry_path = 1;
 		revs->simplify_history = 0;
-		revs->limited = 1;
 		revs->ancestry_path_implicit_bottoms = 1;
 	} else if (skip_prefix(arg, "--ancestry-path=", &optarg)) {
 		struct commit *c;
@@ -3167,6 +3344,9 @@ int setup_revisions(int argc, const char **argv, struct rev_info *revs, struct s
 				      &revs->prune_data);
 	}
 
+	if (revs->ancestry_path && !ancestry_path_can_stream(revs))
+		revs->limited = 1;
+
 	diff_merges_setup_revs(revs);
 
 	revs->diffopt.abbrev = revs->abbrev;
@@ -3693,6 +3873,13 @@ static int mark_uninteresting(const struct object_id *oid,
 
 define_commit_slab(indegree_slab, int);
 define_commit_slab(author_date_slab, timestamp_t);
+define_commit_slab(ancestry_path_slab, unsigned char);
+
+enum ancestry_path_state {
+	ANCESTRY_PATH_UNKNOWN = 0,
+	ANCESTRY_PATH_ON,
+	ANCESTRY_PATH_OFF,
+};
 
 struct topo_walk_info {
 	timestamp_t min_generation;
@@ -3701,6 +3888,11 @@ struct topo_walk_info {
 	struct prio_queue topo_queue;
 	struct indegree_slab indegree;
 	struct author_date_slab author_date;
+
+	/* Only used for "--ancestry-path" */
+	struct ancestry_path_slab ancestry_path;
+	timestamp_t min_bottom_generation;
+	timestamp_t max_bottom_generation;
 };
 
 static int topo_walk_atexit_registered;
@@ -3826,6 +4018,7 @@ static void release_revisions_topo_walk_info(struct topo_walk_info *info)
 	clear_prio_queue(&info->topo_queue);
 	clear_indegree_slab(&info->indegree);
 	clear_author_date_slab(&info->author_date);
+	clear_ancestry_path_slab(&info->ancestry_path);
 	free(info);
 }
 
@@ -3868,6 +4061,20 @@ static void init_topo_walk(struct rev_info *revs)
 	info->explore_queue.compare = compare_commits_by_gen_then_commit_date;
 	info->indegree_queue.compare = compare_commits_by_gen_then_commit_date;
 
+	if (revs->ancestry_path) {
+		init_ancestry_path_slab(&info->ancestry_path);
+		info->min_bottom_generation = GENERATION_NUMBER_INFINITY;
+		info->max_bottom_generation = 0;
+		for (list = revs->ancestry_path_bottoms; list; list = list->next) {
+			timestamp_t generation = commit_graph_generation(list->item);
+
+			if (generation < info->min_bottom_generation)
+				info->min_bottom_generation = generation;
+			if (generation > info->max_bottom_generation)
+				info->max_bottom_generation = generation;
+		}
+	}
+
 	info->min_generation = GENERATION_NUMBER_INFINITY;
 	for (list = revs->commits; list; list = list->next) {
 		struct commit *c = list->item;
@@ -3964,6 +4171,140 @@ static void expand_topo_walk(struct rev_info *revs, struct commit *commit)
 	}
 }
 
+/*
+ * Return the ancestry-path state of "c" if it can be decided without
+ * looking at its parents, ANCESTRY_PATH_UNKNOWN otherwise.
+ */
+static enum ancestry_path_state ancestry_path_state_of(struct rev_info *revs,
+						       struct commit *c)
+{
+	struct topo_walk_info *info = revs->topo_walk_info;
+	unsigned char *state = ancestry_path_slab_at(&info->ancestry_path, c);
+	timestamp_t generation;
+
+	if (*state)
+		return *state;
+	if (c->object.flags & BOTTOM)
+		return *state = ANCESTRY_PATH_ON;
+	if (repo_parse_commit_gently(revs->repo, c, 1) < 0)
+		return *state = ANCESTRY_PATH_OFF;
+
+	/* Only descendants of a bottom commit can lead to it. */
+	generation = commit_graph_generation(c);
+	if (generation <= info->min_bottom_generation)
+		return *state = ANCESTRY_PATH_OFF;
+
+	/*
+	 * Paths through UNINTERESTING commits do not count, just like in
+	 * limit_to_ancestry(). Only ancestors of the bottom commits can be
+	 * UNINTERESTING, and the explore walk has to get to "c" before we
+	 * can trust its flags.
+	 */
+	if (generation < info->max_bottom_generation)
+		explore_to_depth(revs, generation);
+	if (c->object.flags & UNINTERESTING)
+		return *state = ANCESTRY_PATH_OFF;
+
+	return ANCESTRY_PATH_UNKNOWN;
+}
+
+struct ancestry_path_frame {
+	struct commit *commit;
+	struct commit_list *parents;
+};
+
+/*
+ * Return whether "commit" leads to one of the bottom commits through
+ * commits that are not UNINTERESTING. The answers are remembered, so all
+ * the calls during a walk look at each commit at most once.
+ */
+static int ancestry_path_reaches_bottom(struct rev_info *revs,
+					struct commit *commit)
+{
+	struct topo_walk_info *info = revs->topo_walk_info;
+	struct ancestry_path_frame *stack = NULL;
+	size_t nr = 0, alloc = 0;
+	enum ancestry_path_state state;
+
+	state = ancestry_path_state_of(revs, commit);
+	if (state != ANCESTRY_PATH_UNKNOWN)
+		return state == ANCESTRY_PATH_ON;
+
+	ALLOC_GROW(stack, nr + 1, alloc);
+	stack[nr].commit = commit;
+	stack[nr++].parents = commit->parents;
+
+	while (nr) {
+		struct ancestry_path_frame *top = &stack[nr - 1];
+		struct commit *parent;
+
+		if (!top->parents) {
+			*ancestry_path_slab_at(&info->ancestry_path, top->commit) =
+				ANCESTRY_PATH_OFF;
+			nr--;
+			continue;
+		}
+
+		parent = top->parents->item;
+		top->parents = top->parents->next;
+
+		state = ancestry_path_state_of(revs, parent);
+		if (state == ANCESTRY_PATH_ON) {
+			/* everything on the stack leads to "parent" */
+			while (nr)
+				*ancestry_path_slab_at(&info->ancestry_path,
+						       stack[--nr].commit) =
+					ANCESTRY_PATH_ON;
+		} else if (state == ANCESTRY_PATH_UNKNOWN) {
+			ALLOC_GROW(stack, nr + 1, alloc);
+			stack[nr].commit = parent;
+			stack[nr++].parents = parent->parents;
+		}
+	}
+
+	free(stack);
+	return *ancestry_path_slab_at(&info->ancestry_path, commit) ==
+		ANCESTRY_PATH_ON;
+}
+
+/*
+ * Mark a commit that does not lead to a bottom commit as UNINTERESTING.
+ * None of its parents can lead to one either, and marking them as well
+ * keeps "--graph --boundary" from drawing edges to them.
+ */
+static void mark_off_ancestry_path(struct commit *commit)
+{
+	struct commit_list *p;
+
+	commit->object.flags |= UNINTERESTING;
+	for (p = commit->parents; p; p = p->next)
+		p->item->object.flags |= UNINTERESTING;
+}
+
+/*
+ * The streaming counterpart of limit_to_ancestry(): mark "commit" as
+ * UNINTERESTING if it does not lead to a bottom commit. Its parents are
+ * decided right away, too, so that they already look UNINTERESTING when
+ * "commit" is shown, e.g. to decide which edges "--graph" draws.
+ */
+static void limit_topo_walk_to_ancestry(struct rev_info *revs,
+					struct commit *commit)
+{
+	struct commit_list *p;
+
+	if (commit->object.flags & UNINTERESTING)
+		return;
+
+	if (!ancestry_path_reaches_bottom(revs, commit)) {
+		mark_off_ancestry_path(commit);
+		return;
+	}
+
+	for (p = commit->parents; p; p = p->next)
+		if (!ancestry_path_reaches_bottom(revs, p->item))
+			mark_off_ancestry_path(p->item);
+}
+
 void rev_info_commit_list_to_queue(struct rev_info *revs)
 {
 	while (revs->commits)
@@ -4002,12 +4343,18 @@ int prepare_revision_walk(struct rev_info *revs)
 		odb_for_each_object(revs->repo->objects, NULL, mark_uninteresting,
 				    revs, ODB_FOR_EACH_OBJECT_PROMISOR_ONLY);
 
-	if (!revs->reflog_info)
+	if (!revs->reflog_info) {
+		prepare_to_use_changed_path_lists(revs);
 		prepare_to_use_bloom_filter(revs);
+	}
 	if (!revs->unsorted_input)
 		commit_list_sort_by_date(&revs->commits);
 	if (revs->no_walk)
 		return 0;
+	if (revs->ancestry_path && !revs->limited &&
+	    (!ancestry_path_can_stream(revs) ||
+	     collect_ancestry_path_bottoms(revs) < 0))
+		revs->limited = 1;
 	if (revs->limited) {
 		if (limit_list(revs) < 0)
 			return -1;
@@ -4032,6 +4379,75 @@ int prepare_revision_walk(struct rev_info *revs)
 	return 0;
 }
 
+/*
+ * Whether the commits of the walk only need to be counted, and every
+ * commit reachable from the starting points counts.
+ */
+static int only_counting_reachable(struct rev_info *revs)
+{
+	return revs->count &&
+		!revs->tag_objects && !revs->tree_objects && !revs->blob_objects &&
+		!revs->left_right && !revs->left_only && !revs->right_only &&
+		!revs->cherry_mark && !revs->cherry_pick &&
+		!revs->prune_data.nr && !revs->reflog_info &&
+		!revs->no_walk && !revs->boundary && !revs->bisect &&
+		!revs->ancestry_path && !revs->simplify_by_decoration &&
+		!revs->line_level_traverse && !revs->maximal_only &&
+		!revs->unpacked && !revs->no_kept_objects &&
+		!revs->exclude_promisor_objects && !revs->filter.choice &&
+		revs->max_count < 0 && revs->skip_count < 0 &&
+		revs->max_age == -1 && revs->max_age_as_filter == -1 &&
+		revs->min_age == -1 &&
+		!revs->min_parents && revs->max_parents == -1 &&
+		!revs->include_check && !revs->include_check_obj &&
+		!revs->grep_filter.pattern_list && !revs->grep_filter.header_list;
+}
+
+int count_revisions_in_graph(struct rev_info *revs)
+{
+	struct commit **include = NULL, **exclude = NULL;
+	size_t include_nr = 0, include_alloc = 0;
+	size_t exclude_nr = 0, exclude_alloc = 0;
+	enum count_walk_flags flags = 0;
+	uint32_t count;
+	int ret = -1;
+
+	if (!only_counting_reachable(revs))
+		return -1;
+
+	for (size_t i = 0; i < revs->pending.nr; i++) {
+		struct object *obj = revs->pending.objects[i].item;
+		unsigned uninteresting = obj->flags & UNINTERESTING;
+
+		obj = deref_tag(revs->repo, obj, NULL, 0);
+		if (!obj || obj->type != OBJ_COMMIT)
+			goto out;
+
+		if (uninteresting) {
+			ALLOC_GROW(exclude, exclude_nr + 1, exclude_alloc);
+			exclude[exclude_nr++] = (struct commit *)obj;
+		} else {
+			ALLOC_GROW(include, include_nr + 1, include_alloc);
+			include[include_nr++] = (struct commit *)obj;
+		}
+	}
+
+	if (revs->first_parent_only)
+		flags |= COUNT_WALK_FIRST_PARENT_ONLY;
+	if (revs->exclude_first_parent_only)
+		flags |= COUNT_WALK_EXCLUDE_FIRST_PARENT_ONLY;
+
+	ret = commit_graph_count_reachable(revs->repo, include, include_nr,
+					   exclude, exclude_nr, flags, &count);
+	if (!ret)
+		revs->count_right = count;
+
+out:
+	free(include);
+	free(exclude);
+	return ret;
+}
+
 static enum rewrite_result rewrite_one_1(struct rev_info *revs,
 					 struct commit **pp,
 					 struct prio_queue *queue)
@@ -4420,6 +4836,8 @@ static struct commit *get_revision_1(struct rev_info *revs)
 			break;
 		case REV_WALK_TOPO:
 			expand_topo_walk(revs, commit);
+			if (revs->ancestry_path)
+				limit_topo_walk_to_ancestry(revs, commit);
 			break;
 		case REV_WALK_STREAMING:
 			if (process_parents(revs, commit,
@@ -382,6 +382,12 @@ struct rev_info {
 	 */
 	struct bloom_filter_settings *bloom_filter_settings;
 
+	/*
+	 * Whether the changed-path lists of the commit-graph can tell if a
+	 * commit is TREESAME to its first parent.
+	 */
+	unsigned use_changed_path_lists:1;
+
 	/* misc. flags related to '--no-kept-objects' */
 	unsigned keep_pack_cache_flags;
 
@@ -489,6 +495,16 @@ void reset_revision_walk(void);
  */
 int prepare_revision_walk(struct rev_info *revs);
 
+/**
+ * If all the walk is asked to do is counting the commits (as for "git
+ * rev-list --count"), count them directly from the commit-graph without
+ * instantiating the commits that are walked, and store the result in
+ * `count_right`. Call this instead of prepare_revision_walk(). Returns -1
+ * if the walk needs more than that, or the commits are not all in the
+ * commit-graph, in which case the caller has to walk the usual way.
+ */
+int count_revisions_in_graph(struct rev_info *revs);
+
 /* Drain the commits linked list into the priority queue. */
 void rev_info_commit_list_to_queue(struct rev_info *revs);
 /**
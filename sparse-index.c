@@ -10,6 +10,7 @@
 #include "repository.h"
 #include "sparse-index.h"
 #include "tree.h"
+#include "tree-walk.h"
 #include "pathspec.h"
 #include "trace2.h"
 #include "cache-tree.h"
@@ -466,6 +467,78 @@ void ensure_full_index(struct index_state *istate)
 	expand_index(istate, NULL);
 }
 
+int expand_sparse_directory(struct index_state *istate, int pos)
+{
+	struct cache_entry *dir = istate->cache[pos];
+	struct cache_entry **entries = NULL;
+	size_t i, nr = 0, alloc = 0;
+	struct strbuf name = STRBUF_INIT;
+	struct tree_desc desc;
+	struct name_entry entry;
+	struct tree *tree;
+	int ret = 0;
+
+	if (!S_ISSPARSEDIR(dir->ce_mode))
+		BUG("not a sparse directory: '%s'", dir->name);
+
+	tree = lookup_tree(istate->repo, &dir->oid);
+	if (!tree || parse_tree(tree))
+		return -1;
+
+	trace2_region_enter("index", "expand_sparse_directory", istate->repo);
+
+	init_tree_desc(&desc, &tree->object.oid, tree->buffer, tree->size);
+	while (tree_entry(&desc, &entry)) {
+		struct cache_entry *ce;
+
+		strbuf_reset(&name);
+		strbuf_add(&name, dir->name, ce_namelen(dir));
+		strbuf_addstr(&name, entry.path);
+		if (S_ISDIR(entry.mode))
+			strbuf_addch(&name, '/');
+
+		ce = make_cache_entry(istate, entry.mode, &entry.oid,
+				      name.buf, 0, 0);
+		if (!ce) {
+			ret = -1;
+			goto done;
+		}
+		ce->ce_flags |= CE_SKIP_WORKTREE | CE_EXTENDED;
+
+		ALLOC_GROW(entries, nr + 1, alloc);
+		entries[nr++] = ce;
+	}
+
+	/* Replace the directory entry with its contents, in tree order. */
+	ALLOC_GROW(istate->cache, istate->cache_nr + nr, istate->cache_alloc);
+	MOVE_ARRAY(istate->cache + pos + nr, istate->cache + pos + 1,
+		   istate->cache_nr - pos - 1);
+	istate->cache_nr = istate->cache_nr + nr - 1;
+	remove_name_hash(istate, dir);
+	for (i = 0; i < nr; i++) {
+		istate->cache[pos + i] = entries[i];
+		add_name_hash(istate, entries[i]);
+	}
+	nr = 0;
+
+	/* The entry counts of the enclosing trees have changed. */
+	cache_tree_invalidate_path(istate, dir->name);
+	discard_cache_entry(dir);
+
+	istate->sparse_index = INDEX_PARTIALLY_SPARSE;
+	istate->cache_changed |= CE_ENTRY_REMOVED | CE_ENTRY_ADDED;
+	ewah_free(istate->fsmonitor_dirty);
+	istate->fsmonitor_dirty = NULL;
+
+done:
+	for (i = 0; i < nr; i++)
+		discard_cache_entry(entries[i]);
+	free(entries);
+	strbuf_release(&name);
+	trace2_region_leave("index", "expand_sparse_directory", istate->repo);
+	return ret;
+}
+
 void ensure_correct_sparsity(struct index_state *istate)
 {
 	/*
@@ -740,10 +813,17 @@ void expand_to_path(struct index_state *istate,
 			 * hashtable, because only sparse directory entries
 			 * have a trailing '/' character.  Since "path" wasn't
 			 * in the index, perhaps it exists within this
-			 * sparse-directory.  Expand accordingly.
+			 * sparse-directory.  Expand just that directory and
+			 * keep looking for deeper ones among its contents.
 			 */
-			ensure_full_index(istate);
-			break;
+			int pos = index_name_pos_sparse(istate,
+							path_mutable.buf,
+							substr_len);
+
+			if (pos < 0 || expand_sparse_directory(istate, pos)) {
+				ensure_full_index(istate);
+				break;
+			}
 		}
 
 		*replace = temp;
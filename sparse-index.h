@@ -15,6 +15,16 @@ int convert_to_sparse(struct index_state *istate, int flags);
 void ensure_correct_sparsity(struct index_state *istate);
 void clear_skip_worktree_from_present_files(struct index_state *istate);
 
+/*
+ * Replace the sparse directory entry at position 'pos' with the
+ * entries of its tree: files become skip-worktree entries and
+ * subdirectories become sparse directory entries of their own.
+ *
+ * Returns 0 on success, or -1 if the tree could not be read, in which
+ * case the index is left unchanged.
+ */
+int expand_sparse_directory(struct index_state *istate, int pos);
+
 /*
  * Some places in the codebase expect to search for a specific path.
  * This path might be outside of the sparse-checkout definition, in
@@ -22,8 +32,9 @@ void clear_skip_worktree_from_present_files(struct index_state *istate);
  *
  * Given an index and a path, check to see if a leading directory for
  * 'path' exists in the index as a sparse directory. In that case,
- * expand that sparse directory to a full range of cache entries and
- * populate the index accordingly.
+ * expand that sparse directory (and any sparse directories below it
+ * that lead to 'path') into cache entries and populate the index
+ * accordingly. The rest of the index stays sparse.
  */
 void expand_to_path(struct index_state *istate,
 		    const char *path, size_t pathlen, int icase);
@@ -1395,6 +1395,38 @@ test_expect_success 'sort by custom date format' '
 	test_cmp expected actual
 '
 
+test_expect_success 'sort by date with commit-graph' '
+	test_when_finished "rm -rf graph-dates" &&
+	git init graph-dates &&
+	(
+		cd graph-dates &&
+		for when in 1707341660 945129922 1622806011 1169484241
+		do
+			GIT_COMMITTER_DATE="@$when +0000" \
+			git commit --allow-empty -m "commit $when" &&
+			git branch "branch-$when" &&
+			GIT_COMMITTER_DATE="@$when +0000" \
+			git tag -m "tag $when" "tag-$when" || return 1
+		done &&
+		for sort in committerdate -committerdate creatordate -creatordate \
+			    "committerdate:format:%H:%M:%S"
+		do
+			${git_for_each_ref} --format="%(creatordate:unix) %(refname)" \
+				--sort="$sort" >expect &&
+			${git_for_each_ref} --format="%(refname)" --count=3 \
+				--sort="$sort" >expect.count &&
+			git commit-graph write --reachable &&
+			${git_for_each_ref} --format="%(creatordate:unix) %(refname)" \
+				--sort="$sort" >actual &&
+			${git_for_each_ref} --format="%(refname)" --count=3 \
+				--sort="$sort" >actual.count &&
+			rm -f .git/objects/info/commit-graph &&
+			test_cmp expect actual &&
+			test_cmp expect.count actual.count || return 1
+		done
+	)
+'
+
 test_expect_success 'do not dereference NULL upon %(HEAD) on unborn branch' '
 	test_when_finished "git checkout main" &&
 	${git_for_each_ref} --format="%(HEAD) %(refname:short)" refs/heads/ >actual &&
@@ -0,0 +1,56 @@
+/*
+ * test-tool batch-lstat <path>...
+ *
+ * lstat() the given paths through compat/batch-lstat.h and check that
+ * the results agree with plain lstat(). Exits with status 2 if batched
+ * lstat() is not available in this build or on this kernel.
+ */
+#include "test-tool.h"
+#include "git-compat-util.h"
+#include "compat/batch-lstat.h"
+
+int cmd__batch_lstat(int argc, const char **argv)
+{
+	struct batch_lstat *b = batch_lstat_init();
+	struct stat *st;
+	int *err, ret = 0;
+	unsigned int max, nr, left;
+
+	if (!b)
+		return 2;
+
+	argv++;
+	left = argc - 1;
+	max = batch_lstat_size(b);
+	ALLOC_ARRAY(st, max);
+	ALLOC_ARRAY(err, max);
+	while (left) {
+		nr = left < max ? left : max;
+		if (batch_lstat(b, argv, st, err, nr))
+			die("batch_lstat() failed");
+		for (unsigned int i = 0; i < nr; i++) {
+			struct stat expect;
+			int expect_err = lstat(argv[i], &expect) ? errno : 0;
+
+			if (err[i] != expect_err) {
+				error("%s: got error %d, expected %d",
+				      argv[i], err[i], expect_err);
+				ret = 1;
+			} else if (!err[i] &&
+				   (st[i].st_mode != expect.st_mode ||
+				    st[i].st_size != expect.st_size ||
+				    st[i].st_ino != expect.st_ino ||
+				    st[i].st_mtime != expect.st_mtime)) {
+				error("%s: stat data differs", argv[i]);
+				ret = 1;
+			}
+		}
+		argv += nr;
+		left -= nr;
+	}
+
+	free(st);
+	free(err);
+	batch_lstat_release(b);
+	return ret;
+}
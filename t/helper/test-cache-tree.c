@@ -12,7 +12,7 @@
 #include "setup.h"
 
 static char const * const test_cache_tree_usage[] = {
-	N_("test-tool cache-tree <options> (control|prime|update)"),
+	N_("test-tool cache-tree <options> (control|prime|update|write)"),
 	NULL
 };
 
@@ -63,6 +63,8 @@ int cmd__cache_tree(int argc, const char **argv)
 		prime_cache_tree(the_repository, the_repository->index, tree);
 	else if (!strcmp(argv[0], "update"))
 		cache_tree_update(the_repository->index, WRITE_TREE_SILENT | WRITE_TREE_REPAIR);
+	else if (!strcmp(argv[0], "write"))
+		cache_tree_update(the_repository->index, WRITE_TREE_SILENT);
 	/* use "control" subcommand to specify no-op */
 	else if (!!strcmp(argv[0], "control"))
 		die(_("Unhandled subcommand '%s'"), argv[0]);
@@ -34,6 +34,10 @@ static void dump_graph_info(struct commit_graph *graph)
 		printf(" bloom_indexes");
 	if (graph->chunk_bloom_data)
 		printf(" bloom_data");
+	if (graph->chunk_reachability_index)
+		printf(" reachability_index");
+	if (graph->chunk_path_list_index)
+		printf(" changed_path_lists");
 	printf("\n");
 
 	printf("options:");
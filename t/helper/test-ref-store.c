@@ -1,6 +1,8 @@
 #define USE_THE_REPOSITORY_VARIABLE
 
 #include "test-tool.h"
+#include "config.h"
+#include "environment.h"
 #include "hex.h"
 #include "refs.h"
 #include "setup.h"
@@ -10,6 +12,7 @@
 #include "repository.h"
 #include "strbuf.h"
 #include "revision.h"
+#include "run-command.h"
 
 struct flag_definition {
 	const char *name;
@@ -170,6 +173,36 @@ static int cmd_for_each_ref(struct ref_store *refs, const char **argv)
 	return refs_for_each_ref_ext(refs, each_ref, NULL, &opts);
 }
 
+/*
+ * Iterate the refs, run a shell command and iterate them again from
+ * within the same process, like a long-running process would.
+ */
+static int cmd_for_each_ref__repeat(struct ref_store *refs, const char **argv)
+{
+	const char *prefix = notnull(*argv++, "prefix");
+	const char *command = notnull(*argv++, "command");
+	struct child_process cp = CHILD_PROCESS_INIT;
+	struct refs_for_each_ref_options opts = {
+		.prefix = prefix,
+		.trim_prefix = strlen(prefix),
+	};
+	int ret;
+
+	repo_config(the_repository, git_default_config, NULL);
+
+	ret = refs_for_each_ref_ext(refs, each_ref, NULL, &opts);
+	if (ret)
+		return ret;
+
+	cp.use_shell = 1;
+	strvec_push(&cp.args, command);
+	if (run_command(&cp))
+		die("command failed: %s", command);
+
+	printf("--\n");
+	return refs_for_each_ref_ext(refs, each_ref, NULL, &opts);
+}
+
 static int cmd_for_each_ref__exclude(struct ref_store *refs, const char **argv)
 {
 	const char *prefix = notnull(*argv++, "prefix");
@@ -318,6 +351,7 @@ static struct command commands[] = {
 	{ "rename-ref", cmd_rename_ref },
 	{ "for-each-ref", cmd_for_each_ref },
 	{ "for-each-ref--exclude", cmd_for_each_ref__exclude },
+	{ "for-each-ref--repeat", cmd_for_each_ref__repeat },
 	{ "resolve-ref", cmd_resolve_ref },
 	{ "verify-ref", cmd_verify_ref },
 	{ "for-each-reflog", cmd_for_each_reflog },
@@ -11,6 +11,7 @@ static const char * const test_tool_usage[] = {
 
 static struct test_cmd cmds[] = {
 	{ "advise", cmd__advise_if_enabled },
+	{ "batch-lstat", cmd__batch_lstat },
 	{ "bitmap", cmd__bitmap },
 	{ "bloom", cmd__bloom },
 	{ "bundle-uri", cmd__bundle_uri },
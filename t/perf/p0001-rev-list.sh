@@ -45,4 +45,16 @@ test_perf 'rev-list --objects $commit --not --all' '
 	git rev-list --objects $commit --not --all >/dev/null
 '
 
+test_expect_success 'write commit-graph' '
+	git commit-graph write --reachable
+'
+
+test_perf 'rev-list --count --all (commit-graph)' '
+	git rev-list --count --all
+'
+
+test_perf 'rev-list --count --all (no commit-graph)' '
+	git -c core.commitGraph=false rev-list --count --all
+'
+
 test_done
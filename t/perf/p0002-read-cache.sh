@@ -11,4 +11,29 @@ test_perf "read_cache/discard_cache $count times" "
 	test-tool read-cache $count
 "
 
+test_expect_success 'setup for the index entry lookup table' '
+	git update-index --index-version 2 &&
+	git ls-files | sed -n "\$p" >path
+'
+
+test_perf "ls-files" "
+	git ls-files >/dev/null
+"
+
+test_perf "rev-parse :<path>" "
+	git rev-parse \":\$(cat path)\" >/dev/null
+"
+
+test_expect_success 'write the index with a lookup table' '
+	git -c index.recordLookupTable=true update-index --force-write-index
+'
+
+test_perf "ls-files (lookup table)" "
+	git ls-files >/dev/null
+"
+
+test_perf "rev-parse :<path> (lookup table)" "
+	git rev-parse \":\$(cat path)\" >/dev/null
+"
+
 test_done
@@ -26,11 +26,19 @@ test_cache_tree_update_functions () {
 	test_cache_tree 'no-op' 'control' "$1" "$2"
 	test_cache_tree 'prime_cache_tree' 'prime' "$1" "$2"
 	test_cache_tree 'cache_tree_update' 'update' "$1" "$2"
+	test_cache_tree 'cache_tree_update (write)' 'write' "$1" "$2"
 }
 
-test_cache_tree_update_functions "clean" ""
-test_cache_tree_update_functions "invalidate 2" "--invalidate 2"
-test_cache_tree_update_functions "invalidate 50" "--invalidate 50"
-test_cache_tree_update_functions "empty" "--empty"
+for threads in 1 0
+do
+	test_expect_success "index.threads=$threads" "
+		git config index.threads $threads
+	"
+
+	test_cache_tree_update_functions "clean, index.threads=$threads" ""
+	test_cache_tree_update_functions "invalidate 2, index.threads=$threads" "--invalidate 2"
+	test_cache_tree_update_functions "invalidate 50, index.threads=$threads" "--invalidate 50"
+	test_cache_tree_update_functions "empty, index.threads=$threads" "--empty"
+done
 
 test_done
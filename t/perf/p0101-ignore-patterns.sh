@@ -0,0 +1,53 @@
+#!/bin/sh
+
+test_description="Tests performance of matching long lists of ignore patterns"
+
+. ./perf-lib.sh
+
+test_perf_fresh_repo
+
+test_expect_success 'setup' '
+	for d in $(test_seq 50)
+	do
+		mkdir dir$d &&
+		for f in $(test_seq 50)
+		do
+			>dir$d/file$f.c &&
+			>dir$d/file$f.o || return 1
+		done || return 1
+	done &&
+	git add "*.c" &&
+	git commit -q -m files &&
+
+	# a generated ignore file of mostly literal names and paths
+	for i in $(test_seq 5000)
+	do
+		echo "generated$i" &&
+		echo "/dir$((i % 50))/output$i" &&
+		echo "*.gen$i" &&
+		echo "build$i/" || return 1
+	done >.gitignore &&
+	echo "*.o" >>.gitignore &&
+	echo "dir*/tmp-*" >>.gitignore
+'
+
+for min in 1000000 32
+do
+	if test $min = 32
+	then
+		desc="with lookup tables"
+	else
+		desc="without lookup tables"
+	fi
+
+	test_perf "status --ignored, $desc" "
+		GIT_TEST_PATTERN_INDEX_MIN=$min git status --ignored >/dev/null
+	"
+
+	test_perf "ls-files -o --exclude-standard, $desc" "
+		GIT_TEST_PATTERN_INDEX_MIN=$min \
+			git ls-files -o --exclude-standard >/dev/null
+	"
+done
+
+test_done
@@ -14,7 +14,13 @@ test_expect_success "setup" '
 		printf "start\ncreate refs/heads/%d PRE\ncommit\n" $i &&
 		printf "start\nupdate refs/heads/%d POST PRE\ncommit\n" $i &&
 		printf "start\ndelete refs/heads/%d POST\ncommit\n" $i || return 1
-	done >instructions
+	done >instructions &&
+	for i in $(test_seq 20000)
+	do
+		printf "create refs/heads/large/%d PRE\n" $i || return 1
+	done >large-create &&
+	sed -e "s/^create \(.*\) PRE$/update \1 POST PRE/" <large-create >large-update &&
+	sed -e "s/^create \(.*\) PRE$/delete \1 POST/" <large-create >large-delete
 '
 
 test_perf "update-ref" '
@@ -30,4 +36,17 @@ test_perf "update-ref --stdin" '
 	git update-ref --stdin <instructions >/dev/null
 '
 
+# Set GIT_TEST_FSYNC=1 explicitly since fsync is normally disabled by
+# the test framework.
+for method in fsync batch
+do
+	test_perf "update-ref --stdin, large transaction (fsyncMethod=$method)" \
+		--setup "git update-ref --stdin <large-delete 2>/dev/null || :" "
+		GIT_TEST_FSYNC=1 git -c core.fsync=reference \
+			-c core.fsyncMethod=$method update-ref --stdin <large-create &&
+		GIT_TEST_FSYNC=1 git -c core.fsync=reference \
+			-c core.fsyncMethod=$method update-ref --stdin <large-update
+	"
+done
+
 test_done
@@ -35,13 +35,20 @@ test_expect_success 'setup' '
 	commit=$(git commit-tree $(git rev-parse HEAD^{tree})) &&
 	git update-ref refs/heads/disjoint-base $commit &&
 
-	git commit-graph write --reachable
+	git commit-graph write --reachable &&
+	git -c core.aheadBehindCache=true for-each-ref \
+		--format="%(ahead-behind:HEAD)" --stdin <refs
 '
 
 test_perf 'ahead-behind counts: git for-each-ref' '
 	git for-each-ref --format="%(ahead-behind:HEAD)" --stdin <refs
 '
 
+test_perf 'ahead-behind counts: git for-each-ref (cached)' '
+	git -c core.aheadBehindCache=true for-each-ref \
+		--format="%(ahead-behind:HEAD)" --stdin <refs
+'
+
 test_perf 'ahead-behind counts: git branch' '
 	xargs git branch -l --format="%(ahead-behind:HEAD)" <branches
 '
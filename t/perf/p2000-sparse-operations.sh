@@ -109,6 +109,7 @@ test_perf_on_all () {
 test_perf_on_all git status
 test_perf_on_all 'git stash && git stash pop'
 test_perf_on_all 'echo >>new && git stash -u && git stash pop'
+test_perf_on_all "echo >>$SPARSE_CONE/a && git stash push -- $SPARSE_CONE/a && git stash pop"
 test_perf_on_all git add -A
 test_perf_on_all git add .
 test_perf_on_all git commit -a -m A
@@ -125,6 +126,7 @@ test_perf_on_all git read-tree -mu HEAD
 test_perf_on_all git checkout-index -f --all
 test_perf_on_all git update-index --add --remove $SPARSE_CONE/a
 test_perf_on_all "git rm -f $SPARSE_CONE/a && git checkout HEAD -- $SPARSE_CONE/a"
+test_perf_on_all "git checkout HEAD~1 -- f2/f1/a && git reset --hard"
 test_perf_on_all git grep --cached bogus -- "f2/f1/f1/*"
 test_perf_on_all git write-tree
 test_perf_on_all git describe --dirty
@@ -68,6 +68,8 @@ run_tests () {
 	test_for_each_ref "$1, tags, no sort" --no-sort refs/tags/
 	test_for_each_ref "$1, tags, dereferenced" '--format="%(refname) %(objectname) %(*objectname)"' refs/tags/
 	test_for_each_ref "$1, tags, dereferenced, no sort" --no-sort '--format="%(refname) %(objectname) %(*objectname)"' refs/tags/
+	test_for_each_ref "$1, branches, sort by committerdate" --sort=-committerdate refs/heads/
+	test_for_each_ref "$1, branches, sort by committerdate, --count=10" --sort=-committerdate --count=10 refs/heads/
 
 	test_perf "for-each-ref ($1, tags) + cat-file --batch-check (dereferenced)" "
 		for i in \$(test_seq $test_iteration_count); do
@@ -84,4 +86,9 @@ test_expect_success 'pack refs' '
 '
 run_tests "packed"
 
+test_expect_success 'write commit-graph' '
+	git commit-graph write --reachable
+'
+run_tests "packed, commit-graph"
+
 test_done
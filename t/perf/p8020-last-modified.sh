@@ -19,4 +19,20 @@ test_perf 'subdir last-modified' '
 	git last-modified -r HEAD -- "$path"
 '
 
+test_perf 'top-level recursive last-modified with threads' '
+	git -c lastModified.threads=0 last-modified -r HEAD
+'
+
+test_expect_success 'fill the last-modified cache' '
+	git -c lastModified.cache=true last-modified -r HEAD >/dev/null
+'
+
+test_perf 'top-level recursive last-modified from the cache' '
+	git -c lastModified.cache=true last-modified -r HEAD
+'
+
+test_expect_success 'remove the last-modified cache' '
+	rm -rf "$(git rev-parse --git-dir)/last-modified-cache"
+'
+
 test_done
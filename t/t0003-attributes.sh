@@ -664,6 +664,45 @@ test_expect_success 'user defined builtin_objectmode values are ignored' '
 	test_cmp expect err
 '
 
+test_expect_success 'long attributes files match like short ones' '
+	test_when_finished "rm -rf long" &&
+	mkdir -p long/sub &&
+	(
+		cd long &&
+		for i in $(test_seq 20)
+		do
+			echo "name$i n$i" &&
+			echo "*.ext$i e$i" &&
+			echo "/sub/path$i p$i" &&
+			echo "dir$i/ d$i" || return 1
+		done >.gitattributes &&
+		cat >>.gitattributes <<-\EOF &&
+		[attr]both n1 e1
+		name1 -n1 both
+		*.ext1 e1=later
+		sub/* s
+		n?me* q
+		EOF
+		echo "*.ext2 -e2 inner" >sub/.gitattributes &&
+		for path in name1 name2 sub/name3 a.ext1 sub/b.ext2 c.ext15 \
+			    sub/path1 path1 sub/sub/path2 dir1/ sub/dir2/ dir3 \
+			    other NAME1 A.EXT1
+		do
+			echo "$path" || return 1
+		done >paths &&
+		GIT_TEST_ATTR_INDEX_MIN=1000 git check-attr --stdin -a \
+			<paths >expect &&
+		GIT_TEST_ATTR_INDEX_MIN=1 git check-attr --stdin -a \
+			<paths >actual &&
+		test_cmp expect actual &&
+		GIT_TEST_ATTR_INDEX_MIN=1000 git -c core.ignoreCase=true \
+			check-attr --stdin -a <paths >expect &&
+		GIT_TEST_ATTR_INDEX_MIN=1 git -c core.ignoreCase=true \
+			check-attr --stdin -a <paths >actual &&
+		test_cmp expect actual
+	)
+'
+
 test_expect_success ULIMIT_STACK_SIZE 'deep macro recursion' '
 	n=3000 &&
 	{
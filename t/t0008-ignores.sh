@@ -955,6 +955,48 @@ test_expect_success SYMLINKS 'symlinks not respected in-tree' '
 	test_grep "unable to access.*gitignore" err
 '
 
+test_expect_success 'long pattern lists match like short ones' '
+	test_when_finished "rm -rf long" &&
+	mkdir -p long/sub/deep &&
+	(
+		cd long &&
+		for i in $(test_seq 20)
+		do
+			echo "name$i" &&
+			echo "*.ext$i" &&
+			echo "/sub/path$i" &&
+			echo "sub/deep/file$i" &&
+			echo "dir$i/" || return 1
+		done >.gitignore &&
+		cat >>.gitignore <<-\EOF &&
+		!name3
+		!/sub/path4
+		n?me7*
+		sub/**/glob*
+		*.ext1
+		!*.ext2
+		EOF
+		mkdir dir1 sub/dir2 &&
+		for path in name1 name3 name7x sub/name20 a.ext1 b.ext2 sub/c.ext15 \
+			    sub/path1 sub/path4 path1 sub/sub/path2 sub/deep/file5 \
+			    deep/file5 dir1 sub/dir2 dir3 sub/deep/glob.c glob.c \
+			    other sub/other NAME1
+		do
+			echo "$path" || return 1
+		done >paths &&
+		GIT_TEST_PATTERN_INDEX_MIN=1000 git check-ignore -v -n \
+			--stdin <paths >expect &&
+		GIT_TEST_PATTERN_INDEX_MIN=1 git check-ignore -v -n \
+			--stdin <paths >actual &&
+		test_cmp expect actual &&
+		GIT_TEST_PATTERN_INDEX_MIN=1000 git -c core.ignoreCase=true \
+			check-ignore -v -n --stdin <paths >expect &&
+		GIT_TEST_PATTERN_INDEX_MIN=1 git -c core.ignoreCase=true \
+			check-ignore -v -n --stdin <paths >actual &&
+		test_cmp expect actual
+	)
+'
+
 test_expect_success EXPENSIVE 'large exclude file ignored in tree' '
 	test_when_finished "rm .gitignore" &&
 	find . -name .gitignore -exec rm "{}" ";" &&
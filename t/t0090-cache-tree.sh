@@ -286,4 +286,31 @@ test_expect_success 'cache-tree is used by write-tree when valid' '
 	test_grep ! region_enter.*cache_tree.*update trace.output
 '
 
+test_expect_success 'cache-tree update with threads' '
+	test_when_finished "rm -f trace.event expect actual dump" &&
+	rm -f trace.output &&
+	for d in a b c d
+	do
+		mkdir -p threads/$d/sub &&
+		echo $d >threads/$d/file &&
+		echo $d >threads/$d/sub/file || return 1
+	done &&
+	git add threads &&
+	git -c index.threads=1 write-tree >expect &&
+
+	git read-tree HEAD &&
+	git add threads &&
+	GIT_TRACE2_EVENT="$(pwd)/trace.event" \
+		git -c index.threads=4 write-tree >actual &&
+	test_cmp expect actual &&
+	test_region cache_tree parallel trace.event &&
+
+	git read-tree HEAD &&
+	git add threads &&
+	git -c index.threads=4 commit -m threads &&
+	test-tool dump-cache-tree >dump &&
+	test_grep ! "^invalid" dump &&
+	test_grep " threads/a/sub/ (1 entries, 0 subtrees)" dump
+'
+
 test_done
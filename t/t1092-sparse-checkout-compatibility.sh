@@ -547,6 +547,19 @@ test_expect_success 'checkout and reset --hard' '
 	test_all_match git reset --hard update-folder2
 '
 
+test_expect_success 'checkout <tree> -- <path> inside sparse directories' '
+	init_repos &&
+
+	test_all_match git checkout update-folder1 -- folder1/a &&
+	test_all_match git status --porcelain=v2 &&
+	test_all_match git ls-files --stage &&
+
+	test_all_match git reset --hard &&
+	test_all_match git checkout rename-out-to-out -- folder2/0/1 &&
+	test_all_match git status --porcelain=v2 &&
+	test_all_match git ls-files --stage
+'
+
 test_expect_success 'diff --cached' '
 	init_repos &&
 
@@ -1485,6 +1498,14 @@ ensure_not_expanded () {
 	test_region ! index ensure_full_index trace2.txt
 }
 
+# Only the sparse directories leading to the paths in question are
+# expanded.
+ensure_partially_expanded () {
+	run_sparse_index_trace2 "$@" &&
+	test_region index expand_sparse_directory trace2.txt &&
+	test_region ! index ensure_full_index trace2.txt
+}
+
 test_expect_success 'sparse-index is not expanded' '
 	init_repos &&
 
@@ -1504,6 +1525,8 @@ test_expect_success 'sparse-index is not expanded' '
 	ensure_not_expanded reset --hard &&
 	ensure_not_expanded checkout rename-out-to-out -- deep/deeper1 &&
 	ensure_not_expanded reset --hard &&
+	ensure_partially_expanded checkout update-folder1 -- folder1/a &&
+	ensure_not_expanded reset --hard &&
 	ensure_not_expanded restore -s rename-out-to-out -- deep/deeper1 &&
 
 	ensure_not_expanded ls-files deep/deeper1 &&
@@ -1595,7 +1618,17 @@ test_expect_success 'sparse-index is not expanded: stash' '
 	oid=$(git -C sparse-index stash create) &&
 	ensure_not_expanded stash store -m "test" $oid &&
 	ensure_not_expanded reset --hard &&
-	ensure_not_expanded stash pop
+	ensure_not_expanded stash pop &&
+
+	echo >>sparse-index/deep/a &&
+	echo >>sparse-index/a &&
+	ensure_not_expanded stash push -- deep/a &&
+	ensure_not_expanded stash pop &&
+	ensure_not_expanded stash push -- "deep/*" &&
+	ensure_not_expanded stash pop &&
+	ensure_expanded stash push -- folder1/a &&
+	git -C sparse-index stash list >stash-list &&
+	test_must_be_empty stash-list
 '
 
 test_expect_success 'describe tested on all' '
@@ -2434,8 +2467,8 @@ test_expect_success 'sparse-index is not expanded: git apply' '
 	# Fails when caring about the worktree.
 	ensure_not_expanded ! apply ../patch-outside &&
 
-	# Expands when using --index.
-	ensure_expanded apply --index ../patch-outside &&
+	# Expands the affected directory when using --index.
+	ensure_partially_expanded apply --index ../patch-outside &&
 
 	# Does not when index is partially expanded.
 	git -C sparse-index reset --hard &&
@@ -2445,8 +2478,8 @@ test_expect_success 'sparse-index is not expanded: git apply' '
 	git -C sparse-index reset --hard &&
 	git -C sparse-index sparse-checkout reapply &&
 
-	# Expands when index is collapsed.
-	ensure_expanded apply --cached ../patch-outside
+	# Expands the affected directory when index is collapsed.
+	ensure_partially_expanded apply --cached ../patch-outside
 '
 
 test_expect_success 'sparse-index is not expanded: git add -p' '
@@ -2460,7 +2493,8 @@ test_expect_success 'sparse-index is not expanded: git add -p' '
 	git -C sparse-index reset &&
 	ensure_not_expanded add -i <in &&
 
-	# -p does expand when edits are outside sparse checkout.
+	# -p expands the affected directories when edits are outside
+	# sparse checkout.
 	mkdir -p sparse-index/folder1 &&
 	echo "new content" >sparse-index/folder1/a &&
 	test_write_lines y n y >in &&
@@ -2498,7 +2532,7 @@ test_expect_success 'sparse-index is not expanded: checkout -p, reset -p' '
 	echo "new content" >sparse-index/folder1/a &&
 	git -C sparse-index add --sparse folder1 &&
 	git -C sparse-index sparse-checkout reapply &&
-	ensure_expanded reset --patch <in &&
+	ensure_partially_expanded reset --patch <in &&
 
 	# Fully reset the index.
 	mkdir -p sparse-index/folder1 &&
@@ -2506,7 +2540,7 @@ test_expect_success 'sparse-index is not expanded: checkout -p, reset -p' '
 	git -C sparse-index add --sparse folder1 &&
 	git -C sparse-index commit -m "folder1 change" &&
 	git -C sparse-index sparse-checkout reapply &&
-	ensure_expanded checkout HEAD~1 --patch <in
+	ensure_partially_expanded checkout HEAD~1 --patch <in
 '
 
 test_expect_success 'advice.sparseIndexExpanded' '
@@ -2533,7 +2567,7 @@ test_expect_success 'cat-file -p' '
 	test_all_match git cat-file -p :deep/a &&
 	ensure_not_expanded cat-file -p :deep/a &&
 	test_all_match git cat-file -p :folder1/a &&
-	ensure_expanded cat-file -p :folder1/a
+	ensure_partially_expanded cat-file -p :folder1/a
 '
 
 test_expect_success 'cat-file --batch' '
@@ -2549,14 +2583,14 @@ test_expect_success 'cat-file --batch' '
 
 	echo ":folder1/a" >in &&
 	test_all_match git cat-file --batch <in &&
-	ensure_expanded cat-file --batch <in &&
+	ensure_partially_expanded cat-file --batch <in &&
 
 	cat >in <<-\EOF &&
 	:deep/a
 	:folder1/a
 	EOF
 	test_all_match git cat-file --batch <in &&
-	ensure_expanded cat-file --batch <in
+	ensure_partially_expanded cat-file --batch <in
 '
 
 test_expect_success 'merge -s ours' '
@@ -2470,4 +2470,31 @@ test_expect_success 'dangling symref overwritten without old oid' '
 	test_must_fail git rev-parse --verify refs/heads/does-not-exist
 '
 
+test_expect_success REFFILES 'batch fsync flushes a transaction once' '
+	test_when_finished "git update-ref -d refs/heads/batch-1 &&
+		git update-ref -d refs/heads/batch-2 &&
+		git update-ref -d refs/heads/batch-3" &&
+	cat >stdin <<-EOF &&
+	create refs/heads/batch-1 HEAD
+	create refs/heads/batch-2 HEAD
+	create refs/heads/batch-3 HEAD
+	EOF
+	GIT_TRACE2_EVENT="$(pwd)/trace2.txt" GIT_TEST_FSYNC=true \
+		git -c core.fsync=reference -c core.fsyncMethod=batch \
+		update-ref --stdin <stdin &&
+	sed -n -e "/\"category\":\"fsync\"/{
+		s/.*\"category\":\"fsync\",//;
+		s/}$//;
+		p;
+	}" <trace2.txt >actual &&
+	cat >expect <<-\EOF &&
+	"name":"writeout-only","count":3
+	"name":"hardware-flush","count":1
+	EOF
+	test_cmp expect actual &&
+	git rev-parse HEAD >expect &&
+	git rev-parse refs/heads/batch-2 >actual &&
+	test_cmp expect actual
+'
+
 test_done
@@ -0,0 +1,81 @@
+#!/bin/sh
+
+test_description='revalidation of the loose ref cache in long-running processes'
+
+. ./test-lib.sh
+
+if test_have_prereq !REFFILES
+then
+	skip_all='skipping files-backend specific loose ref cache tests'
+	test_done
+fi
+
+# Move the mtime of all ref directories into the past, so that they are
+# not considered racy.
+age_ref_dirs () {
+	find .git/refs -type d >dirs &&
+	while read dir
+	do
+		test-tool chmtime =-10 "$dir" || return 1
+	done <dirs
+}
+
+test_expect_success 'setup' '
+	test_commit one &&
+	test_commit two &&
+	git branch topic one &&
+	git branch nested/topic one &&
+	git config core.revalidateLooseRefs true
+'
+
+test_expect_success 'new refs are visible to the second iteration' '
+	age_ref_dirs &&
+	test-tool ref-store main for-each-ref--repeat refs/heads/ \
+		"git branch new two" >actual &&
+	sed -n "/^--$/,\$p" actual >second &&
+	test_grep "$(git rev-parse two) new" second &&
+	test_grep "nested/topic" second
+'
+
+test_expect_success 'updated refs in nested directories are visible' '
+	age_ref_dirs &&
+	test-tool ref-store main for-each-ref--repeat refs/heads/ \
+		"git branch -f nested/topic two" >actual &&
+	sed -n "/^--$/,\$p" actual >second &&
+	test_grep "$(git rev-parse two) nested/topic" second
+'
+
+test_expect_success 'deleted refs disappear' '
+	age_ref_dirs &&
+	test-tool ref-store main for-each-ref--repeat refs/heads/ \
+		"git branch -D new" >actual &&
+	sed -n "/^--$/,\$p" actual >second &&
+	test_grep ! " new " second
+'
+
+test_expect_success 'symrefs are re-resolved' '
+	git symbolic-ref refs/heads/alias refs/heads/topic &&
+	age_ref_dirs &&
+	mtime=$(test-tool chmtime --get .git/refs/heads) &&
+	test-tool ref-store main for-each-ref--repeat refs/heads/ \
+		"git update-ref refs/heads/topic two && test-tool chmtime =$mtime .git/refs/heads" >actual &&
+	sed -n "/^--$/,\$p" actual >second &&
+	test_grep "$(git rev-parse two) alias" second &&
+	git symbolic-ref -d refs/heads/alias
+'
+
+test_expect_success 'unchanged directories are not re-read' '
+	test_config core.trustctime false &&
+	git branch -f topic one &&
+	age_ref_dirs &&
+	# Rewrite the ref in place and restore the directory mtime, which
+	# is not something Git does. With ctime not being trusted, this
+	# change is invisible to the cache.
+	mtime=$(test-tool chmtime --get .git/refs/heads) &&
+	test-tool ref-store main for-each-ref--repeat refs/heads/ \
+		"git rev-parse two >.git/refs/heads/topic && test-tool chmtime =$mtime .git/refs/heads" >actual &&
+	sed -n "/^--$/,\$p" actual >second &&
+	test_grep "$(git rev-parse one) topic" second
+'
+
+test_done
@@ -0,0 +1,126 @@
+#!/bin/sh
+
+test_description='looking up reflog entries by date with core.reflogIndex'
+
+GIT_TEST_DEFAULT_INITIAL_BRANCH_NAME=main
+export GIT_TEST_DEFAULT_INITIAL_BRANCH_NAME
+
+. ./test-lib.sh
+
+if ! test_have_prereq REFFILES
+then
+	skip_all='skipping reflog index tests; need files backend'
+	test_done
+fi
+
+# Compare the result of looking up "$1" at various dates with and without
+# the index.
+compare_lookups () {
+	for date in 1000000000 1112912053 1112912090 1112912113 \
+		    1112912200 1112912413 1112913000 2000000000
+	do
+		git rev-parse "$1@{$date}" >expect 2>&1 &&
+		git -c core.reflogIndex=true rev-parse "$1@{$date}" >actual 2>&1 &&
+		test_cmp expect actual || return 1
+	done
+}
+
+index_size () {
+	test_file_size .git/logs-index/refs/heads/main
+}
+
+test_expect_success 'setup' '
+	for i in $(test_seq 8)
+	do
+		test_commit "commit-$i" || return 1
+	done
+'
+
+test_expect_success 'index is not written by default' '
+	git rev-parse "main@{1112912113}" &&
+	test_path_is_missing .git/logs-index
+'
+
+test_expect_success 'lookups by date match the unindexed reflog' '
+	compare_lookups main &&
+	test_path_is_file .git/logs-index/refs/heads/main &&
+	echo $((16 + 8 * 16)) >expect &&
+	index_size >actual &&
+	test_cmp expect actual
+'
+
+test_expect_success 'lookups by date only read the entries they need' '
+	GIT_TRACE_REFS="$(pwd)/trace" git -c core.reflogIndex=true \
+		rev-parse "main@{1112912113}" &&
+	grep reflog_ent trace >entries &&
+	test_line_count = 2 entries
+'
+
+test_expect_success 'appended entries are indexed' '
+	test_commit commit-9 &&
+	compare_lookups main &&
+	echo $((16 + 9 * 16)) >expect &&
+	index_size >actual &&
+	test_cmp expect actual
+'
+
+test_expect_success 'rewritten reflog causes the index to be rebuilt' '
+	sed -e "/commit-3/d" .git/logs/refs/heads/main >log &&
+	cp log .git/logs/refs/heads/main &&
+	compare_lookups main &&
+	echo $((16 + 8 * 16)) >expect &&
+	index_size >actual &&
+	test_cmp expect actual
+'
+
+test_expect_success 'corrupt reflog entries are skipped' '
+	echo garbage >>.git/logs/refs/heads/main &&
+	test_commit commit-10 &&
+	compare_lookups main
+'
+
+test_expect_success 'out-of-order timestamps fall back to reading the reflog' '
+	test_when_finished "git reflog expire --expire=all main" &&
+	GIT_COMMITTER_DATE="1112912000 +0000" git reset --hard commit-2 &&
+	compare_lookups main
+'
+
+test_expect_success 'expiring the reflog removes the index' '
+	test_path_is_missing .git/logs-index/refs/heads/main &&
+	test_commit commit-11 &&
+	compare_lookups main &&
+	test_path_is_file .git/logs-index/refs/heads/main
+'
+
+test_expect_success 'deleting the reflog removes the index' '
+	git branch indexed &&
+	compare_lookups indexed &&
+	test_path_is_file .git/logs-index/refs/heads/indexed &&
+	git branch -D indexed &&
+	test_path_is_missing .git/logs-index/refs/heads/indexed
+'
+
+test_expect_success 'renaming the reflog removes the index' '
+	git branch old &&
+	git branch new &&
+	compare_lookups old &&
+	compare_lookups new &&
+	test_path_is_file .git/logs-index/refs/heads/old &&
+	test_path_is_file .git/logs-index/refs/heads/new &&
+	git branch -M old new &&
+	test_path_is_missing .git/logs-index/refs/heads/old &&
+	test_path_is_missing .git/logs-index/refs/heads/new &&
+	compare_lookups new
+'
+
+test_expect_success 'copying the reflog removes the index of the copy' '
+	git branch copy &&
+	compare_lookups copy &&
+	test_path_is_file .git/logs-index/refs/heads/copy &&
+	git branch -C new copy &&
+	test_path_is_file .git/logs-index/refs/heads/new &&
+	test_path_is_missing .git/logs-index/refs/heads/copy &&
+	compare_lookups copy
+'
+
+test_done
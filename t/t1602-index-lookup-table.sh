@@ -0,0 +1,130 @@
+#!/bin/sh
+
+test_description='reading the index through its entry lookup table'
+
+. ./test-lib.sh
+
+sane_unset GIT_TEST_SPLIT_INDEX
+sane_unset GIT_TEST_SPARSE_INDEX
+sane_unset GIT_INDEX_VERSION
+
+# Rewrite the index with or without ("$1") the lookup table.
+write_index () {
+	git -c index.recordLookupTable=$1 update-index --force-write-index
+}
+
+# Compare the output of "git $@" with and without the lookup table,
+# collecting trace2 data of the run with the table in "trace".
+compare_mapped () {
+	rm -f trace &&
+	write_index false &&
+	git "$@" >expect &&
+	write_index true &&
+	GIT_TRACE2_EVENT="$(pwd)/trace" git "$@" >actual &&
+	test_cmp expect actual
+}
+
+test_expect_success 'setup' '
+	mkdir -p a/b c &&
+	for i in 1 2 3
+	do
+		echo $i >a/f$i &&
+		echo $i >a/b/g$i &&
+		echo $i >c/h$i || return 1
+	done &&
+	echo top >top &&
+	git add . &&
+	git commit -m initial &&
+
+	one=$(echo one | git hash-object -w --stdin) &&
+	two=$(echo two | git hash-object -w --stdin) &&
+	cat >info <<-EOF &&
+	0 $ZERO_OID	a/conflict
+	100644 $one 1	a/conflict
+	100644 $two 2	a/conflict
+	EOF
+	git update-index --index-info <info
+'
+
+test_expect_success 'lookup table is not written by default' '
+	git update-index --force-write-index &&
+	rm -f trace &&
+	GIT_TRACE2_EVENT="$(pwd)/trace" git ls-files >/dev/null &&
+	test_grep ! mapped/cache_nr trace
+'
+
+for args in "" "-s" "-s a" "-u" "--deduplicate" "a/b" "-- a/f2 c" \
+	    "--abbrev=7 -s c/h*" "--debug top"
+do
+	test_expect_success "ls-files $args" '
+		compare_mapped ls-files $args &&
+		test_trace2_data index mapped/cache_nr 12 <trace
+	'
+done
+
+test_expect_success 'ls-files from a subdirectory' '
+	write_index true &&
+	git -C a ls-files -s >actual &&
+	write_index false &&
+	git -C a ls-files -s >expect &&
+	test_cmp expect actual
+'
+
+test_expect_success 'ls-files --error-unmatch' '
+	write_index true &&
+	git ls-files --error-unmatch a/f1 &&
+	test_must_fail git ls-files --error-unmatch a/nope 2>err &&
+	test_grep "did not match any file" err
+'
+
+test_expect_success 'ls-files options that need the whole index' '
+	write_index true &&
+	for args in "-t" "-m" "--eol" "--format=%(path)" "--resolve-undo"
+	do
+		rm -f trace &&
+		GIT_TRACE2_EVENT="$(pwd)/trace" git ls-files $args >/dev/null &&
+		test_grep ! mapped/cache_nr trace || return 1
+	done
+'
+
+test_expect_success 'rev-parse looks up paths in the lookup table' '
+	for path in :top :a/b/g2 :1:a/conflict :2:a/conflict
+	do
+		compare_mapped rev-parse $path &&
+		test_trace2_data index mapped/cache_nr 12 <trace &&
+		test_grep ! "read/cache_nr" trace || return 1
+	done &&
+
+	write_index true &&
+	git -C a rev-parse :./f1 >actual &&
+	git rev-parse HEAD:a/f1 >expect &&
+	test_cmp expect actual
+'
+
+test_expect_success 'rev-parse still diagnoses missing paths' '
+	write_index true &&
+	test_must_fail git rev-parse :a/conflict 2>err &&
+	test_grep "is in the index, but not at stage 0" err &&
+	test_must_fail git -C a rev-parse :b/g1 2>err &&
+	test_grep "is in the index, but not ${SQ}b/g1${SQ}" err
+'
+
+test_expect_success 'index version 4 is read as usual' '
+	test_when_finished "git update-index --index-version 2" &&
+	git -c index.recordLookupTable=true update-index --index-version 4 &&
+	compare_mapped ls-files -s &&
+	test_grep ! mapped/cache_nr trace
+'
+
+test_expect_success 'split index is read as usual' '
+	test_when_finished "git update-index --no-split-index" &&
+	git -c index.recordLookupTable=true update-index --split-index &&
+	rm -f trace &&
+	GIT_TRACE2_EVENT="$(pwd)/trace" git ls-files -s >actual &&
+	test_grep ! mapped/cache_nr trace &&
+	git update-index --no-split-index &&
+	git ls-files -s >expect &&
+	test_cmp expect actual
+'
+
+test_done
@@ -184,6 +184,19 @@ test_expect_success 'git log with path contains various magic signatures' '
 	test_bloom_filters_used "-- \:\(attr\:text\)A"
 '
 
+test_expect_success 'git log with excluded paths uses Bloom filters' '
+	test_bloom_filters_used "-- A \:\(exclude\)A/B/C" &&
+	test_bloom_filters_used "-- file4 A \:\(exclude\)A/B \:\(exclude\)A/file1" &&
+	test_bloom_filters_used "-- A/\* \:\(exclude\)\*file\*" &&
+	test_bloom_filters_not_used "-- \:\(exclude\)A/B/C" &&
+	test_bloom_filters_not_used "-- file\* \:\(exclude\)A"
+'
+
+test_expect_success 'git log with many overlapping paths uses Bloom filters' '
+	test_bloom_filters_used "-- A A/B A/B/C A/file1 A/B/file2 file4 file4 A/B/C/\*" &&
+	test_bloom_filters_used "-- A/B A/B/file2 A/B/C A/B- path_does_not_exist"
+'
+
 test_expect_success 'setup - add commit-graph to the chain without Bloom filters' '
 	test_commit c14 A/anotherFile2 &&
 	test_commit c15 A/B/anotherFile2 &&
@@ -453,6 +466,44 @@ test_expect_success 'Bloom generation backfills empty commits' '
 	)
 '
 
+test_expect_success 'Bloom filters do not depend on the number of threads' '
+	git init threads &&
+	test_when_finished "rm -fr threads" &&
+	(
+		cd threads &&
+		for i in $(test_seq 1 20)
+		do
+			mkdir -p "dir$((i % 3))/sub$((i % 5))" &&
+			echo $i >"dir$((i % 3))/sub$((i % 5))/file$i" &&
+			git add . &&
+			git commit -q -m "$i" || return 1
+		done &&
+		git commit --allow-empty -m empty &&
+		test_seq 1 20 >file-list &&
+		for f in $(cat file-list)
+		do
+			echo changed >"dir$((f % 3))/sub$((f % 5))/file$f" || return 1
+		done &&
+		git commit -q -a -m large &&
+
+		for threads in 1 4
+		do
+			rm -f .git/objects/info/commit-graph &&
+			GIT_TEST_BLOOM_SETTINGS_MAX_CHANGED_PATHS=10 \
+				git -c commitGraph.threads=$threads commit-graph write \
+				--reachable --changed-paths --max-new-filters=15 &&
+			GIT_TEST_BLOOM_SETTINGS_MAX_CHANGED_PATHS=10 \
+				GIT_TRACE2_EVENT="$(pwd)/trace-$threads" \
+				git -c commitGraph.threads=$threads commit-graph write \
+				--reachable --changed-paths &&
+			test_filter_computed 7 trace-$threads &&
+			test_filter_not_computed 15 trace-$threads &&
+			cp .git/objects/info/commit-graph graph-$threads || return 1
+		done &&
+		test_cmp graph-1 graph-4
+	)
+'
+
 graph=.git/objects/info/commit-graph
 graphdir=.git/objects/info/commit-graphs
 chain=$graphdir/commit-graph-chain
@@ -0,0 +1,172 @@
+#!/bin/sh
+
+test_description='git log for a path with changed-path lists'
+GIT_TEST_DEFAULT_INITIAL_BRANCH_NAME=main
+export GIT_TEST_DEFAULT_INITIAL_BRANCH_NAME
+
+. ./test-lib.sh
+. "$TEST_DIRECTORY"/lib-chunk.sh
+
+GIT_TEST_COMMIT_GRAPH=0
+GIT_TEST_COMMIT_GRAPH_CHANGED_PATHS=0
+
+# Turn off any inherited trace2 settings for this test.
+sane_unset GIT_TRACE2 GIT_TRACE2_PERF GIT_TRACE2_EVENT
+sane_unset GIT_TRACE2_PERF_BRIEF
+sane_unset GIT_TRACE2_CONFIG_PARAMS
+
+test_expect_success 'setup' '
+	mkdir A A/B A/B/C &&
+	test_commit c1 A/file1 &&
+	test_commit c2 A/B/file2 &&
+	test_commit c3 A/B/C/file3 &&
+	test_commit c4 A/file1 &&
+	test_commit c5 A/B/file2 &&
+	test_commit c6 A/B/C/file3 &&
+	test_commit c7 file_to_be_deleted &&
+	git checkout -b side HEAD~4 &&
+	test_commit side-1 file4 &&
+	test_commit side-2 A/B/file2 &&
+	git checkout main &&
+	git merge -X theirs side &&
+	test_commit c8 file5 &&
+	git mv file5 file5_renamed &&
+	git commit -m "rename" &&
+	git rm file_to_be_deleted &&
+	git commit -m "file removed" &&
+	git commit --allow-empty -m "empty" &&
+	git commit-graph write --reachable --changed-path-lists
+'
+
+test_expect_success 'commit-graph write wrote out the lists' '
+	test-tool read-graph >out &&
+	test_grep changed_path_lists out &&
+	git commit-graph verify
+'
+
+# Compare "git log" with and without the commit-graph, collecting trace2
+# data of the run with the commit-graph in "trace.perf".
+test_changed_path_lists () {
+	rm -f trace.perf &&
+	eval git -c core.commitGraph=false log --format=%s "$1" >expect &&
+	eval "GIT_TRACE2_PERF=\"$(pwd)/trace.perf\"" \
+		git log --format=%s "$1" >actual &&
+	test_cmp expect actual
+}
+
+test_changed_path_lists_used () {
+	test_changed_path_lists "$1" &&
+	grep -q "statistics:{\"list_not_present\":${2:-0}," trace.perf
+}
+
+test_changed_path_lists_not_used () {
+	test_changed_path_lists "$1" &&
+	test_grep ! "list_not_present" trace.perf
+}
+
+for path in A A/ A/B A/B/C A/file1 A/B/file2 A/B/C/file3 file4 file5 \
+	    file5_renamed file_to_be_deleted "A/*" "*file2" path_does_not_exist
+do
+	for option in "" \
+		      "--all" \
+		      "--full-history" \
+		      "--full-history --simplify-merges" \
+		      "--simplify-merges" \
+		      "--show-pulls" \
+		      "--first-parent" \
+		      "--topo-order" \
+		      "--remove-empty" \
+		      "--ancestry-path side..main"
+	do
+		test_expect_success "git log option: $option for path: $path" '
+			test_changed_path_lists_used "$option -- \"$path\""
+		'
+	done
+done
+
+test_expect_success 'git log with excluded and multiple pathspecs' '
+	test_changed_path_lists_used "-- A \":(exclude)A/B/C\"" &&
+	test_changed_path_lists_used "-- file4 A/B/C" &&
+	test_changed_path_lists_used "-- \":(glob)A/**/file3\""
+'
+
+test_expect_success 'git log with pathspec magic that needs the trees' '
+	test_changed_path_lists_not_used "-- \":(icase)a\"" &&
+	test_changed_path_lists_not_used "--walk-reflogs -- A"
+'
+
+test_expect_success 'commits that change too many paths are not covered' '
+	test_when_finished "git reset --hard HEAD~1" &&
+	mkdir many &&
+	for i in $(test_seq 10)
+	do
+		echo $i >many/file$i || return 1
+	done &&
+	git add many &&
+	git commit -m many &&
+	GIT_TEST_BLOOM_SETTINGS_MAX_CHANGED_PATHS=5 \
+		git commit-graph write --reachable &&
+	test_changed_path_lists_used "-- many" 1 &&
+	test_changed_path_lists_used "-- many/file3" 1
+'
+
+test_expect_success 'commits that change a submodule are not covered' '
+	test_when_finished "git reset --hard HEAD~1 && rm -rf sub" &&
+	git init sub &&
+	test_commit -C sub sub-1 &&
+	git add sub &&
+	git commit -m submodule &&
+	git commit-graph write --reachable &&
+	test_changed_path_lists_used "-- sub" 1 &&
+	test_changed_path_lists_used "-- A" 1
+'
+
+test_expect_success 'lists are kept, dropped and written to split layers' '
+	git commit-graph write --reachable &&
+	test-tool read-graph >out &&
+	test_grep changed_path_lists out &&
+
+	git commit-graph write --reachable --no-changed-path-lists &&
+	test-tool read-graph >out &&
+	test_grep ! changed_path_lists out &&
+	test_changed_path_lists_not_used "-- A" &&
+
+	git -c commitGraph.changedPathLists=true \
+		commit-graph write --reachable --split=replace &&
+	test_commit c9 A/file1 &&
+	git commit-graph write --reachable --split=no-merge &&
+	test_line_count = 2 .git/objects/info/commit-graphs/commit-graph-chain &&
+	git commit-graph verify &&
+	test_changed_path_lists_used "-- A" &&
+	test_changed_path_lists_used "-- file4" &&
+
+	git commit-graph write --reachable --split=replace &&
+	test_line_count = 1 .git/objects/info/commit-graphs/commit-graph-chain &&
+	test_changed_path_lists_used "-- A"
+'
+
+test_expect_success 'git last-modified with changed-path lists' '
+	git -c core.commitGraph=false last-modified >expect &&
+	git last-modified >actual &&
+	test_cmp expect actual &&
+	git -c core.commitGraph=false last-modified -t A >expect &&
+	git last-modified -t A >actual &&
+	test_cmp expect actual &&
+	git -c core.commitGraph=false last-modified --max-depth=1 >expect &&
+	git last-modified --max-depth=1 >actual &&
+	test_cmp expect actual
+'
+
+test_expect_success 'incomplete lists are ignored' '
+	rm -rf .git/objects/info/commit-graphs &&
+	git commit-graph write --reachable --changed-path-lists &&
+	graph=.git/objects/info/commit-graph &&
+	test_when_finished "rm -f $graph" &&
+	corrupt_chunk_file $graph PNAM clear &&
+	git log --format=%s -- A >actual 2>err &&
+	git -c core.commitGraph=false log --format=%s -- A >expect &&
+	test_cmp expect actual &&
+	test_grep "ignoring incomplete changed-path lists" err
+'
+
+test_done
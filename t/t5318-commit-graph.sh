@@ -1010,4 +1010,124 @@ test_expect_success 'config commitGraph.changedPaths acts like --changed-paths'
 	)
 '
 
+test_expect_success 'reachability index is written and kept' '
+	git init reachability-index &&
+	(
+		cd reachability-index &&
+		test_commit first &&
+		git commit-graph write --reachable &&
+		test-tool read-graph >out &&
+		test_grep ! reachability_index out &&
+
+		test_commit second &&
+		git commit-graph write --reachable --reachability-index &&
+		test-tool read-graph >out &&
+		test_grep reachability_index out &&
+		git commit-graph verify &&
+
+		# An existing index is kept by default...
+		test_commit third &&
+		git commit-graph write --reachable &&
+		test-tool read-graph >out &&
+		test_grep reachability_index out &&
+
+		# ... but can be dropped.
+		git commit-graph write --reachable --no-reachability-index &&
+		test-tool read-graph >out &&
+		test_grep ! reachability_index out &&
+
+		git -c commitGraph.reachabilityIndex=true \
+			commit-graph write --reachable &&
+		test-tool read-graph >out &&
+		test_grep reachability_index out
+	)
+'
+
+test_expect_success 'reachability index is only written to base layers' '
+	git init reachability-index-split &&
+	(
+		cd reachability-index-split &&
+		test_commit first &&
+		git commit-graph write --reachable --split --reachability-index &&
+		base=$(head -n 1 .git/objects/info/commit-graphs/commit-graph-chain) &&
+		test-tool read-graph >out &&
+		test_grep reachability_index out &&
+
+		test_commit second &&
+		git commit-graph write --reachable --split=no-merge &&
+		test_line_count = 2 .git/objects/info/commit-graphs/commit-graph-chain &&
+		test-tool read-graph >out &&
+		test_grep ! reachability_index out &&
+		test_grep "^$base\$" .git/objects/info/commit-graphs/commit-graph-chain &&
+
+		git merge-base --is-ancestor first second &&
+		test_must_fail git merge-base --is-ancestor second first &&
+
+		git commit-graph write --reachable --split=replace &&
+		test_line_count = 1 .git/objects/info/commit-graphs/commit-graph-chain &&
+		test-tool read-graph >out &&
+		test_grep reachability_index out
+	)
+'
+
+test_expect_success 'rev-list --count walks the commit-graph' '
+	git init count-walk &&
+	(
+		cd count-walk &&
+		test_commit base &&
+		for i in $(test_seq 3)
+		do
+			git checkout -b topic-$i base &&
+			test_commit topic-$i-1 &&
+			test_commit topic-$i-2 &&
+			git checkout - || return 1
+		done &&
+		git checkout -B main base &&
+		test_commit main-1 &&
+		git merge -m merge-1 topic-1 &&
+		test_commit main-2 &&
+		git merge -m merge-2 topic-2 topic-3 &&
+		test_commit main-3 &&
+		git commit-graph write --reachable &&
+
+		for args in "main" "--all" "topic-1..main" "topic-2...main" \
+			    "main --not topic-1 topic-3" "--first-parent main" \
+			    "--exclude-first-parent-only main ^main~3" \
+			    "--first-parent --exclude-first-parent-only main ^topic-2" \
+			    "main ^main" "main-1 ^main"
+		do
+			git -c core.commitGraph=false rev-list --count $args >expect &&
+			rm -f trace &&
+			GIT_TRACE2_EVENT="$(pwd)/trace" \
+				git rev-list --count $args >actual &&
+			test_cmp expect actual &&
+			test_grep "count-reachable" trace || return 1
+		done
+	)
+'
+
+test_expect_success 'rev-list --count walks the usual way when it has to' '
+	(
+		cd count-walk &&
+		for args in "--merges main" "--left-right topic-1...main" \
+			    "--since=$(git log -1 --format=%ct main-2) main" \
+			    "-3 main" "main -- topic-1-1.t"
+		do
+			git -c core.commitGraph=false rev-list --count $args >expect &&
+			rm -f trace &&
+			GIT_TRACE2_EVENT="$(pwd)/trace" \
+				git rev-list --count $args >actual &&
+			test_cmp expect actual &&
+			test_grep ! "count-reachable" trace || return 1
+		done &&
+
+		test_commit outside-graph &&
+		git rev-list --count main >expect &&
+		GIT_TRACE2_EVENT="$(pwd)/trace" \
+			git rev-list --count main >actual &&
+		test_cmp expect actual &&
+		test_grep ! "count-reachable" trace
+	)
+'
+
 test_done
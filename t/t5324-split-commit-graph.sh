@@ -741,4 +741,99 @@ test_expect_success 'temporary graph layer is discarded upon failure' '
 	)
 '
 
+test_expect_success 'setup repo for --split=cost' '
+	git init cost &&
+	(
+		cd cost &&
+		git config gc.writeCommitGraph false &&
+		for n in 27 9 3
+		do
+			for i in $(test_seq $n)
+			do
+				test_commit --no-tag $n-$i || return 1
+			done &&
+			git commit-graph write --reachable --split=no-merge \
+				--changed-paths || return 1
+		done &&
+		test_line_count = 3 $graphdir/commit-graph-chain &&
+		test_commit --no-tag tip
+	)
+'
+
+test_expect_success '--split=cost merges layers to keep lookups cheap' '
+	test_when_finished rm -rf cost-size cost-3 cost-4 cost-2 cost-0 &&
+	git clone -q cost cost-size &&
+	git -C cost-size commit-graph write --reachable --split &&
+	test_line_count = 4 cost-size/$graphdir/commit-graph-chain &&
+
+	git clone -q cost cost-3 &&
+	GIT_TRACE2_EVENT="$(pwd)/trace" \
+		git -C cost-3 commit-graph write --reachable --split=cost &&
+	test_line_count = 3 cost-3/$graphdir/commit-graph-chain &&
+	test_trace2_data commit-graph split/cost-merged-layers 1 <trace &&
+	git -C cost-3 commit-graph verify &&
+
+	git clone -q cost cost-4 &&
+	git -C cost-4 -c commitGraph.maxLookupCost=4 \
+		commit-graph write --reachable --split=cost &&
+	test_line_count = 4 cost-4/$graphdir/commit-graph-chain &&
+
+	git clone -q cost cost-2 &&
+	git -C cost-2 -c commitGraph.splitStrategy=cost \
+		commit-graph write --reachable --split --max-lookup-cost=2 &&
+	test_line_count = 2 cost-2/$graphdir/commit-graph-chain &&
+	git -C cost-2 commit-graph verify &&
+
+	test_must_fail git -C cost commit-graph write --reachable \
+		--split=cost --max-lookup-cost=0 2>err &&
+	test_grep "max-lookup-cost must be at least 1" err &&
+	test_must_fail git -C cost -c commitGraph.maxLookupCost=0 \
+		-c commitGraph.splitStrategy=cost \
+		commit-graph write --reachable --split 2>err &&
+	test_grep "max-lookup-cost must be at least 1" err &&
+
+	git clone -q cost cost-0 &&
+	git -C cost-0 -c commitGraph.maxLookupCost=0 \
+		commit-graph write --reachable &&
+	git -C cost-0 -c commitGraph.maxLookupCost=0 \
+		commit-graph write --reachable --split &&
+	git -C cost-0 commit-graph verify
+'
+
+test_expect_success '--split=cost closes gaps in Bloom filter coverage' '
+	test_when_finished rm -rf cost-gap trace &&
+	git clone -q cost cost-gap &&
+	(
+		cd cost-gap &&
+		for i in $(test_seq 4)
+		do
+			test_commit --no-tag gap-$i || return 1
+		done &&
+		git commit-graph write --reachable --split=no-merge \
+			--no-changed-paths &&
+		test_commit --no-tag another &&
+
+		rm -f ../trace &&
+		GIT_TRACE2_EVENT="$(pwd)/../trace" git commit-graph write \
+			--reachable --split=cost --changed-paths --max-lookup-cost=10 \
+			--max-new-filters=0 &&
+		test_trace2_data commit-graph split/cost-merged-layers 0 <../trace &&
+		test_line_count = 5 $graphdir/commit-graph-chain &&
+
+		test_commit --no-tag more &&
+		rm -f ../trace &&
+		GIT_TRACE2_EVENT="$(pwd)/../trace" git commit-graph write \
+			--reachable --split=cost --changed-paths --max-lookup-cost=10 &&
+		test_trace2_data commit-graph split/cost-merged-layers 1 <../trace &&
+		test_line_count = 4 $graphdir/commit-graph-chain &&
+		git commit-graph verify &&
+		git rev-list --count HEAD -- 27-1.t >expect &&
+		rm -f ../trace &&
+		GIT_TRACE2_PERF="$(pwd)/../trace" \
+			git rev-list --count HEAD -- 27-1.t >actual &&
+		test_cmp expect actual &&
+		grep "statistics:{\"filter_not_present\":0," ../trace
+	)
+'
+
 test_done
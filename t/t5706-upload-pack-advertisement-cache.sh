@@ -0,0 +1,194 @@
+#!/bin/sh
+
+test_description='upload-pack reference advertisement cache'
+
+GIT_TEST_DEFAULT_INITIAL_BRANCH_NAME=main
+export GIT_TEST_DEFAULT_INITIAL_BRANCH_NAME
+
+. ./test-lib.sh
+
+ls_refs () {
+	{
+		echo command=ls-refs &&
+		echo object-format=$(test_oid algo) &&
+		echo 0001 &&
+		for arg in "$@"
+		do
+			echo "$arg" || return 1
+		done &&
+		echo 0000
+	} | test-tool pkt-line pack >in &&
+	test-tool serve-v2 --stateless-rpc <in >out &&
+	test-tool pkt-line unpack <out
+}
+
+advertise_v0 () {
+	git upload-pack --advertise-refs . >out &&
+	test-tool pkt-line unpack <out
+}
+
+test_expect_success 'setup' '
+	test_commit one &&
+	test_commit two &&
+	git tag -a -m annotated annotated two &&
+	git branch dev one &&
+	git symbolic-ref refs/heads/alias refs/heads/dev &&
+	git update-ref refs/hidden/secret HEAD
+'
+
+test_expect_success 'cache is not used by default' '
+	ls_refs peel symrefs >actual &&
+	test_path_is_missing .git/ref-advert-cache
+'
+
+test_expect_success 'ls-refs output is the same with the cache' '
+	ls_refs peel symrefs >expect &&
+	test_config uploadpack.advertisementCache true &&
+	ls_refs peel symrefs >actual &&
+	test_cmp expect actual &&
+	ls .git/ref-advert-cache/*/* >entries &&
+	test_line_count = 1 entries &&
+	ls_refs peel symrefs >actual &&
+	test_cmp expect actual
+'
+
+test_expect_success 'ls-refs is served from the cache' '
+	test_config uploadpack.advertisementCache true &&
+	ls_refs "ref-prefix refs/tags/" >expect &&
+	entry=$(ls -t .git/ref-advert-cache/*/* | head -n 1) &&
+	echo "$(test_oid zero) refs/tags/fake" >"$entry" &&
+	ls_refs "ref-prefix refs/tags/" >actual &&
+	cat >expect <<-EOF &&
+	$(test_oid zero) refs/tags/fake
+	0000
+	EOF
+	test_cmp expect actual
+'
+
+test_expect_success 'cached entries are keyed on the arguments' '
+	test_config uploadpack.advertisementCache true &&
+	ls_refs "ref-prefix refs/heads/" >actual &&
+	cat >expect <<-EOF &&
+	$(git rev-parse refs/heads/alias) refs/heads/alias
+	$(git rev-parse refs/heads/dev) refs/heads/dev
+	$(git rev-parse refs/heads/main) refs/heads/main
+	0000
+	EOF
+	test_cmp expect actual
+'
+
+test_expect_success 'ref updates invalidate the cache' '
+	test_config uploadpack.advertisementCache true &&
+	ls_refs "ref-prefix refs/tags/" >before &&
+	git tag three &&
+	ls_refs "ref-prefix refs/tags/" >actual &&
+	cat >expect <<-EOF &&
+	$(git rev-parse refs/tags/annotated) refs/tags/annotated
+	$(git rev-parse refs/tags/one) refs/tags/one
+	$(git rev-parse refs/tags/three) refs/tags/three
+	$(git rev-parse refs/tags/two) refs/tags/two
+	0000
+	EOF
+	test_cmp expect actual &&
+	git update-ref -d refs/tags/three &&
+	ls_refs "ref-prefix refs/tags/" >actual &&
+	grep -v refs/tags/three expect >expect.deleted &&
+	test_cmp expect.deleted actual
+'
+
+test_expect_success 'reflog --updateref invalidates the cache' '
+	test_config uploadpack.advertisementCache true &&
+	git branch expire one &&
+	git update-ref refs/heads/expire two &&
+	ls_refs "ref-prefix refs/heads/expire" >actual &&
+	test_grep "$(git rev-parse two) refs/heads/expire" actual &&
+	git reflog delete --updateref --rewrite expire@{0} &&
+	ls_refs "ref-prefix refs/heads/expire" >actual &&
+	test_grep "$(git rev-parse one) refs/heads/expire" actual &&
+	git branch -D expire
+'
+
+test_expect_success 'stale entries are pruned' '
+	test_config uploadpack.advertisementCache true &&
+	ls_refs >/dev/null &&
+	git branch -f dev two &&
+	ls_refs >/dev/null &&
+	ls .git/ref-advert-cache >dirs &&
+	test_line_count = 1 dirs
+'
+
+test_expect_success 'number of entries is capped' '
+	test_config uploadpack.advertisementCache true &&
+	test_config uploadpack.advertisementCacheEntries 2 &&
+	git update-ref refs/heads/cap HEAD &&
+	for prefix in refs/heads/ refs/tags/ refs/hidden/ refs/heads/d
+	do
+		ls_refs "ref-prefix $prefix" >/dev/null || return 1
+	done &&
+	ls .git/ref-advert-cache/*/* >entries &&
+	test_line_count = 2 entries &&
+	ls_refs "ref-prefix refs/heads/d" >actual &&
+	test_grep refs/heads/dev actual &&
+	git update-ref -d refs/heads/cap
+'
+
+test_expect_success 'no entries are written with a cap of 0' '
+	rm -rf .git/ref-advert-cache &&
+	test_config uploadpack.advertisementCache true &&
+	test_config uploadpack.advertisementCacheEntries 0 &&
+	ls_refs >/dev/null &&
+	test_path_is_missing .git/ref-advert-cache
+'
+
+test_expect_success 'packing refs keeps the cache coherent' '
+	test_config uploadpack.advertisementCache true &&
+	ls_refs peel symrefs >expect &&
+	git pack-refs --all &&
+	ls_refs peel symrefs >actual &&
+	test_cmp expect actual &&
+	git update-ref refs/heads/dev HEAD &&
+	ls_refs peel symrefs >actual &&
+	test_config uploadpack.advertisementCache false &&
+	ls_refs peel symrefs >expect &&
+	test_cmp expect actual
+'
+
+test_expect_success 'hidden refs are part of the cache key' '
+	test_config uploadpack.advertisementCache true &&
+	ls_refs "ref-prefix refs/hidden/" >actual &&
+	test_grep refs/hidden/secret actual &&
+	test_config uploadpack.hideRefs refs/hidden &&
+	ls_refs "ref-prefix refs/hidden/" >actual &&
+	test_grep ! refs/hidden/secret actual
+'
+
+test_expect_success 'v0 advertisement is the same with the cache' '
+	advertise_v0 >expect &&
+	test_config uploadpack.advertisementCache true &&
+	advertise_v0 >actual &&
+	test_cmp expect actual &&
+	advertise_v0 >actual &&
+	test_cmp expect actual &&
+	git tag four &&
+	advertise_v0 >actual &&
+	test_grep "$(git rev-parse four) refs/tags/four" actual
+'
+
+test_expect_success 'cache works with the reftable backend' '
+	test_when_finished "rm -rf reftable" &&
+	git init --ref-format=reftable reftable &&
+	test_commit -C reftable first &&
+	(
+		cd reftable &&
+		ls_refs >expect &&
+		git config uploadpack.advertisementCache true &&
+		ls_refs >actual &&
+		test_cmp expect actual &&
+		test_path_is_dir .git/ref-advert-cache &&
+		git tag second &&
+		ls_refs >actual &&
+		test_grep refs/tags/second actual
+	)
+'
+
+test_done
@@ -91,6 +91,21 @@ test_ancestry "G..M -- G.t" ""
 test_ancestry "--ancestry-path G..M -- G.t" "L"
 test_ancestry "--ancestry-path --simplify-merges G^..M -- G.t" "G L"
 
+test_expect_success '--ancestry-path --graph with generation numbers' '
+	test_when_finished "rm -f .git/objects/info/commit-graph" &&
+	for range in D..M F...I "M ^D ^K" G..I
+	do
+		git -c core.commitGraph=false log --graph --boundary \
+			--format=%s --ancestry-path $range >expect &&
+		git commit-graph write --reachable &&
+		GIT_TRACE2_EVENT="$(pwd)/trace" git log --graph --boundary \
+			--format=%s --ancestry-path $range >actual &&
+		test_cmp expect actual &&
+		test_grep "\"category\":\"topo_walk\"" trace &&
+		rm -f trace .git/objects/info/commit-graph || return 1
+	done
+'
+
 #   b---bc
 #  / \ /
 # a   X
@@ -129,4 +144,14 @@ test_expect_success 'criss-cross: rev-list --ancestry-path --all ^cb' '
 	 test_must_be_empty actual)
 '
 
+test_expect_success 'criss-cross: --ancestry-path --topo-order with commit-graph' '
+	(cd criss-cross &&
+	 git commit-graph write --reachable &&
+	 git rev-list --topo-order --ancestry-path xcb..xbc >actual &&
+	 test_must_be_empty actual &&
+	 git rev-list --topo-order --ancestry-path xb..xbc >actual &&
+	 git rev-parse xbc >expect &&
+	 test_cmp expect actual)
+'
+
 test_done
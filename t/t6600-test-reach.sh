@@ -58,6 +58,13 @@ test_expect_success 'setup' '
 	git -c commitGraph.generationVersion=1 commit-graph write --reachable &&
 	mv .git/objects/info/commit-graph commit-graph-no-gdat &&
 	chmod u+w commit-graph-no-gdat &&
+	git commit-graph write --reachable --reachability-index &&
+	mv .git/objects/info/commit-graph commit-graph-reach &&
+	chmod u+w commit-graph-reach &&
+	git show-ref -s commit-5-5 |
+		git commit-graph write --stdin-commits --reachability-index &&
+	mv .git/objects/info/commit-graph commit-graph-half-reach &&
+	chmod u+w commit-graph-half-reach &&
 	git config core.commitGraph true
 '
 
@@ -73,6 +80,12 @@ run_all_modes () {
 	test_cmp expect actual &&
 	cp commit-graph-no-gdat .git/objects/info/commit-graph &&
 	"$@" <input >actual &&
+	test_cmp expect actual &&
+	cp commit-graph-reach .git/objects/info/commit-graph &&
+	"$@" <input >actual &&
+	test_cmp expect actual &&
+	cp commit-graph-half-reach .git/objects/info/commit-graph &&
+	"$@" <input >actual &&
 	test_cmp expect actual
 }
 
@@ -205,6 +218,35 @@ test_expect_success 'reduce_heads' '
 	test_all_modes reduce_heads
 '
 
+test_expect_success 'reduce_heads:many' '
+	for x in $(test_seq 1 10)
+	do
+		for y in $(test_seq 1 10)
+		do
+			test $(($x + $y)) -gt 12 ||
+			echo "X:commit-$x-$y" || return 1
+		done
+	done >input &&
+	{
+		echo "reduce_heads(X):" &&
+		for x in $(test_seq 2 10)
+		do
+			git rev-parse commit-$x-$((12 - $x)) || return 1
+		done | sort
+	} >expect &&
+	test_all_modes reduce_heads &&
+	for threads in 2 3 8
+	do
+		test_config commitGraph.threads $threads &&
+		test_all_modes reduce_heads || return 1
+	done &&
+	cp commit-graph-full .git/objects/info/commit-graph &&
+	test_when_finished rm -f .git/objects/info/commit-graph &&
+	GIT_TRACE2_EVENT="$(pwd)/trace.txt" test-tool reach reduce_heads <input >actual &&
+	test_cmp expect actual &&
+	test_trace2_data commit-graph find-redundant/threads 8 <trace.txt
+'
+
 test_expect_success 'can_all_from_reach:hit' '
 	cat >input <<-\EOF &&
 	X:commit-2-10
@@ -0,0 +1,128 @@
+#!/bin/sh
+
+test_description='caching ahead/behind counts with core.aheadBehindCache'
+
+GIT_TEST_DEFAULT_INITIAL_BRANCH_NAME=main
+export GIT_TEST_DEFAULT_INITIAL_BRANCH_NAME
+
+. ./test-lib.sh
+
+ahead_behind () {
+	git "$@" for-each-ref --format="%(refname) %(ahead-behind:main)" \
+		"$pattern"
+}
+
+# Compare the output for the references matching "$1" (default: all
+# branches) with and without the cache, collecting trace2 data of the
+# cached run in "trace".
+compare_ahead_behind () {
+	pattern=${1:-refs/heads} &&
+	rm -f trace &&
+	ahead_behind >expect &&
+	GIT_TRACE2_EVENT="$(pwd)/trace" \
+		ahead_behind -c core.aheadBehindCache=true >actual &&
+	test_cmp expect actual
+}
+
+test_expect_success 'setup' '
+	test_commit base &&
+	for i in $(test_seq 4)
+	do
+		git checkout -b topic-$i main &&
+		test_commit --no-tag topic-$i-a &&
+		test_commit --no-tag topic-$i-b || return 1
+	done &&
+	git checkout main &&
+	test_commit --no-tag main-1 &&
+	git tag -a -m annotated annotated topic-1
+'
+
+test_expect_success 'cache is not used by default' '
+	git for-each-ref --format="%(ahead-behind:main)" &&
+	test_path_is_missing .git/ahead-behind-cache
+'
+
+test_expect_success 'counts are the same with the cache' '
+	compare_ahead_behind &&
+	test_path_is_file .git/ahead-behind-cache &&
+	test_trace2_data ahead-behind-cache hits 0 <trace &&
+	test_trace2_data ahead-behind-cache misses 5 <trace &&
+	test_trace2_data ahead-behind-cache written 5 <trace
+'
+
+test_expect_success 'repeated queries are served from the cache' '
+	compare_ahead_behind &&
+	test_trace2_data ahead-behind-cache hits 5 <trace &&
+	test_trace2_data ahead-behind-cache misses 0 <trace &&
+	test_grep ! written trace
+'
+
+test_expect_success 'only moved references are recomputed' '
+	git checkout topic-2 &&
+	test_commit --no-tag topic-2-c &&
+	git checkout main &&
+	compare_ahead_behind &&
+	test_trace2_data ahead-behind-cache hits 4 <trace &&
+	test_trace2_data ahead-behind-cache misses 1 <trace
+'
+
+test_expect_success 'moving the base recomputes all counts' '
+	test_commit --no-tag main-2 &&
+	compare_ahead_behind &&
+	test_trace2_data ahead-behind-cache hits 0 <trace &&
+	test_trace2_data ahead-behind-cache misses 5 <trace
+'
+
+test_expect_success 'entries for current tips are kept' '
+	compare_ahead_behind refs/heads/topic-1 &&
+	test_trace2_data ahead-behind-cache hits 1 <trace &&
+	git checkout topic-3 &&
+	test_commit --no-tag topic-3-c &&
+	git checkout main &&
+	compare_ahead_behind refs/heads/topic-3 &&
+	test_trace2_data ahead-behind-cache misses 1 <trace &&
+	test_trace2_data ahead-behind-cache written 5 <trace &&
+	compare_ahead_behind &&
+	test_trace2_data ahead-behind-cache hits 5 <trace
+'
+
+test_expect_success 'entries for stale tips are dropped' '
+	git branch -D topic-4 &&
+	git checkout topic-2 &&
+	test_commit --no-tag topic-2-d &&
+	git checkout main &&
+	compare_ahead_behind refs/heads/topic-2 &&
+	test_trace2_data ahead-behind-cache misses 1 <trace &&
+	test_trace2_data ahead-behind-cache written 4 <trace
+'
+
+test_expect_success 'multiple bases and peeled tags' '
+	ahead_behind_multi () {
+		git "$@" for-each-ref \
+			--format="%(refname) %(ahead-behind:main) %(ahead-behind:topic-1)"
+	} &&
+	ahead_behind_multi >expect &&
+	ahead_behind_multi -c core.aheadBehindCache=true >actual &&
+	test_cmp expect actual &&
+	ahead_behind_multi -c core.aheadBehindCache=true >actual &&
+	test_cmp expect actual
+'
+
+test_expect_success 'invalid cache files are ignored' '
+	echo garbage >.git/ahead-behind-cache &&
+	compare_ahead_behind 2>err &&
+	test_grep "ignoring invalid ahead/behind cache" err &&
+	test_trace2_data ahead-behind-cache hits 0 <trace &&
+	compare_ahead_behind 2>err &&
+	test_must_be_empty err &&
+	test_trace2_data ahead-behind-cache misses 0 <trace
+'
+
+test_expect_success 'cache is not used with replaced history' '
+	test_when_finished "git replace -d topic-3" &&
+	git replace --graft topic-3 &&
+	compare_ahead_behind &&
+	test_grep ! '"category":"ahead-behind-cache"' trace
+'
+
+test_done
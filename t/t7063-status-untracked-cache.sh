@@ -191,6 +191,25 @@ test_expect_success 'untracked cache after second status' '
 	test_cmp ../dump.expect ../actual
 '
 
+test_expect_success 'status checks cached directories in parallel' '
+	: >../trace.output &&
+	GIT_TEST_PRELOAD_INDEX=true GIT_TRACE2_PERF="$TRASH_DIRECTORY/trace.output" \
+	git -c core.preloadIndex=true status --porcelain >../actual &&
+	test_cmp ../status.expect ../actual &&
+	grep "preload-untracked/dirs:4" ../trace.output &&
+	get_relevant_traces ../trace.output ../trace.relevant &&
+	test_cmp ../trace.expect ../trace.relevant &&
+	test-tool dump-untracked-cache >../actual &&
+	test_cmp ../dump.expect ../actual
+'
+
+test_expect_success 'status with a pathspec does not check unrelated cached directories' '
+	: >../trace.output &&
+	GIT_TEST_PRELOAD_INDEX=true GIT_TRACE2_PERF="$TRASH_DIRECTORY/trace.output" \
+	git -c core.preloadIndex=true status --porcelain -- dtwo/ >../actual &&
+	test_grep ! "preload-untracked/dirs:4" ../trace.output
+'
+
 cat >../status_uall.expect <<EOF &&
 A  done/one
 A  one
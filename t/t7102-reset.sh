@@ -626,6 +626,26 @@ test_expect_success 'reset --mixed sets up work tree' '
 	test_must_be_empty actual
 '
 
+test_expect_success 'reset --hard preloads the index before unpack_trees()' '
+	test_when_finished "rm -f trace sum-lstat" &&
+	file=$(git ls-files | head -n 1) &&
+	echo dirty >>"$file" &&
+	GIT_TEST_PRELOAD_INDEX=true GIT_TRACE2_EVENT="$(pwd)/trace" \
+		git -c core.preloadIndex=true reset --hard &&
+	test_region unpack_trees preload_index trace &&
+	sed -n "s/.*\"key\":\"preload\/sum_lstat\",\"value\":\"\([0-9]*\)\".*/\1/p" \
+		trace >sum-lstat &&
+	test "$(cat sum-lstat)" -gt 0 &&
+	git diff --exit-code
+'
+
+test_expect_success 'read-tree -m -u does not preload the index' '
+	test_when_finished "rm -f trace" &&
+	GIT_TEST_PRELOAD_INDEX=true GIT_TRACE2_EVENT="$(pwd)/trace" \
+		git -c core.preloadIndex=true read-tree -m -u HEAD &&
+	test_region ! unpack_trees preload_index trace
+'
+
 test_expect_success 'reset handles --end-of-options' '
 	git update-ref refs/heads/--foo HEAD^ &&
 	git log -1 --format=%s refs/heads/--foo >expect &&
@@ -1773,6 +1773,42 @@ test_expect_success 'slow status advice when core.untrackedCache true, and fsmon
 	)
 '
 
+test_lazy_prereq BATCH_LSTAT '
+	test-tool batch-lstat .
+'
+
+test_expect_success 'status with batched lstat matches unbatched status' '
+	git init batched &&
+	(
+		cd batched &&
+		for i in $(test_seq 100)
+		do
+			echo $i >file$i || return 1
+		done &&
+		mkdir dir &&
+		echo sub >dir/file &&
+		git add . &&
+		git commit -m initial &&
+		echo changed >file3 &&
+		rm file7 &&
+		rm -r dir &&
+		test-tool chmtime =-60 file5 &&
+		git -c core.preloadIndex=false status --porcelain -uno >expect &&
+		GIT_TEST_PRELOAD_INDEX=true \
+			git -c core.preloadIndex=true status --porcelain -uno >actual &&
+		test_cmp expect actual
+	)
+'
+
+test_expect_success BATCH_LSTAT 'status batches lstat() calls when io_uring is usable' '
+	test_when_finished "rm -rf batched trace sum-batched" &&
+	GIT_TEST_PRELOAD_INDEX=true GIT_TRACE2_EVENT="$(pwd)/trace" \
+		git -C batched -c core.preloadIndex=true status --porcelain -uno &&
+	sed -n "s/.*\"key\":\"preload\/sum_batched\",\"value\":\"\([0-9]*\)\".*/\1/p" \
+		trace >sum-batched &&
+	test "$(cat sum-batched)" -gt 0
+'
+
 test_expect_success EXPENSIVE 'status does not re-read unchanged 4 or 8 GiB file' '
 	(
 		mkdir large-file &&
@@ -423,13 +423,15 @@ test_expect_success 'status succeeds after staging/unstaging' '
 
 # Usage:
 # check_sparse_index_behavior [!]
-# If "!" is supplied, then we verify that we do not call ensure_full_index
-# during a call to 'git status'. Otherwise, we verify that we _do_ call it.
+# If "!" is supplied, then we verify that we do not expand the sparse index
+# during a call to 'git status'. Otherwise, we verify that only the sparse
+# directories leading to the reported paths are expanded.
 check_sparse_index_behavior () {
 	git -C full status --porcelain=v2 >expect &&
 	GIT_TRACE2_EVENT="$(pwd)/trace2.txt" \
 		git -C sparse status --porcelain=v2 >actual &&
-	test_region $1 index ensure_full_index trace2.txt &&
+	test_region $1 index expand_sparse_directory trace2.txt &&
+	test_region ! index ensure_full_index trace2.txt &&
 	test_region fsm_hook query trace2.txt &&
 	test_cmp expect actual &&
 	rm trace2.txt
@@ -468,7 +470,7 @@ test_expect_success 'status succeeds with sparse index' '
 		git -C sparse sparse-checkout set dir1 dir2 &&
 
 		# This one modifies outside the sparse-checkout definition
-		# and hence we expect to expand the sparse-index.
+		# and hence we expect to expand the sparse directory "dir1a/".
 		test_hook --clobber fsmonitor-test <<-\EOF &&
 			printf "last_update_token\0"
 			printf "dir1a/modified\0"
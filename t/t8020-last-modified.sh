@@ -269,6 +269,166 @@ test_expect_success 'last-modified merge undoes changes' '
 	EOF
 '
 
+test_expect_success 'setup history for threads and cache' '
+	git init history &&
+	(
+		cd history &&
+		mkdir -p a/b &&
+		test_commit base a/b/file &&
+		for i in $(test_seq 4)
+		do
+			git checkout -b topic-$i base &&
+			test_commit topic-$i-1 a/file$i &&
+			mkdir -p c &&
+			test_commit topic-$i-2 c/file$i &&
+			git checkout - || return 1
+		done &&
+		git checkout -B main base &&
+		test_commit main-1 file &&
+		git merge -m merge-1 topic-1 topic-2 &&
+		test_commit main-2 a/b/file &&
+		git merge -m merge-2 topic-3 &&
+		test_commit main-3 c/file3 &&
+		git merge -m merge-3 topic-4 &&
+		git commit-graph write --reachable --changed-paths
+	)
+'
+
+compare_threads () {
+	git -C history last-modified "$@" >expect &&
+	rm -f trace &&
+	GIT_TRACE2_EVENT="$(pwd)/trace" \
+		git -C history last-modified --threads=4 "$@" >actual &&
+	sort expect >expect.sorted &&
+	sort actual >actual.sorted &&
+	test_cmp expect.sorted actual.sorted
+}
+
+test_expect_success 'last-modified with threads' '
+	compare_threads -r &&
+	test_trace2_data last-modified threads 4 <trace &&
+	compare_threads -r -t &&
+	compare_threads --max-depth=1 &&
+	compare_threads -r -- c &&
+	compare_threads &&
+	test_trace2_data last-modified threads 3 <trace &&
+	compare_threads -- file &&
+	test_grep ! "\"key\":\"threads\"" trace &&
+	compare_threads -r HEAD^ &&
+	test_trace2_data last-modified threads 4 <trace
+'
+
+test_expect_success 'last-modified with threads needs a plain walk' '
+	compare_threads -r -2 &&
+	test_grep ! "\"key\":\"threads\"" trace &&
+	compare_threads -r topic-1..main &&
+	test_grep ! "\"key\":\"threads\"" trace
+'
+
+test_expect_success 'last-modified with lastModified.threads' '
+	git -C history last-modified -r >expect &&
+	rm -f trace &&
+	GIT_TRACE2_EVENT="$(pwd)/trace" \
+		git -C history -c lastModified.threads=2 last-modified -r >actual &&
+	test_cmp expect actual &&
+	test_trace2_data last-modified threads 2 <trace &&
+	rm -f trace &&
+	GIT_TRACE2_EVENT="$(pwd)/trace" \
+		git -C history -c lastModified.threads=2 last-modified --threads=1 -r &&
+	test_grep ! "\"key\":\"threads\"" trace &&
+	test_must_fail git -C history last-modified --threads=-1 2>err &&
+	test_grep "invalid number of threads" err
+'
+
+compare_cache () {
+	git -C history last-modified "$@" >expect &&
+	rm -f trace &&
+	GIT_TRACE2_EVENT="$(pwd)/trace" \
+		git -C history -c lastModified.cache=true last-modified "$@" >actual &&
+	test_cmp expect actual
+}
+
+test_expect_success 'last-modified cache is not used by default' '
+	git -C history last-modified -r &&
+	test_path_is_missing history/.git/last-modified-cache
+'
+
+test_expect_success 'last-modified writes and reads the cache' '
+	compare_cache -r &&
+	test_trace2_data last-modified-cache hit 0 <trace &&
+	test_trace2_data last-modified-cache written 10 <trace &&
+	compare_cache -r &&
+	test_trace2_data last-modified-cache hit 1 <trace &&
+	test_grep ! written trace &&
+	compare_cache -r -z &&
+	test_trace2_data last-modified-cache hit 1 <trace
+'
+
+test_expect_success 'last-modified cache is keyed on commit and paths' '
+	compare_cache -r -- a &&
+	test_trace2_data last-modified-cache hit 0 <trace &&
+	compare_cache -r -t -- a &&
+	test_trace2_data last-modified-cache hit 0 <trace &&
+	compare_cache -r HEAD^ &&
+	test_trace2_data last-modified-cache hit 0 <trace &&
+	compare_cache -r -- a &&
+	test_trace2_data last-modified-cache hit 1 <trace &&
+	compare_cache -r --threads=4 &&
+	test_trace2_data last-modified-cache hit 1 <trace
+'
+
+test_expect_success 'last-modified results of threads are cached' '
+	compare_cache -r --threads=4 -- c &&
+	test_trace2_data last-modified-cache hit 0 <trace &&
+	compare_cache -r -- c &&
+	test_trace2_data last-modified-cache hit 1 <trace
+'
+
+test_expect_success 'last-modified cache is not used for limited walks' '
+	compare_cache -r -1 &&
+	test_grep ! last-modified-cache trace &&
+	compare_cache -r topic-1..main &&
+	test_grep ! last-modified-cache trace
+'
+
+test_expect_success 'last-modified ignores invalid cache files' '
+	for f in history/.git/last-modified-cache/*
+	do
+		echo garbage >"$f" || return 1
+	done &&
+	compare_cache -r 2>err &&
+	test_grep "ignoring invalid last-modified cache" err &&
+	test_trace2_data last-modified-cache hit 0 <trace &&
+	compare_cache -r 2>err &&
+	test_must_be_empty err &&
+	test_trace2_data last-modified-cache hit 1 <trace
+'
+
+test_expect_success 'last-modified cache keeps the recently used entries' '
+	rm -rf history/.git/last-modified-cache &&
+	test_config -C history lastModified.cacheEntries 2 &&
+	compare_cache -r -- a &&
+	compare_cache -r -- b &&
+	test-tool chmtime =-100 history/.git/last-modified-cache/* &&
+	compare_cache -r -- a &&
+	test_trace2_data last-modified-cache hit 1 <trace &&
+	compare_cache -r -- c &&
+	ls history/.git/last-modified-cache >entries &&
+	test_line_count = 2 entries &&
+	compare_cache -r -- a &&
+	test_trace2_data last-modified-cache hit 1 <trace &&
+	compare_cache -r -- b &&
+	test_trace2_data last-modified-cache hit 0 <trace
+'
+
+test_expect_success 'last-modified cache can be limited to no entries' '
+	rm -rf history/.git/last-modified-cache &&
+	test_config -C history lastModified.cacheEntries 0 &&
+	compare_cache -r &&
+	test_trace2_data last-modified-cache hit 0 <trace &&
+	test_path_is_missing history/.git/last-modified-cache
+'
+
 test_expect_success 'cannot run last-modified on two commits' '
 	test_must_fail git last-modified HEAD HEAD~1 2>err &&
 	test_grep "last-modified can only operate on one commit at a time" err
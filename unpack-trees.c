@@ -30,6 +30,7 @@
 #include "promisor-remote.h"
 #include "entry.h"
 #include "parallel-checkout.h"
+#include "preload-index.h"
 #include "setup.h"
 
 /*
@@ -1914,6 +1915,19 @@ int unpack_trees(unsigned len, struct tree_desc *t, struct unpack_trees_options
 			ensure_full_index(o->dst_index);
 	}
 
+	/*
+	 * A oneway merge that resets and updates the worktree lstat()s
+	 * every entry, one path at a time during the traversal. Let
+	 * preload_index() check them in parallel upfront instead, so
+	 * that oneway_merge() can skip those it marked up to date.
+	 * Other merges only look at the few entries they change.
+	 */
+	if (o->fn == oneway_merge && o->reset && o->update) {
+		trace2_region_enter("unpack_trees", "preload_index", repo);
+		preload_index(o->src_index, o->pathspec, 0);
+		trace2_region_leave("unpack_trees", "preload_index", repo);
+	}
+
 	if (o->reset == UNPACK_RESET_OVERWRITE_UNTRACKED &&
 	    o->preserve_ignored)
 		BUG("UNPACK_RESET_OVERWRITE_UNTRACKED incompatible with preserved ignored files");
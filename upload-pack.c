@@ -34,6 +34,7 @@
 #include "json-writer.h"
 #include "strmap.h"
 #include "promisor-remote.h"
+#include "ref-advert-cache.h"
 
 /* Remember to update object flag allocation in object.h */
 #define THEY_HAVE	(1u << 11)
@@ -65,6 +66,7 @@ enum allow_uor {
  */
 struct upload_pack_data {
 	struct string_list symref;				/* v0 only */
+	struct ref_advert_cache *advert_cache;			/* v0 only */
 	struct object_array want_obj;
 	struct object_array have_obj;
 	struct strmap wanted_refs;				/* v2 only */
@@ -1228,6 +1230,22 @@ static void format_session_id(struct strbuf *buf, struct upload_pack_data *d) {
 		strbuf_addf(buf, " session-id=%s", trace2_session_id());
 }
 
+__attribute__((format (printf, 2, 3)))
+static void write_v0_line(struct upload_pack_data *data, const char *fmt, ...)
+{
+	struct strbuf buf = STRBUF_INIT;
+	va_list args;
+
+	va_start(args, fmt);
+	strbuf_vaddf(&buf, fmt, args);
+	va_end(args);
+
+	packet_fwrite(stdout, buf.buf, buf.len);
+	if (data->advert_cache)
+		ref_advert_cache_add(data->advert_cache, buf.buf, buf.len);
+	strbuf_release(&buf);
+}
+
 static void write_v0_ref(struct upload_pack_data *data,
 			 const struct reference *ref,
 			 const char *refname_nons)
@@ -1263,11 +1281,11 @@ static void write_v0_ref(struct upload_pack_data *data,
 		strbuf_release(&session_id);
 		data->sent_capabilities = 1;
 	} else {
-		packet_fwrite_fmt(stdout, "%s %s\n", oid_to_hex(ref->oid), refname_nons);
+		write_v0_line(data, "%s %s\n", oid_to_hex(ref->oid), refname_nons);
 	}
 	capabilities = NULL;
 	if (!reference_get_peeled_oid(the_repository, ref, &peeled))
-		packet_fwrite_fmt(stdout, "%s %s^{}\n", oid_to_hex(&peeled), refname_nons);
+		write_v0_line(data, "%s %s^{}\n", oid_to_hex(&peeled), refname_nons);
 	return;
 }
 
@@ -1277,6 +1295,27 @@ static int send_ref(const struct reference *ref, void *cb_data)
 	return 0;
 }
 
+static void send_cached_refs(struct upload_pack_data *data)
+{
+	struct ref_advert_cache cache = REF_ADVERT_CACHE_INIT;
+	struct strbuf key = STRBUF_INIT;
+
+	strbuf_addf(&key, "v0\nnamespace=%s\n", get_git_namespace());
+	for (size_t i = 0; i < data->hidden_refs.nr; i++)
+		strbuf_addf(&key, "hide=%s\n", data->hidden_refs.v[i]);
+	ref_advert_cache_init(&cache, the_repository, key.buf);
+
+	if (!ref_advert_cache_replay(&cache, stdout)) {
+		data->advert_cache = &cache;
+		for_each_namespaced_ref_1(send_ref, data);
+		data->advert_cache = NULL;
+		ref_advert_cache_store(&cache);
+	}
+
+	ref_advert_cache_release(&cache);
+	strbuf_release(&key);
+}
+
 static int find_symref(const struct reference *ref, void *cb_data)
 {
 	const char *symref_target;
@@ -1421,7 +1460,17 @@ void upload_pack(const int advertise_refs, const int stateless_rpc,
 			data.no_done = 1;
 		refs_head_ref_namespaced(get_main_ref_store(the_repository),
 					 send_ref, &data);
-		for_each_namespaced_ref_1(send_ref, &data);
+		/*
+		 * The advertisement cache only covers plain ref lines, so
+		 * it cannot be used when the capabilities still have to be
+		 * attached to the first ref. Also, when we are going to
+		 * serve the fetch ourselves we need to mark our refs.
+		 */
+		if (advertise_refs && data.sent_capabilities &&
+		    ref_advert_cache_enabled(the_repository))
+			send_cached_refs(&data);
+		else
+			for_each_namespaced_ref_1(send_ref, &data);
 		if (!data.sent_capabilities) {
 			struct reference ref = {
 				.name = "capabilities^{}",
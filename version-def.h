@@ -0,0 +1,8 @@
+#ifndef VERSION_DEF_H
+#define VERSION_DEF_H
+
+#define GIT_VERSION "2.55.0"
+#define GIT_BUILT_FROM_COMMIT "07f6c1296a265d803f36baca74f2697a81e0b45b"
+#define GIT_USER_AGENT "git/2.55.0"
+
+#endif /* VERSION_DEF_H */